@@ -4,6 +4,76 @@
 #include <stdbool.h>  // Boolean type (bool, true, false)
 #include <sys/stat.h> // For mkdir
 #include <errno.h>    // For errno
+#include <time.h>     // For time, mktime, strftime (due dates)
+#include <limits.h>   // For INT_MAX
+#include <poll.h>     // For poll (sleeping until the next reminder)
+#include <signal.h>   // For signal (auto-reaping notification hooks)
+#include <unistd.h>   // For fork, execl, read, close
+#include <sys/inotify.h> // For inotify (waking the reminder loop when the store changes)
+#include <stdint.h>   // Fixed-width integers (record hashes, on-disk headers)
+#include <fcntl.h>    // For open flags
+#include <sys/mman.h> // For mmap (updating the Merkle tree in place)
+#include <stdarg.h>   // For va_list (formatting operation log entries)
+#include <inttypes.h> // For PRIx64/SCNx64 (log, follower and crdt.txt IDs)
+#include <sys/file.h> // For flock (serializing operation log writers with compaction)
+#include <dirent.h>   // For opendir/readdir (follower positions, backing up the task directory)
+#include <pthread.h>  // For the work-stealing executor and the daemon's workers
+#include <sys/socket.h> // For the daemon's Unix socket
+#include <sys/un.h>     // For sockaddr_un
+#include <sys/epoll.h>  // For the daemon's event loop
+#include <sys/eventfd.h> // For waking the event loop when workers finish requests
+#include <sys/resource.h> // For raising the open file limit of the daemon
+#include <netinet/in.h>   // For the daemon's loopback HTTP listener
+#include <netinet/tcp.h>  // For TCP_NODELAY
+#include <arpa/inet.h>    // For htonl/htons
+#include <ctype.h>        // For isxdigit (decoding HTTP escapes)
+#include <sched.h>        // For sched_yield (idle threads of the work-stealing executor)
+#include <stddef.h>       // For ptrdiff_t
+#include <sys/syscall.h>  // For SYS_futex (sleeping on a shared-memory ring)
+#include <linux/futex.h>  // For FUTEX_WAIT/FUTEX_WAKE and futex_waitv
+
+// Static tracepoints (USDT) for bpftrace, perf and SystemTap, e.g.
+//   bpftrace -e 'usdt:./tasakman:tasakman:mutation__start { @start[tid] = nsecs; }'
+// Each probe is a single nop plus an ELF note (.note.stapsdt) naming it and where its arguments
+// are, in the format of <sys/sdt.h>, so a disabled probe costs a nop. Arguments are passed as
+// 64-bit values (strings as pointers). Build with -DTASAKMAN_NO_PROBES to leave them out.
+#if defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__)) && !defined(TASAKMAN_NO_PROBES)
+#define TASAKMAN_PROBE_NOTE(name, args)                                              \
+    "990: nop\n"                                                                     \
+    ".pushsection .note.stapsdt,\"\",\"note\"\n"                                     \
+    ".balign 4\n"                                                                    \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                               \
+    "991: .asciz \"stapsdt\"\n"                                                      \
+    "992: .balign 4\n"                                                               \
+    "993: .8byte 990b, _.stapsdt.base, 0\n" /* Probe address, base, no semaphore */ \
+    ".asciz \"tasakman\"\n"                                                          \
+    ".asciz \"" #name "\"\n"                                                         \
+    ".asciz \"" args "\"\n"                                                          \
+    "994: .balign 4\n"                                                               \
+    ".popsection\n"                                                                  \
+    ".ifndef _.stapsdt.base\n" /* Lets tools correct for prelinking, as sdt.h does */ \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"          \
+    ".weak _.stapsdt.base\n"                                                         \
+    ".hidden _.stapsdt.base\n"                                                       \
+    "_.stapsdt.base: .space 1\n"                                                     \
+    ".size _.stapsdt.base, 1\n"                                                      \
+    ".popsection\n"                                                                  \
+    ".endif\n"
+#define TASAKMAN_PROBE_ARG(value) "r"((int64_t)(intptr_t)(value))
+#define TASAKMAN_PROBE0(name) __asm__ __volatile__(TASAKMAN_PROBE_NOTE(name, ""))
+#define TASAKMAN_PROBE1(name, a1) \
+    __asm__ __volatile__(TASAKMAN_PROBE_NOTE(name, "-8@%0") : : TASAKMAN_PROBE_ARG(a1))
+#define TASAKMAN_PROBE2(name, a1, a2) \
+    __asm__ __volatile__(TASAKMAN_PROBE_NOTE(name, "-8@%0 -8@%1") : : TASAKMAN_PROBE_ARG(a1), TASAKMAN_PROBE_ARG(a2))
+#define TASAKMAN_PROBE3(name, a1, a2, a3)                                       \
+    __asm__ __volatile__(TASAKMAN_PROBE_NOTE(name, "-8@%0 -8@%1 -8@%2") : :    \
+                         TASAKMAN_PROBE_ARG(a1), TASAKMAN_PROBE_ARG(a2), TASAKMAN_PROBE_ARG(a3))
+#else
+#define TASAKMAN_PROBE0(name) ((void)0)
+#define TASAKMAN_PROBE1(name, a1) ((void)(a1))
+#define TASAKMAN_PROBE2(name, a1, a2) ((void)(a1), (void)(a2))
+#define TASAKMAN_PROBE3(name, a1, a2, a3) ((void)(a1), (void)(a2), (void)(a3))
+#endif
 
 // Define ANSI color codes for terminal output
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -20,58 +90,525 @@
 // Define the directory and filename components
 #define TASK_DIR_SUFFIX "/.local/taskmanager"
 #define TASK_FILENAME "tasks.txt"
+#define DUE_FILENAME "due.txt" // Sidecar file with one "ID,EPOCH" line per task that has a due date
+#define REMIND_FILENAME "remind.sent" // Due entries 'remind' has already delivered, in the due.txt format
+#define REMIND_CATCH_UP 16 // Overdue reminders delivered individually when 'remind' catches up
+#define MERKLE_FILENAME "merkle.bin" // Persisted Merkle tree of record hashes, used by 'diff'
+#define OPLOG_FILENAME "oplog.txt" // Append-only log of mutations, tailed by 'replicate'
+#define FOLLOWERS_DIRNAME "followers" // One file per follower with the log position it has applied
+#define OPLOG_COMPACT_BYTES (1 << 20) // Log size past which applied entries are dropped from its front
+#define OPLOG_RETAIN_MAX (64LL << 20) // Most log kept for a lagging follower (it re-copies the store after that)
+#define CREATED_FILENAME "created.txt" // Creation times of tasks whose 'A' entry compaction dropped from the log
+#define REPLICA_OFFSET_FILENAME "replica.offset" // Oplog position a follower store has applied
+#define CRDT_FILENAME "crdt.txt" // Append-only record identities and status clocks, used by 'merge'
+#define FINGERPRINT_FILENAME "fingerprints.bin" // Hash set of pending descriptions, used by 'add --unique'
+#define POLICY_FILENAME "policy.txt" // Store policies set with the 'policy' command
+#define DAEMON_SOCKET_FILENAME "daemon.sock" // Unix socket the daemon ('serve') listens on
+#define DAEMON_LOCK_FILENAME "daemon.lock" // Held (flock) by the daemon for as long as it runs
+#define DAEMON_IDLE_MINUTES 10 // An auto-started daemon exits after this long without requests
+// Per-connection limits of the daemon
+#define DAEMON_MAX_REQUEST 65536         // Longest request line accepted
+#define DAEMON_OUTPUT_HIGH_WATER 1048576 // Stop taking requests from a client with this much unsent output
+// Binary daemon protocol (see "Binary wire protocol" below)
+#define WIRE_MAGIC 0xB7          // First byte sent by a binary client
+#define WIRE_MAX_FRAME 1048576   // Largest frame accepted
+#define WIRE_LIST_CHUNK 65536    // Listings are streamed in chunks of about this size
+// Shared-memory rings between a client and the daemon (see "Shared-memory rings" below)
+#define RING_SLOTS 64            // Requests a ring client may have in flight (a power of two)
+#define RING_MAX_IDS 62          // Task IDs carried by one ring request
+#define RING_SPIN 1000           // Polls of a ring before sleeping on its futex (with 2+ CPUs)
+#define RING_WAIT_MS 100         // Longest futex sleep before checking the other side is still there
+#define RING_MAX_CLIENTS 64      // Rings a daemon serves at once; more clients use the socket
+// Content-defined chunking parameters for 'backup' (FastCDC-style, 8 KiB average chunks)
+#define CDC_MIN_CHUNK 2048
+#define CDC_AVG_CHUNK 8192
+#define CDC_MAX_CHUNK 65536
+// Number of consecutive task IDs covered by one Merkle leaf
+#define MERKLE_LEAF_SPAN 64
 // Define a maximum path length (e.g., for full path to tasks.txt)
 #define MAX_PATH_LEN 512
 
-// Global buffer for the full task file path
-// This will store the path like "/home/youruser/.local/taskmanager/tasks.txt"
-char full_task_file_path[MAX_PATH_LEN];
+// Global buffer for the task directory path
+// This will store the path like "/home/youruser/.local/taskmanager"; it is only used to open the
+// directory, to name the daemon socket and in messages
+char task_dir_path[MAX_PATH_LEN];
+// The task directory, opened once by main(); the store files are opened relative to it
+int task_dir_fd = -1;
+
+// Function to build the full path of a file in the task directory into path[MAX_PATH_LEN]
+// Returns false if it does not fit.
+bool storeFilePath(char *path, const char *name) {
+    int length = snprintf(path, MAX_PATH_LEN, "%s/%s", task_dir_path, name);
+    return length >= 0 && length < MAX_PATH_LEN;
+}
+
+// Bump allocator for the temporary data of one command (or one daemon request)
+// Descriptions, scratch vectors and the like are carved out of large blocks and never freed one
+// by one; the whole arena is released in one go when the command or request is done.
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;  // Previously filled block
+    size_t size, used;
+    // Data follows
+} ArenaBlock;
 
-// Structure to represent a single task
 typedef struct {
-    int id;
-    char description[MAX_DESCRIPTION_LEN];
-    bool completed; // true if completed, false if pending
-} Task;
+    ArenaBlock *blocks;       // Current block first
+    size_t allocations;       // Since the last reset (reported by --trace)
+    size_t bytes;
+    size_t block_count;
+} Arena;
+
+// Allocation totals of arenas released so far in this process (reported by --trace)
+struct {
+    size_t allocations, bytes, blocks;
+} arena_totals;
 
-// Function to ensure the ~/.local/taskmanager directory exists
-void ensure_task_directory_exists() {
-    char task_dir[MAX_PATH_LEN];
-    const char *home_dir = getenv("HOME");
-    if (home_dir == NULL) {
-        fprintf(stderr, "Error: HOME environment variable not set. Cannot create task directory.\n");
-        exit(EXIT_FAILURE); // Exit if home directory cannot be found
+// Arena of the command or request the calling thread is working on (see scratchArena())
+__thread Arena *current_arena = NULL;
+Arena command_arena; // The main thread's
+bool trace_enabled = false; // --trace: report the cost of commands (and daemon requests) on stderr
+// --mem-limit / TASAKMAN_MEM_LIMIT: bytes a command may buffer (0: no limit). Paths that would
+// hold more stream or spill to disk instead.
+size_t memory_limit = 0;
+
+// Function to parse a byte size like "512M", "2G", "64k" or "1048576"
+// Returns false if it is malformed or zero.
+bool parseByteSize(const char *text, size_t *bytes) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 0;
+    if (*end == 'k' || *end == 'K') shift = 10;
+    else if (*end == 'm' || *end == 'M') shift = 20;
+    else if (*end == 'g' || *end == 'G') shift = 30;
+    if (shift != 0 && (end[1] == '\0' || ((end[1] == 'b' || end[1] == 'B') && end[2] == '\0'))) end += strlen(end);
+    if (end == text || *end != '\0' || value == 0 || value > (SIZE_MAX >> shift)) {
+        return false;
     }
+    *bytes = (size_t)value << shift;
+    return true;
+}
 
-    // Construct the full path to the task directory
-    snprintf(task_dir, sizeof(task_dir), "%s%s", home_dir, TASK_DIR_SUFFIX);
+// Function to allocate from an arena (16-byte aligned; never returns NULL unless out of memory)
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE / 4 ? size : ARENA_BLOCK_SIZE; // Big requests get their own block
+        block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + block_size + 15);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+        if (size > ARENA_BLOCK_SIZE / 4 && arena->blocks != NULL) { // Keep filling the current block
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+        arena->block_count++;
+    }
+    char *data = (char *)(((uintptr_t)(block + 1) + 15) & ~(uintptr_t)15);
+    void *result = data + block->used;
+    block->used += size;
+    arena->allocations++;
+    arena->bytes += size;
+    return result;
+}
 
-    // Check if the directory exists
-    struct stat st = {0};
-    if (stat(task_dir, &st) == -1) {
-        // Directory does not exist, try to create it
-        // 0700 gives read, write, execute permissions to the owner only
-        if (mkdir(task_dir, 0700) == -1) {
-            // Check if error is due to directory already existing (e.g., race condition)
-            if (errno != EEXIST) {
-                perror("Error creating task directory");
-                exit(EXIT_FAILURE); // Exit if directory cannot be created for other reasons
+// Function to copy a string into an arena
+char *arenaStrdup(Arena *arena, const char *text) {
+    size_t length = strlen(text);
+    char *copy = (char *)arenaAlloc(arena, length + 1);
+    if (copy != NULL) memcpy(copy, text, length + 1);
+    return copy;
+}
+
+// Function to grow an arena allocation (a vector being appended to)
+// The last allocation of the current block grows in place; anything else is copied.
+void *arenaGrow(Arena *arena, void *data, size_t old_size, size_t new_size) {
+    ArenaBlock *block = arena->blocks;
+    old_size = (old_size + 15) & ~(size_t)15;
+    size_t grown = ((new_size + 15) & ~(size_t)15) - old_size;
+    if (data != NULL && block != NULL) {
+        char *base = (char *)(((uintptr_t)(block + 1) + 15) & ~(uintptr_t)15);
+        if ((char *)data + old_size == base + block->used && block->size - block->used >= grown) {
+            block->used += grown;
+            arena->bytes += grown;
+            return data;
+        }
+    }
+    void *moved = arenaAlloc(arena, new_size);
+    if (moved != NULL && data != NULL) memcpy(moved, data, old_size < new_size ? old_size : new_size);
+    return moved;
+}
+
+// Function to release everything allocated from an arena
+// The first block is kept for the next command when 'keep' is set (daemon workers reuse theirs).
+void arenaReset(Arena *arena, bool keep) {
+    __atomic_add_fetch(&arena_totals.allocations, arena->allocations, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&arena_totals.bytes, arena->bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&arena_totals.blocks, arena->block_count, __ATOMIC_RELAXED);
+    ArenaBlock *kept = NULL;
+    for (ArenaBlock *block = arena->blocks; block != NULL;) {
+        ArenaBlock *next = block->next;
+        if (keep && kept == NULL && block->size == ARENA_BLOCK_SIZE) {
+            kept = block;
+            kept->used = 0;
+            kept->next = NULL;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+    arena->blocks = kept;
+    arena->allocations = arena->bytes = arena->block_count = 0;
+}
+
+// Function to get the arena of the calling thread's command or request
+// main() and the daemon's workers set current_arena; any other thread gets one of its own.
+Arena *scratchArena() {
+    if (current_arena == NULL) {
+        current_arena = (Arena *)calloc(1, sizeof(Arena));
+    }
+    return current_arena;
+}
+
+// Operations the daemon times for 'tasakman metrics'
+// Requests are timed on the thread that serves them; a commit is one append to or rewrite of
+// tasks.txt, whichever request caused it.
+typedef enum {
+    METRIC_ADD,
+    METRIC_LIST,
+    METRIC_DONE,
+    METRIC_PENDING,
+    METRIC_DELETE,
+    METRIC_DUE,
+    METRIC_SEARCH,
+    METRIC_COMMIT,
+    METRIC_OP_COUNT
+} MetricOp;
+
+const char *const metric_op_names[METRIC_OP_COUNT] = {"add", "list", "done", "pending", "delete", "due", "search", "commit"};
+
+// Counters kept by the daemon
+typedef enum {
+    COUNTER_STORE_READ,    // Bytes of tasks.txt read (version loads, adds and rewrites)
+    COUNTER_STORE_WRITTEN, // Bytes of tasks.txt written
+    COUNTER_RECEIVED,      // Bytes received from clients
+    COUNTER_SENT,          // Bytes sent to clients
+    COUNTER_CACHE_HITS,    // HTTP listings answered from the render cache
+    COUNTER_CACHE_MISSES,  // HTTP listings that had to be rendered first
+    COUNTER_VERSION_LOADS, // Store versions loaded from tasks.txt
+    COUNTER_VERSION_EXTENDS, // Store versions built from the previous one plus appended rows
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Names of each counter: for 'tasakman metrics', and in the Prometheus format with its help text
+const char *const metric_counter_labels[METRIC_COUNTER_COUNT][3] = {
+    {"store bytes read", "tasakman_store_read_bytes_total", "Bytes of tasks.txt read."},
+    {"store bytes written", "tasakman_store_written_bytes_total", "Bytes of tasks.txt written."},
+    {"client bytes received", "tasakman_client_received_bytes_total", "Bytes received from clients."},
+    {"client bytes sent", "tasakman_client_sent_bytes_total", "Bytes sent to clients."},
+    {"listing cache hits", "tasakman_listing_cache_hits_total", "HTTP listings answered from the render cache."},
+    {"listing cache misses", "tasakman_listing_cache_misses_total", "HTTP listings rendered on demand."},
+    {"version loads", "tasakman_version_loads_total", "Store versions loaded from tasks.txt."},
+    {"version extends", "tasakman_version_extends_total", "Store versions built from the previous one plus appended tasks."},
+};
+
+// Latency histograms are HDR-style: one bucket per nanosecond below 2^LATENCY_SUB_BITS, then
+// 2^LATENCY_SUB_BITS equal buckets per power of two, so a bucket is never wider than 1/16 of the
+// values in it. Latencies from 2^LATENCY_MAX_BITS ns (about 69 s) on share the last bucket.
+#define LATENCY_SUB_BITS 4
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+// Metrics recorded by one daemon thread
+// Only the owning thread writes its shard, so recording is a few plain (relaxed) stores with no
+// locked instructions and no shared cache lines; readers add the shards up.
+typedef struct {
+    uint64_t latency[METRIC_OP_COUNT][LATENCY_BUCKETS];
+    uint64_t latency_sum[METRIC_OP_COUNT]; // Nanoseconds
+    uint64_t latency_max[METRIC_OP_COUNT];
+    uint64_t counters[METRIC_COUNTER_COUNT];
+} MetricShard;
+
+#define METRIC_SHARDS 256
+MetricShard *metric_shards[METRIC_SHARDS];
+int metric_shard_count = 0;
+// Shards of threads that have exited, handed to the next thread that records something
+MetricShard *metric_free_shards[METRIC_SHARDS];
+int metric_free_count = 0;
+pthread_mutex_t metric_shard_lock = PTHREAD_MUTEX_INITIALIZER; // Guards the free list and new shards
+pthread_key_t metric_shard_key; // Its destructor returns a thread's shard to the free list
+pthread_once_t metric_shard_once = PTHREAD_ONCE_INIT;
+__thread MetricShard *metric_shard = NULL;
+bool metrics_enabled = false; // Set by serveDaemon(); commands run directly record nothing
+uint64_t metrics_started = 0; // When the daemon started (CLOCK_MONOTONIC nanoseconds)
+__thread int request_metric = -1; // MetricOp of the request the worker is serving (-1: not timed)
+
+// Function to read the monotonic clock used for latencies, in nanoseconds
+uint64_t monotonicNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Function to start timing an operation: 0 (nothing to record) unless this is the daemon
+uint64_t metricClock() {
+    return metrics_enabled ? monotonicNanoseconds() : 0;
+}
+
+// Function to put the shard of an exiting thread on the free list (the key's destructor)
+// The shard keeps its numbers, which still count towards the totals; its next owner adds to them.
+void releaseMetricShard(void *shard) {
+    pthread_mutex_lock(&metric_shard_lock);
+    metric_free_shards[metric_free_count++] = (MetricShard *)shard;
+    pthread_mutex_unlock(&metric_shard_lock);
+}
+
+// Function to create the key that tells when a thread with a shard exits
+void createMetricShardKey() {
+    pthread_key_create(&metric_shard_key, releaseMetricShard);
+}
+
+// Function to get the calling thread's shard (NULL if the daemon has too many threads)
+// A thread's first recording takes the shard of a thread that has exited, or else a new one, so
+// the number of shards follows the most threads alive at once rather than all ever started.
+MetricShard *metricShard() {
+    if (metric_shard == NULL) {
+        pthread_once(&metric_shard_once, createMetricShardKey);
+        MetricShard *shard = NULL;
+        pthread_mutex_lock(&metric_shard_lock);
+        if (metric_free_count > 0) {
+            shard = metric_free_shards[--metric_free_count];
+        } else if (metric_shard_count < METRIC_SHARDS && (shard = (MetricShard *)calloc(1, sizeof(MetricShard))) != NULL) {
+            __atomic_store_n(&metric_shards[metric_shard_count], shard, __ATOMIC_RELEASE);
+            __atomic_store_n(&metric_shard_count, metric_shard_count + 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&metric_shard_lock);
+        if (shard == NULL) {
+            return NULL;
+        }
+        metric_shard = shard;
+        pthread_setspecific(metric_shard_key, shard);
+    }
+    return metric_shard;
+}
+
+// Function to add to a value of the calling thread's shard (its only writer)
+static inline void metricAdd(uint64_t *value, uint64_t amount) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// Function to find the histogram bucket of a latency
+static inline size_t latencyBucket(uint64_t nanoseconds) {
+    if (nanoseconds < (1ULL << LATENCY_SUB_BITS)) {
+        return (size_t)nanoseconds;
+    }
+    int top = 63 - __builtin_clzll(nanoseconds);
+    if (top >= LATENCY_MAX_BITS) {
+        return LATENCY_BUCKETS - 1;
+    }
+    int shift = top - LATENCY_SUB_BITS;
+    return ((size_t)(shift + 1) << LATENCY_SUB_BITS) + ((nanoseconds >> shift) & ((1ULL << LATENCY_SUB_BITS) - 1));
+}
+
+// Function to get the highest latency that falls in a bucket
+uint64_t latencyBucketHigh(size_t bucket) {
+    if (bucket < (1ULL << LATENCY_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (int)(bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t low = ((1ULL << LATENCY_SUB_BITS) + (bucket & ((1ULL << LATENCY_SUB_BITS) - 1))) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+// Function to record the latency of an operation that started at 'started' (from metricClock())
+void recordLatency(MetricOp op, uint64_t started) {
+    MetricShard *shard;
+    if (started == 0 || (shard = metricShard()) == NULL) {
+        return;
+    }
+    uint64_t elapsed = monotonicNanoseconds() - started;
+    metricAdd(&shard->latency[op][latencyBucket(elapsed)], 1);
+    metricAdd(&shard->latency_sum[op], elapsed);
+    if (elapsed > shard->latency_max[op]) {
+        __atomic_store_n(&shard->latency_max[op], elapsed, __ATOMIC_RELAXED);
+    }
+}
+
+// Function to add to one of the daemon's counters
+void countMetric(MetricCounter counter, uint64_t amount) {
+    MetricShard *shard;
+    if (metrics_enabled && (shard = metricShard()) != NULL) {
+        metricAdd(&shard->counters[counter], amount);
+    }
+}
+
+// Function to find the operation a command name is timed as (-1 if it is not timed)
+int metricOpByName(const char *command) {
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        if (strcmp(command, metric_op_names[op]) == 0) return op;
+    }
+    return -1;
+}
+
+// Function to add up the shards of every thread into one (the caller frees it)
+MetricShard *snapshotMetrics() {
+    MetricShard *total = (MetricShard *)calloc(1, sizeof(MetricShard));
+    int shard_count = __atomic_load_n(&metric_shard_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < shard_count; i++) {
+        MetricShard *shard = __atomic_load_n(&metric_shards[i], __ATOMIC_ACQUIRE);
+        for (int op = 0; op < METRIC_OP_COUNT; op++) {
+            for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+                total->latency[op][b] += __atomic_load_n(&shard->latency[op][b], __ATOMIC_RELAXED);
             }
+            total->latency_sum[op] += __atomic_load_n(&shard->latency_sum[op], __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&shard->latency_max[op], __ATOMIC_RELAXED);
+            if (max > total->latency_max[op]) total->latency_max[op] = max;
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            total->counters[c] += __atomic_load_n(&shard->counters[c], __ATOMIC_RELAXED);
         }
     }
+    return total;
 }
 
-// Function to get the next available task ID
-// Reads the file to find the highest existing ID and returns highest + 1
-int getNextTaskId() {
-    // Use the global full_task_file_path
-    FILE *file = fopen(full_task_file_path, "r"); // Open the task file in read mode
-    if (file == NULL) {
-        // If file doesn't exist, it's fine, we'll create it when adding the first task.
-        // errno will be ENOENT (No such file or directory) which is expected.
-        return 1; // Start with ID 1 if file doesn't exist
+// Function to get a latency percentile (0 < q <= 1) from a histogram, at bucket precision
+uint64_t latencyPercentile(const uint64_t *buckets, uint64_t count, uint64_t max, double q) {
+    uint64_t rank = (uint64_t)(q * (double)count + 0.999999), seen = 0;
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank && seen > 0) {
+            uint64_t high = latencyBucketHigh(b);
+            return high < max ? high : max;
+        }
+    }
+    return max;
+}
+
+// Function to format a latency in nanoseconds with a fitting unit ("850ns", "41.2us", "3.05ms")
+void formatLatency(char *text, size_t size, uint64_t nanoseconds) {
+    if (nanoseconds < 1000) snprintf(text, size, "%lluns", (unsigned long long)nanoseconds);
+    else if (nanoseconds < 1000000) snprintf(text, size, "%.1fus", nanoseconds / 1e3);
+    else if (nanoseconds < 1000000000) snprintf(text, size, "%.2fms", nanoseconds / 1e6);
+    else snprintf(text, size, "%.2fs", nanoseconds / 1e9);
+}
+
+// Function to print the daemon's metrics, as a table or in the Prometheus text format
+// Prometheus histograms get fixed buckets from 10us to 10s; each count includes the HDR buckets
+// that end at or below the bound, so it can fall short by up to 1/16 of the bound.
+void printMetrics(FILE *out, bool prometheus) {
+    MetricShard *total = snapshotMetrics();
+    uint64_t counts[METRIC_OP_COUNT];
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        counts[op] = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) counts[op] += total->latency[op][b];
+    }
+    double uptime = (double)(monotonicNanoseconds() - metrics_started) / 1e9;
+
+    if (prometheus) {
+        static const double bounds[] = {1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+                                        1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+        fprintf(out, "# HELP tasakman_operation_duration_seconds Time to serve an operation (a commit is one write of tasks.txt).\n");
+        fprintf(out, "# TYPE tasakman_operation_duration_seconds histogram\n");
+        for (int op = 0; op < METRIC_OP_COUNT; op++) {
+            uint64_t cumulative = 0;
+            size_t b = 0;
+            for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+                uint64_t bound = (uint64_t)(bounds[i] * 1e9);
+                for (; b < LATENCY_BUCKETS && latencyBucketHigh(b) <= bound; b++) cumulative += total->latency[op][b];
+                fprintf(out, "tasakman_operation_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+                        metric_op_names[op], bounds[i], (unsigned long long)cumulative);
+            }
+            fprintf(out, "tasakman_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                    metric_op_names[op], (unsigned long long)counts[op]);
+            fprintf(out, "tasakman_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", metric_op_names[op], total->latency_sum[op] / 1e9);
+            fprintf(out, "tasakman_operation_duration_seconds_count{op=\"%s\"} %llu\n", metric_op_names[op], (unsigned long long)counts[op]);
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", metric_counter_labels[c][1], metric_counter_labels[c][2],
+                    metric_counter_labels[c][1], metric_counter_labels[c][1], (unsigned long long)total->counters[c]);
+        }
+        fprintf(out, "# HELP tasakman_uptime_seconds Time since the daemon started.\n# TYPE tasakman_uptime_seconds gauge\n");
+        fprintf(out, "tasakman_uptime_seconds %.3f\n", uptime);
+    } else {
+        fprintf(out, "Daemon metrics over %.0f s:\n", uptime);
+        fprintf(out, "%-10s %10s %10s %10s %10s %10s %10s\n", "operation", "count", "mean", "p50", "p90", "p99", "max");
+        for (int op = 0; op < METRIC_OP_COUNT; op++) {
+            char mean[16] = "-", p50[16] = "-", p90[16] = "-", p99[16] = "-", max[16] = "-";
+            if (counts[op] > 0) {
+                const uint64_t *buckets = total->latency[op];
+                uint64_t highest = total->latency_max[op];
+                formatLatency(mean, sizeof(mean), total->latency_sum[op] / counts[op]);
+                formatLatency(p50, sizeof(p50), latencyPercentile(buckets, counts[op], highest, 0.50));
+                formatLatency(p90, sizeof(p90), latencyPercentile(buckets, counts[op], highest, 0.90));
+                formatLatency(p99, sizeof(p99), latencyPercentile(buckets, counts[op], highest, 0.99));
+                formatLatency(max, sizeof(max), highest);
+            }
+            fprintf(out, "%-10s %10llu %10s %10s %10s %10s %10s\n", metric_op_names[op],
+                    (unsigned long long)counts[op], mean, p50, p90, p99, max);
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            fprintf(out, "%-22s %llu\n", metric_counter_labels[c][0], (unsigned long long)total->counters[c]);
+        }
+    }
+    free(total);
+}
+
+// Function to open the ~/.local/taskmanager directory, creating it if it doesn't exist
+// Uses the global task_dir_path, which main() sets from HOME (or TASAKMAN_DIR). The path is
+// resolved once here; everything else goes through task_dir_fd with the *at() calls.
+void openTaskDirectory() {
+    task_dir_fd = open(task_dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task_dir_fd == -1 && errno == ENOENT) {
+        // Directory does not exist, try to create it
+        // 0700 gives read, write, execute permissions to the owner only
+        // EEXIST means another process created it in the meantime (race condition)
+        if (mkdir(task_dir_path, 0700) == -1 && errno != EEXIST) {
+            perror("Error creating task directory");
+            exit(EXIT_FAILURE); // Exit if directory cannot be created for other reasons
+        }
+        task_dir_fd = open(task_dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     }
+    if (task_dir_fd == -1) {
+        perror("Error opening task directory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Function to open a file relative to a store directory (the task directory, a follower, ...)
+// Files created this way are private to the owner, like the task directory itself.
+int openDirectoryFile(int dir_fd, const char *name, int flags) {
+    return openat(dir_fd, name, flags | O_CLOEXEC, 0600);
+}
+
+// Function to open a file relative to a store directory as a stdio stream ('mode' must agree with 'flags')
+FILE *openDirectoryStream(int dir_fd, const char *name, int flags, const char *mode) {
+    int fd = openDirectoryFile(dir_fd, name, flags);
+    FILE *file = fd != -1 ? fdopen(fd, mode) : NULL;
+    if (file == NULL && fd != -1) close(fd);
+    return file;
+}
+
+// Function to open a file of the store (e.g. TASK_FILENAME) relative to the task directory
+int openStoreFile(const char *name, int flags) {
+    return openDirectoryFile(task_dir_fd, name, flags);
+}
 
+// Function to open a file of the store as a stdio stream ('mode' must agree with 'flags')
+FILE *openStoreStream(const char *name, int flags, const char *mode) {
+    return openDirectoryStream(task_dir_fd, name, flags, mode);
+}
+
+// Function to get the next available task ID
+// Reads the task file from its current position to find the highest existing ID and returns
+// highest + 1. The caller owns the file, so adding tasks needs only one open of tasks.txt.
+int getNextTaskId(FILE *file) {
     int maxId = 0;
     char line[MAX_DESCRIPTION_LEN + 20]; // Buffer for a whole line (ID,STATUS,DESCRIPTION)
     while (fgets(line, sizeof(line), file) != NULL) { // Read file line by line
@@ -83,265 +620,8698 @@ int getNextTaskId() {
             }
         }
     }
-    fclose(file); // Close the file
     return maxId + 1; // Return the next available ID
 }
 
-// Function to add a new task
-void addTask(const char *description) {
-    // Use the global full_task_file_path
-    FILE *file = fopen(full_task_file_path, "a"); // Open in append mode (creates file if it doesn't exist)
-    if (file == NULL) {
-        perror("Error opening task file for writing"); // Print system error message
-        return;
+// Function to finalize a 64-bit hash value (MurmurHash3 fmix64)
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Function to hash a byte range, eight bytes at a time
+uint64_t hashBytes(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = seed ^ (length * 0x9e3779b97f4a7c15ULL);
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ mix64(word)) * 0x9e3779b97f4a7c15ULL;
+        bytes += 8;
+        length -= 8;
     }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes, length); // Remaining 0-7 bytes
+    hash ^= mix64(tail ^ length);
+    return mix64(hash);
+}
 
-    int id = getNextTaskId(); // Get a new unique ID
-    // Write task in format: ID,STATUS,DESCRIPTION\n
-    // STATUS: 0 for pending, 1 for completed
-    fprintf(file, "%d,%d,%s\n", id, 0, description); // Write the new task (initially pending)
-    fclose(file); // Close the file
-    printf("Task added: ID %d - \"%s\"\n", id, description); // Confirm to user
+// Function to hash a task record in its canonical "ID,STATUS,DESCRIPTION" form
+uint64_t recordHash(int id, int status, const char *description) {
+    char record[MAX_DESCRIPTION_LEN + 32];
+    int length = snprintf(record, sizeof(record), "%d,%d,%s", id, status, description);
+    return hashBytes(record, (size_t)length, 0);
 }
 
-// Function to list all tasks
-void listTasks() {
-    // Use the global full_task_file_path
-    FILE *file = fopen(full_task_file_path, "r"); // Open in read mode
-    if (file == NULL) {
-        printf("No tasks found. Create one using 'add' command.\n"); // Inform if file doesn't exist
-        return;
+// Longest description kept inside its TaskText slot instead of the arena
+#define TASK_INLINE_TEXT 11
+
+// Description slot of one task (16 bytes)
+typedef struct {
+    uint32_t length;
+    union {
+        char text[TASK_INLINE_TEXT + 1]; // The description itself when it is short enough
+        uint32_t offset[2];              // Otherwise its position in the arena (low, high words)
+    };
+} TaskText;
+
+// In-memory table of tasks, stored as a structure of arrays
+// IDs, statuses and descriptions are separate columns, so a scan only touches the columns it
+// needs: a status filter reads one bit per task. Long descriptions are NUL-terminated strings
+// packed into one arena, so memory follows the actual text rather than MAX_DESCRIPTION_LEN.
+// The arena is interned: tasks with the same description (as automated producers tend to add)
+// share one copy, found through a hash index while the table is being built.
+typedef struct {
+    size_t count, capacity;
+    int *ids;
+    uint64_t *done;           // Bit i is set when task i is done
+    TaskText *texts;
+    char *arena;              // Distinct descriptions longer than TASK_INLINE_TEXT
+    size_t arena_length, arena_capacity;
+    uint32_t *interned;       // Open-addressing index of the arena: row + 1 of each string's first use
+    size_t interned_count, interned_capacity;
+} TaskTable;
+
+// Function to make room for 'needed' tasks and 'arena_needed' bytes of arena in a table
+void reserveTaskTable(TaskTable *table, size_t needed, size_t arena_needed) {
+    if (needed > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity : 64;
+        while (capacity < needed) capacity *= 2;
+        table->ids = (int *)realloc(table->ids, capacity * sizeof(int));
+        table->texts = (TaskText *)realloc(table->texts, capacity * sizeof(TaskText));
+        size_t words = table->capacity ? table->capacity / 64 + 1 : 0; // Bitset words in use so far
+        table->done = (uint64_t *)realloc(table->done, (capacity / 64 + 1) * sizeof(uint64_t));
+        memset(table->done + words, 0, (capacity / 64 + 1 - words) * sizeof(uint64_t));
+        table->capacity = capacity;
+    }
+    if (arena_needed > table->arena_capacity) {
+        size_t capacity = table->arena_capacity ? table->arena_capacity : 4096;
+        while (capacity < arena_needed) capacity *= 2;
+        table->arena = (char *)realloc(table->arena, capacity);
+        table->arena_capacity = capacity;
     }
+}
 
-    printf("\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
-    char line[MAX_DESCRIPTION_LEN + 20]; // Buffer for reading lines
-    int count = 0;
-    while (fgets(line, sizeof(line), file) != NULL) { // Read file line by line
-        int id, status;
-        char description[MAX_DESCRIPTION_LEN];
-        // Parse the line: ID,STATUS,DESCRIPTION
-        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) == 3) {
-            // Print task details formatted with colors
-            const char* status_text = (status == 1 ? "[DONE]" : "[PENDING]");
-            const char* status_color = (status == 1 ? ANSI_COLOR_GREEN : ANSI_COLOR_YELLOW);
-
-            printf("%sID: %-4d%s Status: %s%-10s%s Description: %s%s\n",
-                   ANSI_COLOR_CYAN, id, ANSI_COLOR_RESET, // ID in Cyan
-                   status_color, status_text, ANSI_COLOR_RESET, // Status in Green/Yellow
-                   description, ANSI_COLOR_RESET); // Description (default color)
-            count++;
+// Function to get the arena offset of a task's description (only for spilled descriptions)
+uint64_t taskTextOffset(const TaskText *text) {
+    return (uint64_t)text->offset[1] << 32 | text->offset[0];
+}
+
+// Function to get the description of a task in a table (NUL-terminated)
+const char *taskDescription(const TaskTable *table, size_t row) {
+    const TaskText *text = &table->texts[row];
+    if (text->length <= TASK_INLINE_TEXT) {
+        return text->text;
+    }
+    return table->arena + taskTextOffset(text);
+}
+
+// Function to find a description in a table's arena, adding it if it is new
+// 'row' is the task about to use it. Returns the arena offset of the shared copy.
+uint64_t internDescription(TaskTable *table, const char *description, size_t length, size_t row) {
+    if (2 * (table->interned_count + 1) > table->interned_capacity) { // Keep the index at most half full
+        size_t capacity = table->interned_capacity ? table->interned_capacity * 2 : 1024;
+        uint32_t *slots = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+        for (size_t i = 0; i < table->interned_capacity; i++) {
+            uint32_t used = table->interned[i];
+            if (used != 0) {
+                const TaskText *text = &table->texts[used - 1];
+                size_t slot = hashBytes(table->arena + taskTextOffset(text), text->length, 0) & (capacity - 1);
+                while (slots[slot] != 0) slot = (slot + 1) & (capacity - 1);
+                slots[slot] = used;
+            }
         }
+        free(table->interned);
+        table->interned = slots;
+        table->interned_capacity = capacity;
     }
-    fclose(file); // Close the file
-    if (count == 0) {
-        printf("No tasks found.\n"); // Handle case where file exists but is empty
+    size_t slot = hashBytes(description, length, 0) & (table->interned_capacity - 1);
+    for (; table->interned[slot] != 0; slot = (slot + 1) & (table->interned_capacity - 1)) {
+        const TaskText *text = &table->texts[table->interned[slot] - 1];
+        if (text->length == length && memcmp(table->arena + taskTextOffset(text), description, length) == 0) {
+            return taskTextOffset(text);
+        }
     }
-    printf("%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    reserveTaskTable(table, row + 1, table->arena_length + length + 1);
+    uint64_t offset = table->arena_length;
+    memcpy(table->arena + offset, description, length);
+    table->arena[offset + length] = '\0';
+    table->arena_length += length + 1;
+    table->interned[slot] = (uint32_t)row + 1;
+    table->interned_count++;
+    return offset;
 }
 
-// Function to modify a task's status (mark as done)
-void modifyTaskStatus(int taskId, bool complete) {
-    // Use the global full_task_file_path
-    FILE *originalFile = fopen(full_task_file_path, "r"); // Open original file for reading
-    if (originalFile == NULL) {
-        printf("No tasks found.\n");
-        return;
+// Function to append a task to a table
+void appendTaskRow(TaskTable *table, int id, bool done, const char *description, size_t length) {
+    size_t row = table->count;
+    reserveTaskTable(table, row + 1, 0);
+    table->ids[row] = id;
+    if (done) table->done[row / 64] |= 1ULL << (row % 64);
+    TaskText *text = &table->texts[row];
+    if (length <= TASK_INLINE_TEXT) {
+        memcpy(text->text, description, length);
+        text->text[length] = '\0';
+    } else {
+        uint64_t offset = internDescription(table, description, length, row);
+        text->offset[0] = (uint32_t)offset;
+        text->offset[1] = (uint32_t)(offset >> 32);
     }
+    text->length = (uint32_t)length;
+    table->count++;
+}
 
-    // Create a temporary file in the same directory as tasks.txt
-    char temp_file_path[MAX_PATH_LEN];
-    // Construct the path for the temporary file
-    const char *home_dir = getenv("HOME");
-    if (home_dir == NULL) {
-        fprintf(stderr, "Error: HOME environment variable not set. Cannot create temporary file.\n");
-        fclose(originalFile);
-        return;
+// Function to tell whether a task in a table is done
+bool taskDone(const TaskTable *table, size_t row) {
+    return (table->done[row / 64] >> (row % 64)) & 1;
+}
+
+// Function to append every task of another table
+// Descriptions are interned again, so strings repeated across the two tables are stored once.
+void appendTaskTable(TaskTable *table, const TaskTable *other) {
+    reserveTaskTable(table, table->count + other->count, 0);
+    for (size_t i = 0; i < other->count; i++) {
+        appendTaskRow(table, other->ids[i], taskDone(other, i), taskDescription(other, i), other->texts[i].length);
     }
-    snprintf(temp_file_path, sizeof(temp_file_path), "%s%s/%s", home_dir, TASK_DIR_SUFFIX, "temp_tasks.txt");
+}
 
+// Function to copy a sealed table into an empty one, columns and arena whole
+// The copy has no intern index, so rows appended to it later share strings only among themselves.
+void copyTaskTable(TaskTable *table, const TaskTable *other) {
+    reserveTaskTable(table, other->count, other->arena_length);
+    memcpy(table->ids, other->ids, other->count * sizeof(int));
+    memcpy(table->texts, other->texts, other->count * sizeof(TaskText));
+    memcpy(table->done, other->done, (other->count / 64 + 1) * sizeof(uint64_t));
+    if (other->arena_length > 0) memcpy(table->arena, other->arena, other->arena_length);
+    table->count = other->count;
+    table->arena_length = other->arena_length;
+}
 
-    FILE *tempFile = fopen(temp_file_path, "w"); // Open temporary file for writing
-    if (tempFile == NULL) {
-        perror("Error creating temporary file");
-        fclose(originalFile);
-        return;
+// Function to finish building a table that will only be read from now on
+// Drops the intern index and gives back unused arena space.
+void sealTaskTable(TaskTable *table) {
+    free(table->interned);
+    table->interned = NULL;
+    table->interned_count = table->interned_capacity = 0;
+    if (table->arena_length > 0 && table->arena_length < table->arena_capacity) {
+        char *arena = (char *)realloc(table->arena, table->arena_length);
+        if (arena != NULL) {
+            table->arena = arena;
+            table->arena_capacity = table->arena_length;
+        }
     }
+}
 
-    bool taskFound = false;
-    char line[MAX_DESCRIPTION_LEN + 20];
-    while (fgets(line, sizeof(line), originalFile) != NULL) {
-        int id, status;
-        char description[MAX_DESCRIPTION_LEN];
-        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) == 3) {
-            if (id == taskId) {
-                // Found the task, update its status
-                fprintf(tempFile, "%d,%d,%s\n", id, complete ? 1 : 0, description);
-                taskFound = true;
-            } else {
-                // Copy other tasks as they are
-                fprintf(tempFile, "%s", line);
+// Function to free the columns of a table
+void freeTaskTable(TaskTable *table) {
+    free(table->ids);
+    free(table->done);
+    free(table->texts);
+    free(table->arena);
+    free(table->interned);
+    memset(table, 0, sizeof(*table));
+}
+
+// Identity of a tasks.txt file, used to tell whether the persisted Merkle tree still matches it
+typedef struct {
+    int64_t size;     // -1 if the file does not exist
+    int64_t mtime_ns;
+    uint64_t inode;
+} StoreStamp;
+
+// Header of the persisted Merkle tree file. It is followed by 2 * capacity node hashes laid out
+// as an implicit binary tree: node 1 is the root, node i has children 2i and 2i+1, and the
+// leaves are nodes [capacity, 2 * capacity). Each node holds the sum of the record hashes below
+// it, so a mutation only has to add a delta along one leaf-to-root path. After the nodes comes
+// one LeafSpan per leaf, so 'diff' can read just the records of the leaves that differ.
+typedef struct {
+    char magic[8];
+    uint64_t capacity; // Number of leaves, always a power of two
+    StoreStamp stamp;  // tasks.txt the tree was last synchronized with
+} MerkleHeader;
+
+#define MERKLE_MAGIC "TKMRKL2"
+
+// Byte range of tasks.txt that holds every record of one leaf (empty when end is 0)
+// Records are appended in ID order, so this is normally just the leaf's own lines; after a merge
+// or a hand edit it may cover other records too, which readers skip.
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} LeafSpan;
+
+// Growable array of leaf spans indexed by leaf number, built while scanning or rewriting tasks.txt
+typedef struct {
+    LeafSpan *items;
+    uint64_t count; // A power of two once anything has been noted
+} LeafSpanIndex;
+
+// A change to one record's hash, applied to the Merkle tree after a mutation
+typedef struct {
+    int id;
+    uint64_t delta; // New record hash minus old record hash (mod 2^64)
+    LeafSpan line;  // Where an appended record's line now is in tasks.txt (empty otherwise)
+} MerkleDelta;
+
+// Function to widen a leaf span to cover the line [start, end)
+void extendLeafSpan(LeafSpan *span, uint64_t start, uint64_t end) {
+    if (span->end == 0 || start < span->start) span->start = start;
+    if (end > span->end) span->end = end;
+}
+
+// Function to record that a line of tasks.txt holds a record with the given ID
+bool noteLeafSpan(LeafSpanIndex *index, int id, uint64_t start, uint64_t end) {
+    uint64_t leaf = (uint64_t)id / MERKLE_LEAF_SPAN;
+    if (leaf >= index->count) { // Grow to cover this ID, keeping the count a power of two
+        uint64_t grown_count = index->count ? index->count : 1;
+        while (grown_count <= leaf) grown_count *= 2;
+        LeafSpan *grown = (LeafSpan *)realloc(index->items, grown_count * sizeof(LeafSpan));
+        if (grown == NULL) {
+            return false;
+        }
+        memset(grown + index->count, 0, (grown_count - index->count) * sizeof(LeafSpan));
+        index->items = grown;
+        index->count = grown_count;
+    }
+    extendLeafSpan(&index->items[leaf], start, end);
+    return true;
+}
+
+// Function to capture the identity of a tasks file
+StoreStamp stampFromStat(const struct stat *st) {
+    StoreStamp stamp;
+    stamp.size = (int64_t)st->st_size;
+    stamp.mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+    stamp.inode = (uint64_t)st->st_ino;
+    return stamp;
+}
+
+// Function to get the stamp of a file relative to a store directory
+StoreStamp stampDirectoryFile(int dir_fd, const char *name) {
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, 0) == -1) {
+        StoreStamp missing = {-1, 0, 0};
+        return missing;
+    }
+    return stampFromStat(&st);
+}
+
+// Function to get the stamp of a file of the store (e.g. TASK_FILENAME) by name
+StoreStamp stampStoreFile(const char *name) {
+    return stampDirectoryFile(task_dir_fd, name);
+}
+
+// Function to compare two store stamps
+bool stampsEqual(const StoreStamp *a, const StoreStamp *b) {
+    return a->size == b->size && a->mtime_ns == b->mtime_ns && a->inode == b->inode;
+}
+
+// Function to recompute every internal node of a tree from its leaves
+void merkleRecomputeInternal(uint64_t *nodes, uint64_t capacity) {
+    for (uint64_t i = capacity - 1; i >= 1; i--) {
+        nodes[i] = nodes[2 * i] + nodes[2 * i + 1];
+    }
+}
+
+// Function to build a Merkle tree from scratch by scanning a tasks file
+// Returns a malloc'd node array of 2 * *capacity entries (index 0 unused), and stores the
+// malloc'd span of every leaf (*capacity entries) in *spans.
+uint64_t *buildMerkleTree(int dir_fd, const char *tasks_name, uint64_t *capacity, LeafSpan **spans) {
+    uint64_t *leaves = NULL;
+    uint64_t leaf_count = 0;
+    LeafSpanIndex index = {NULL, 0};
+
+    FILE *file = openDirectoryStream(dir_fd, tasks_name, O_RDONLY, "r");
+    if (file != NULL) {
+        char line[MAX_DESCRIPTION_LEN + 20];
+        uint64_t offset = 0;
+        while (fgets(line, sizeof(line), file) != NULL) {
+            uint64_t start = offset;
+            offset += strlen(line);
+            int id, status;
+            char description[MAX_DESCRIPTION_LEN];
+            if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) != 3 || id <= 0) {
+                continue; // Malformed lines are not part of the tree
             }
-        } else {
-            // Copy malformed lines as they are (to preserve file integrity)
-            fprintf(tempFile, "%s", line);
+            if (!noteLeafSpan(&index, id, start, offset)) {
+                perror("Error building Merkle tree");
+                free(leaves);
+                free(index.items);
+                fclose(file);
+                return NULL;
+            }
+            uint64_t leaf = (uint64_t)id / MERKLE_LEAF_SPAN;
+            if (leaf >= leaf_count) { // Grow the leaf array to cover this ID
+                uint64_t grown_count = leaf_count ? leaf_count : 1;
+                while (grown_count <= leaf) grown_count *= 2;
+                uint64_t *grown = (uint64_t *)realloc(leaves, grown_count * sizeof(uint64_t));
+                if (grown == NULL) {
+                    perror("Error building Merkle tree");
+                    free(leaves);
+                    free(index.items);
+                    fclose(file);
+                    return NULL;
+                }
+                memset(grown + leaf_count, 0, (grown_count - leaf_count) * sizeof(uint64_t));
+                leaves = grown;
+                leaf_count = grown_count;
+            }
+            leaves[leaf] += recordHash(id, status, description);
         }
+        fclose(file);
     }
 
-    fclose(originalFile); // Close both files
-    fclose(tempFile);
+    *capacity = leaf_count ? leaf_count : 1; // leaf_count is already a power of two
+    uint64_t *nodes = (uint64_t *)calloc(2 * *capacity, sizeof(uint64_t));
+    *spans = (LeafSpan *)calloc(*capacity, sizeof(LeafSpan));
+    if (nodes == NULL || *spans == NULL) {
+        perror("Error building Merkle tree");
+        free(nodes);
+        free(*spans);
+        free(leaves);
+        free(index.items);
+        return NULL;
+    }
+    if (leaf_count > 0) {
+        memcpy(nodes + *capacity, leaves, leaf_count * sizeof(uint64_t));
+        memcpy(*spans, index.items, index.count * sizeof(LeafSpan)); // Same growth, same count
+    }
+    free(leaves);
+    free(index.items);
+    merkleRecomputeInternal(nodes, *capacity);
+    return nodes;
+}
 
-    // Replace the original file with the temporary file
-    remove(full_task_file_path); // Delete the original file
-    rename(temp_file_path, full_task_file_path); // Rename temp file to original filename
+// Function to persist a Merkle tree next to its tasks file (through a temporary file)
+bool saveMerkleTree(int dir_fd, const StoreStamp *stamp, const uint64_t *nodes, const LeafSpan *spans, uint64_t capacity) {
+    const char *temp_name = MERKLE_FILENAME ".tmp";
+    FILE *file = openDirectoryStream(dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC, "wb");
+    if (file == NULL) {
+        return false; // Read-only store (e.g. a mounted copy); the caller keeps the tree in memory
+    }
 
-    if (taskFound) {
-        printf("Task ID %d marked as %s.\n", taskId, complete ? "DONE" : "PENDING");
-    } else {
-        printf("Task ID %d not found.\n", taskId);
+    MerkleHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MERKLE_MAGIC, sizeof(header.magic));
+    header.capacity = capacity;
+    header.stamp = *stamp;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(nodes, sizeof(uint64_t), 2 * capacity, file) == 2 * capacity &&
+              fwrite(spans, sizeof(LeafSpan), capacity, file) == capacity;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || renameat(dir_fd, temp_name, dir_fd, MERKLE_FILENAME) == -1) {
+        unlinkat(dir_fd, temp_name, 0);
+        return false;
     }
+    return true;
 }
 
-// Function to delete a task
-void deleteTask(int taskId) {
-    // Use the global full_task_file_path
-    FILE *originalFile = fopen(full_task_file_path, "r"); // Open original file for reading
-    if (originalFile == NULL) {
-        printf("No tasks found.\n");
-        return;
+// Function to apply record hash deltas to the persisted Merkle tree after a mutation
+// 'before' and 'after' are the stamps of tasks.txt just before and after the mutation. If the
+// tree was not in sync with 'before' (or doesn't exist yet) it is left alone, and 'diff'
+// rebuilds it on next use. Appends extend the spans of their leaves from the deltas; a rewrite of
+// tasks.txt moves records around, so it passes the spans it noted while writing the new file and
+// they replace the old ones.
+void updateMerkleTree(const StoreStamp *before, const StoreStamp *after, const MerkleDelta *deltas, size_t count, const LeafSpanIndex *spans) {
+    int fd = openStoreFile(MERKLE_FILENAME, O_RDWR);
+    if (fd == -1) {
+        return; // No tree yet: nothing to maintain
     }
 
-    // Create a temporary file in the same directory as tasks.txt
-    char temp_file_path[MAX_PATH_LEN];
-    // Construct the path for the temporary file
-    const char *home_dir = getenv("HOME");
-    if (home_dir == NULL) {
-        fprintf(stderr, "Error: HOME environment variable not set. Cannot create temporary file.\n");
-        fclose(originalFile);
+    MerkleHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, MERKLE_MAGIC, sizeof(header.magic)) != 0 ||
+        !stampsEqual(&header.stamp, before)) {
+        close(fd);
+        unlinkat(task_dir_fd, MERKLE_FILENAME, 0); // Stale: drop it so it gets rebuilt from tasks.txt
         return;
     }
-    snprintf(temp_file_path, sizeof(temp_file_path), "%s%s/%s", home_dir, TASK_DIR_SUFFIX, "temp_tasks.txt");
 
-    FILE *tempFile = fopen(temp_file_path, "w"); // Open temporary file for writing
-    if (tempFile == NULL) {
-        perror("Error creating temporary file");
-        fclose(originalFile);
-        return;
+    // Grow the tree if a new ID falls beyond the last leaf (doubling keeps this amortized O(1))
+    uint64_t capacity = header.capacity;
+    for (size_t i = 0; i < count; i++) {
+        while ((uint64_t)deltas[i].id / MERKLE_LEAF_SPAN >= capacity) capacity *= 2;
+    }
+    while (spans != NULL && spans->count > capacity) capacity *= 2;
+    if (capacity != header.capacity) {
+        size_t leaf_bytes = header.capacity * sizeof(uint64_t);
+        size_t span_bytes = header.capacity * sizeof(LeafSpan);
+        size_t grown_bytes = 2 * capacity * sizeof(uint64_t) + capacity * sizeof(LeafSpan);
+        uint64_t *nodes = (uint64_t *)calloc(1, grown_bytes);
+        LeafSpan *grown_spans = (LeafSpan *)(nodes + 2 * capacity);
+        if (nodes == NULL ||
+            pread(fd, nodes + capacity, leaf_bytes, sizeof(header) + leaf_bytes) != (ssize_t)leaf_bytes ||
+            pread(fd, grown_spans, span_bytes, sizeof(header) + 2 * leaf_bytes) != (ssize_t)span_bytes) {
+            free(nodes);
+            close(fd);
+            unlinkat(task_dir_fd, MERKLE_FILENAME, 0);
+            return;
+        }
+        merkleRecomputeInternal(nodes, capacity);
+        header.capacity = capacity;
+        bool grown = ftruncate(fd, sizeof(header) + grown_bytes) == 0 &&
+                     pwrite(fd, nodes, grown_bytes, sizeof(header)) == (ssize_t)grown_bytes;
+        free(nodes);
+        if (!grown) {
+            close(fd);
+            unlinkat(task_dir_fd, MERKLE_FILENAME, 0);
+            return;
+        }
     }
 
-    bool taskFound = false;
-    char line[MAX_DESCRIPTION_LEN + 20];
-    while (fgets(line, sizeof(line), originalFile) != NULL) {
-        int id;
-        // Peek at the ID to decide if we should copy the line
-        if (sscanf(line, "%d,", &id) == 1) { // Parse ID from line
-            if (id == taskId) {
-                taskFound = true; // Found the task to delete, so DON'T write this line to tempFile
-            } else {
-                fprintf(tempFile, "%s", line); // Copy other lines to tempFile
-            }
-        } else {
-            // Copy malformed lines (or handle error)
-            fprintf(tempFile, "%s", line);
+    size_t map_size = sizeof(header) + 2 * capacity * sizeof(uint64_t) + capacity * sizeof(LeafSpan);
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        unlinkat(task_dir_fd, MERKLE_FILENAME, 0);
+        return;
+    }
+    uint64_t *nodes = (uint64_t *)((char *)map + sizeof(header));
+    LeafSpan *leaf_spans = (LeafSpan *)(nodes + 2 * capacity);
+    for (size_t i = 0; i < count; i++) { // Add each delta along its leaf-to-root path
+        uint64_t leaf = (uint64_t)deltas[i].id / MERKLE_LEAF_SPAN;
+        for (uint64_t node = capacity + leaf; node >= 1; node /= 2) {
+            nodes[node] += deltas[i].delta;
         }
+        if (spans == NULL && deltas[i].line.end > deltas[i].line.start) {
+            extendLeafSpan(&leaf_spans[leaf], deltas[i].line.start, deltas[i].line.end);
+        }
+    }
+    if (spans != NULL) {
+        memset(leaf_spans, 0, capacity * sizeof(LeafSpan));
+        if (spans->count > 0) memcpy(leaf_spans, spans->items, spans->count * sizeof(LeafSpan));
     }
+    header.stamp = *after; // The tree now matches the new tasks.txt
+    memcpy(map, &header, sizeof(header));
+    munmap(map, map_size);
+    close(fd);
+}
 
-    fclose(originalFile); // Close both files
-    fclose(tempFile);
+// Header line that starts oplog.txt: "#oplog,ID,BASE"
+// ID identifies this log; a log that is replaced wholesale gets a new one, which tells followers
+// to copy the store again. Log positions count every entry byte ever logged, so they stay valid
+// when compaction drops entries from the front: BASE is the position of the first entry kept.
+typedef struct {
+    uint64_t id;    // 0 when the log is missing or has no header
+    long long base;
+    size_t length;  // Bytes taken by the header line
+} OplogHeader;
 
-    remove(full_task_file_path); // Delete the original file
-    rename(temp_file_path, full_task_file_path); // Rename temp file to original filename
+// Function to pick a random nonzero 64-bit identifier
+uint64_t randomId() {
+    uint64_t id = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || read(fd, &id, sizeof(id)) != (ssize_t)sizeof(id)) {
+        id = mix64((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32));
+    }
+    if (fd != -1) close(fd);
+    return id != 0 ? id : 1;
+}
 
-    if (taskFound) {
-        printf("Task ID %d deleted.\n", taskId);
+// Function to read the header of an open operation log
+void readOplogHeader(int fd, OplogHeader *header) {
+    char line[64];
+    ssize_t got = pread(fd, line, sizeof(line) - 1, 0);
+    line[got > 0 ? got : 0] = '\0';
+    int length = 0;
+    header->id = 0;
+    header->base = 0;
+    header->length = 0;
+    if (sscanf(line, "#oplog,%" SCNx64 ",%lld\n%n", &header->id, &header->base, &length) == 2 && length > 0) {
+        header->length = (size_t)length;
     } else {
-        printf("Task ID %d not found.\n", taskId);
+        header->id = 0;
+        header->base = 0;
     }
 }
 
+// Function to get the log position just past the last entry of an open operation log
+long long oplogEnd(const OplogHeader *header, const struct stat *st) {
+    return header->base + (long long)st->st_size - (long long)header->length;
+}
 
-// Main function to handle command-line arguments
-int main(int argc, char *argv[]) {
-    // --- IMPORTANT: Initialize the full task file path and ensure directory exists ---
-    const char *home_dir = getenv("HOME");
-    if (home_dir == NULL) {
-        fprintf(stderr, "Error: HOME environment variable not set. Cannot determine task file path.\n");
-        return 1;
-    }
-    // Construct the full path to tasks.txt
-    snprintf(full_task_file_path, sizeof(full_task_file_path), "%s%s/%s", home_dir, TASK_DIR_SUFFIX, TASK_FILENAME);
+// Function to name the file in which a follower records its log position for the leader
+void followerKey(const char *follower_dir, char *key, size_t size) {
+    char resolved[PATH_MAX];
+    const char *path = realpath(follower_dir, resolved) != NULL ? resolved : follower_dir;
+    snprintf(key, size, "%016" PRIx64, hashBytes(path, strlen(path), 0));
+}
 
-    // Ensure the directory ~/.local/taskmanager exists
-    ensure_task_directory_exists();
-    // --- END IMPORTANT INITIALIZATION ---
+// Creation time of a task while created.txt is being rewritten
+typedef struct {
+    int id;
+    long long when; // Seconds since the epoch, or -1 for a deletion
+    size_t order;   // Position in the file, then in the dropped entries: the last one for an ID wins
+} CreatedEntry;
 
-    if (argc < 2) {
-        printf("Usage:\n");
-        printf("  %s add <description>\n", argv[0]);
-        printf("  %s list\n", argv[0]);
-        printf("  %s done <task_id>\n", argv[0]);
-        printf("  %s pending <task_id>\n", argv[0]);
-        printf("  %s delete <task_id>\n", argv[0]);
-        return 1;
-    }
+// Function to compare creation entries by ID, then by order (for qsort)
+int compareCreatedEntries(const void *a, const void *b) {
+    const CreatedEntry *x = (const CreatedEntry *)a, *y = (const CreatedEntry *)b;
+    if (x->id != y->id) return (x->id > y->id) - (x->id < y->id);
+    return (x->order > y->order) - (x->order < y->order);
+}
 
-    // Check the command argument
-    if (strcmp(argv[1], "add") == 0) {
-        if (argc < 3) {
-            printf("Usage: %s add <description>\n", argv[0]);
-            return 1;
+// Function to append an entry to a growing array of creation entries
+bool appendCreatedEntry(CreatedEntry **items, size_t *count, size_t *capacity, int id, long long when) {
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        CreatedEntry *grown = (CreatedEntry *)realloc(*items, grown_capacity * sizeof(CreatedEntry));
+        if (grown == NULL) {
+            return false;
         }
-        // Combine all subsequent arguments into a single description string
-        char description[MAX_DESCRIPTION_LEN] = "";
-        for (int i = 2; i < argc; i++) {
-            strcat(description, argv[i]);
-            if (i < argc - 1) {
-                strcat(description, " ");
+        *items = grown;
+        *capacity = grown_capacity;
+    }
+    (*items)[*count].id = id;
+    (*items)[*count].when = when;
+    (*items)[*count].order = *count;
+    (*count)++;
+    return true;
+}
+
+// Function to fold the entries compaction is about to drop from the log into created.txt
+// created.txt has one "ID,EPOCH" line (like due.txt) per task whose 'A' entry has left the log;
+// a dropped 'D' entry removes the task's line again. Creation times are this file plus the 'A'
+// entries still in the log. Returns false if the file could not be rewritten, and the caller
+// then keeps the log whole.
+bool checkpointCreationTimes(const char *entries, size_t length) {
+    const char *temp_name = "temp_created.txt";
+    CreatedEntry *items = NULL;
+    size_t count = 0, capacity = 0;
+    bool ok = true;
+    FILE *file = openStoreStream(CREATED_FILENAME, O_RDONLY, "r");
+    char line[64];
+    while (ok && file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        int id;
+        long long when;
+        if (sscanf(line, "%d,%lld", &id, &when) == 2) {
+            ok = appendCreatedEntry(&items, &count, &capacity, id, when);
+        }
+    }
+    if (file != NULL) fclose(file);
+    size_t checkpointed = count;
+    for (const char *entry = entries; ok && entry < entries + length;) { // Entries look like "A,TIME,ID,..."
+        const char *newline = (const char *)memchr(entry, '\n', (size_t)(entries + length - entry));
+        const char *end = newline != NULL ? newline : entries + length;
+        size_t size = (size_t)(end - entry) < sizeof(line) - 1 ? (size_t)(end - entry) : sizeof(line) - 1;
+        memcpy(line, entry, size);
+        line[size] = '\0';
+        int id;
+        long long when;
+        if ((line[0] == 'A' || line[0] == 'D') && sscanf(line + 1, ",%lld,%d", &when, &id) == 2) {
+            ok = appendCreatedEntry(&items, &count, &capacity, id, line[0] == 'A' ? when : -1);
+        }
+        entry = end + 1;
+    }
+    if (!ok || count == checkpointed) { // Out of memory, or nothing about creations was dropped
+        free(items);
+        return ok;
+    }
+
+    qsort(items, count, sizeof(CreatedEntry), compareCreatedEntries);
+    FILE *out = openStoreStream(temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    ok = out != NULL;
+    for (size_t i = 0; ok && i < count; i++) {
+        if ((i + 1 == count || items[i + 1].id != items[i].id) && items[i].when >= 0) {
+            ok = fprintf(out, "%d,%lld\n", items[i].id, items[i].when) > 0;
+        }
+    }
+    free(items);
+    if (out == NULL || fclose(out) != 0 || !ok || renameat(task_dir_fd, temp_name, task_dir_fd, CREATED_FILENAME) == -1) {
+        unlinkat(task_dir_fd, temp_name, 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to drop the entries every follower has applied from the front of the operation log
+// Called by a writer that holds the log's lock once it has grown past OPLOG_COMPACT_BYTES. Each
+// follower keeps "POSITION ID" in followers/<key> under the task directory; entries before the
+// lowest position recorded for this log are dropped, and so is everything when nobody follows
+// (a new follower starts from a full copy anyway). A follower more than OPLOG_RETAIN_MAX behind
+// is not waited for: it finds its position gone and copies the store again.
+void compactOplog(int fd, const struct stat *st) {
+    OplogHeader header;
+    readOplogHeader(fd, &header);
+    long long end = oplogEnd(&header, st);
+    long long keep_from = end;
+    int followers_fd = openat(task_dir_fd, FOLLOWERS_DIRNAME, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *followers = followers_fd != -1 ? fdopendir(followers_fd) : NULL;
+    if (followers == NULL && followers_fd != -1) close(followers_fd);
+    struct dirent *entry;
+    while (followers != NULL && (entry = readdir(followers)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        FILE *file = openDirectoryStream(dirfd(followers), entry->d_name, O_RDONLY, "r");
+        long long position;
+        uint64_t id;
+        if (file != NULL && fscanf(file, "%lld %" SCNx64, &position, &id) == 2 &&
+            id == header.id && position >= header.base && position < keep_from) {
+            keep_from = position;
+        }
+        if (file != NULL) fclose(file);
+    }
+    if (followers != NULL) closedir(followers);
+
+    bool cut = end - keep_from > OPLOG_RETAIN_MAX; // Past the slowest follower's position
+    if (cut) keep_from = end - OPLOG_RETAIN_MAX;
+    if (keep_from - header.base < OPLOG_COMPACT_BYTES / 2) {
+        return; // Too little to drop to be worth a rewrite
+    }
+
+    size_t length = (size_t)(end - keep_from);
+    char *kept = (char *)malloc(length + 1);
+    off_t from = (off_t)header.length + (off_t)(keep_from - header.base);
+    if (kept == NULL || pread(fd, kept, length, from) != (ssize_t)length) {
+        free(kept);
+        return;
+    }
+    size_t skip = 0;
+    if (cut) { // A forced cut may land inside an entry: start at the next one
+        char before;
+        if (pread(fd, &before, 1, from - 1) != 1 || before != '\n') {
+            char *newline = (char *)memchr(kept, '\n', length);
+            skip = newline != NULL ? (size_t)(newline - kept) + 1 : length;
+        }
+    }
+    // Creation times must outlive the 'A' entries that carry them
+    size_t dropped_length = (size_t)(from - (off_t)header.length) + skip;
+    char *dropped = (char *)malloc(dropped_length + 1);
+    bool checkpointed = dropped != NULL && pread(fd, dropped, dropped_length, (off_t)header.length) == (ssize_t)dropped_length &&
+                        checkpointCreationTimes(dropped, dropped_length);
+    free(dropped);
+    if (!checkpointed) {
+        free(kept);
+        return;
+    }
+
+    const char *temp_name = "temp_oplog.txt";
+    FILE *out = openStoreStream(temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (out == NULL) {
+        free(kept);
+        return;
+    }
+    fprintf(out, "#oplog,%016" PRIx64 ",%lld\n", header.id != 0 ? header.id : randomId(), keep_from + (long long)skip);
+    bool ok = fwrite(kept + skip, 1, length - skip, out) == length - skip;
+    ok = fclose(out) == 0 && ok;
+    // Writers lock the file they opened and check that it is still the log, so none can append
+    // to the old one once this rename is done
+    if (!ok || renameat(task_dir_fd, temp_name, task_dir_fd, OPLOG_FILENAME) == -1) {
+        unlinkat(task_dir_fd, temp_name, 0);
+    }
+    free(kept);
+}
+
+// Function to append complete entries to the operation log
+// Writers hold an exclusive flock on the log while appending, so entries never interleave and a
+// compaction never loses an entry written to the file it replaces. The first writer of a new log
+// gives it its header.
+void appendOplog(const char *entries, size_t length) {
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int fd = openStoreFile(OPLOG_FILENAME, O_RDWR | O_APPEND | O_CREAT); // Read too, for compaction
+        if (fd == -1) {
+            perror("Error opening operation log");
+            return;
+        }
+        struct stat st;
+        if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1) {
+            perror("Error locking operation log");
+            close(fd);
+            return;
+        }
+        if (st.st_nlink == 0) { // Replaced by a compaction while we waited: use the new file
+            close(fd);
+            continue;
+        }
+        if (st.st_size == 0) {
+            char header[64];
+            int header_length = snprintf(header, sizeof(header), "#oplog,%016" PRIx64 ",0\n", randomId());
+            if (write(fd, header, header_length) != header_length) {
+                perror("Error writing operation log");
+            }
+        }
+        if (write(fd, entries, length) != (ssize_t)length) {
+            perror("Error writing operation log");
+        } else if (fstat(fd, &st) == 0 && st.st_size > OPLOG_COMPACT_BYTES) {
+            compactOplog(fd, &st);
+        }
+        close(fd); // Releases the lock
+        return;
+    }
+}
+
+#define OPLOG_ENTRY_MAX (MAX_DESCRIPTION_LEN + 64) // Longest entry formatOperation() writes
+
+// Function to format one operation log entry into a buffer of OPLOG_ENTRY_MAX bytes
+// Entries look like "OP,TIME,ID[,ARGUMENT]": A (add, argument is the description), S (status),
+// D (delete) and U (due date, 0 clears it). Returns the entry's length, newline included.
+size_t formatOperation(char *entry, char op, int id, const char *format, va_list args) {
+    int length = snprintf(entry, OPLOG_ENTRY_MAX, "%c,%lld,%d", op, (long long)time(NULL), id);
+    if (format != NULL) {
+        entry[length++] = ',';
+        length += vsnprintf(entry + length, OPLOG_ENTRY_MAX - length - 1, format, args);
+        if (length > OPLOG_ENTRY_MAX - 2) length = OPLOG_ENTRY_MAX - 2; // Truncated
+    }
+    entry[length++] = '\n';
+    return (size_t)length;
+}
+
+// Function to append one entry to the operation log
+void logOperation(char op, int id, const char *format, ...) {
+    char entry[OPLOG_ENTRY_MAX];
+    va_list args;
+    va_start(args, format);
+    size_t length = formatOperation(entry, op, id, format, args);
+    va_end(args);
+    appendOplog(entry, length);
+}
+
+// Operation log entries collected in memory and appended with one appendOplog() call
+typedef struct {
+    char *data;
+    size_t length, capacity;
+    bool failed; // Out of memory: some entries are missing
+} OplogBatch;
+
+// Function to add one entry to a batch
+void batchOperation(OplogBatch *batch, char op, int id, const char *format, ...) {
+    if (batch->capacity - batch->length < OPLOG_ENTRY_MAX) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64 * OPLOG_ENTRY_MAX;
+        char *grown = (char *)realloc(batch->data, capacity);
+        if (grown == NULL) {
+            batch->failed = true;
+            return;
+        }
+        batch->data = grown;
+        batch->capacity = capacity;
+    }
+    va_list args;
+    va_start(args, format);
+    batch->length += formatOperation(batch->data + batch->length, op, id, format, args);
+    va_end(args);
+}
+
+// Lamport timestamp of one write to a record field
+// Every local write takes a counter above every counter this store has seen, so a write always
+// wins over the writes it could have observed. Equal counters come from concurrent writes on two
+// replicas, and the higher replica ID wins those.
+typedef struct {
+    uint64_t counter; // 0: the field was never written
+    uint64_t replica; // Replica that made the write
+} LamportStamp;
+
+// Function to order two Lamport timestamps
+int compareLamportStamps(const LamportStamp *a, const LamportStamp *b) {
+    if (a->counter != b->counter) return a->counter < b->counter ? -1 : 1;
+    return (a->replica > b->replica) - (a->replica < b->replica);
+}
+
+// Latest known state of one record for conflict-free merging
+// Records are identified by (replica, origin) instead of their local ID, so tasks created
+// independently in two copies of the store never collide. The status and the deletion flag are
+// separate last-writer-wins registers with their own Lamport timestamps; a deletion always wins.
+typedef struct {
+    uint64_t replica;           // Replica that created the record (legacy records: hash of the description)
+    uint64_t origin;            // Unique creation stamp within that replica
+    LamportStamp status_stamp;  // Last status change
+    LamportStamp deleted_stamp; // Deletion (counter 0 while the record is live)
+    int id;                     // Local display ID (0 for tombstones)
+    char state;                 // 'P' pending, 'C' completed
+    char *description;
+} CrdtRecord;
+
+// crdt.txt line: "ID,REPLICA,ORIGIN,STATE,STATUS_COUNTER,STATUS_REPLICA,DELETED_COUNTER,DELETED_REPLICA"
+#define CRDT_LINE_FORMAT "%d,%016" PRIx64 ",%016" PRIx64 ",%c,%" PRIu64 ",%016" PRIx64 ",%" PRIu64 ",%016" PRIx64 "\n"
+#define CRDT_LINE_MAX 128
+
+// Function to check whether a record has been deleted
+bool crdtDeleted(const CrdtRecord *record) {
+    return record->deleted_stamp.counter != 0;
+}
+
+// Function to parse a crdt.txt line (returns false for the header and malformed lines)
+bool parseCrdtLine(const char *line, CrdtRecord *record) {
+    if (sscanf(line, "%d,%" SCNx64 ",%" SCNx64 ",%c,%" SCNu64 ",%" SCNx64 ",%" SCNu64 ",%" SCNx64, &record->id,
+               &record->replica, &record->origin, &record->state, &record->status_stamp.counter,
+               &record->status_stamp.replica, &record->deleted_stamp.counter, &record->deleted_stamp.replica) != 8) {
+        return false;
+    }
+    record->description = NULL;
+    return record->state == 'P' || record->state == 'C';
+}
+
+// Function to format a record as a crdt.txt line
+int formatCrdtLine(char *line, size_t size, const CrdtRecord *record) {
+    return snprintf(line, size, CRDT_LINE_FORMAT, record->id, record->replica, record->origin, record->state,
+                    record->status_stamp.counter, record->status_stamp.replica,
+                    record->deleted_stamp.counter, record->deleted_stamp.replica);
+}
+
+// Bit marking identities derived from descriptions of records that predate crdt.txt
+#define CRDT_LEGACY_REPLICA (1ULL << 63)
+
+// Function to get the identity used for a record that has no crdt.txt entry yet
+// Such records were created before this store tracked identities; two copies agree on them as
+// long as the ID and description match.
+uint64_t legacyReplica(const char *description) {
+    return hashBytes(description, strlen(description), 0) | CRDT_LEGACY_REPLICA;
+}
+
+// Function to fill in the legacy identity of a record, with both fields never written
+void legacyCrdtRecord(int id, const char *description, CrdtRecord *record) {
+    memset(record, 0, sizeof(*record));
+    record->replica = legacyReplica(description);
+    record->origin = (uint64_t)id;
+    record->id = id;
+    record->state = 'P';
+}
+
+// Function to get the current time in nanoseconds (used for unique creation stamps)
+uint64_t nowNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Function to pick the replica ID of a new store
+uint64_t newReplicaId() {
+    // Random, with the top bit clear to keep it apart from legacy IDs
+    uint64_t replica = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || read(fd, &replica, sizeof(replica)) != (ssize_t)sizeof(replica)) {
+        replica = mix64(nowNanoseconds() ^ ((uint64_t)getpid() << 32));
+    }
+    if (fd != -1) close(fd);
+    return (replica & ~CRDT_LEGACY_REPLICA) | 1;
+}
+
+// Function to read this store's replica ID from crdt.txt, creating the file if needed
+uint64_t crdtReplicaId() {
+    uint64_t replica = 0;
+    FILE *file = openStoreStream(CRDT_FILENAME, O_RDONLY, "r");
+    if (file != NULL) {
+        if (fscanf(file, "#replica=%" SCNx64, &replica) != 1) replica = 0;
+        fclose(file);
+        if (replica != 0) {
+            return replica;
+        }
+    }
+
+    replica = newReplicaId(); // New store
+    file = openStoreStream(CRDT_FILENAME, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (file != NULL) {
+        fprintf(file, "#replica=%016" PRIx64 "\n", replica);
+        fclose(file);
+    }
+    return replica;
+}
+
+// Function to open the local crdt.txt for reading and appending, creating it if needed
+// Like crdtReplicaId() it stores the replica ID from the header in *replica (writing a new
+// header first if there is none), but leaves the file open at its start so the caller can scan
+// it and then append its entries without opening it again. Returns NULL if it can't be opened.
+FILE *openCrdtLog(uint64_t *replica) {
+    FILE *file = openStoreStream(CRDT_FILENAME, O_RDWR | O_APPEND | O_CREAT, "a+");
+    if (file == NULL) {
+        return NULL;
+    }
+    if (fscanf(file, "#replica=%" SCNx64, replica) != 1 || *replica == 0) {
+        *replica = newReplicaId(); // New store
+        char header[32];
+        int length = snprintf(header, sizeof(header), "#replica=%016" PRIx64 "\n", *replica);
+        if (ftruncate(fileno(file), 0) == -1 || write(fileno(file), header, length) != length) {
+            perror("Error writing crdt.txt");
+        }
+    }
+    rewind(file);
+    return file;
+}
+
+// A status change or deletion of a local task, to be recorded in crdt.txt
+typedef struct {
+    int id;
+    char state;        // 'P', 'C' or 'X'
+    char *description; // Needed for the legacy identity of tasks that predate crdt.txt
+} CrdtChange;
+
+// Function to order changes by task ID
+int compareCrdtChanges(const void *a, const void *b) {
+    int idA = ((const CrdtChange *)a)->id, idB = ((const CrdtChange *)b)->id;
+    return (idA > idB) - (idA < idB);
+}
+
+// Function to record status changes and deletions of local tasks in crdt.txt
+// One pass over crdt.txt finds the live identity shown under each ID (falling back to the
+// legacy identity) and the highest Lamport counter, then all new entries are appended with a
+// single write, stamped one past that counter.
+void crdtRecordChanges(CrdtChange *changes, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (count > 1) {
+        qsort(changes, count, sizeof(CrdtChange), compareCrdtChanges);
+    }
+    Arena *arena = scratchArena();
+    CrdtRecord *records = (CrdtRecord *)arenaAlloc(arena, count * sizeof(CrdtRecord));
+    for (size_t i = 0; i < count; i++) {
+        legacyCrdtRecord(changes[i].id, changes[i].description, &records[i]);
+    }
+
+    uint64_t counter = 0;
+    uint64_t replica;
+    FILE *file = openCrdtLog(&replica);
+    if (file != NULL) {
+        char line[CRDT_LINE_MAX];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            CrdtRecord entry;
+            if (!parseCrdtLine(line, &entry)) {
+                continue;
+            }
+            if (entry.status_stamp.counter > counter) counter = entry.status_stamp.counter;
+            if (entry.deleted_stamp.counter > counter) counter = entry.deleted_stamp.counter;
+            CrdtChange key = {entry.id, 0, NULL};
+            CrdtChange *change = (CrdtChange *)bsearch(&key, changes, count, sizeof(CrdtChange), compareCrdtChanges);
+            if (change == NULL) {
+                continue;
+            }
+            if (crdtDeleted(&entry)) { // Deleted: the ID may have been reused by a later record
+                legacyCrdtRecord(change->id, change->description, &records[change - changes]);
+            } else {
+                records[change - changes] = entry;
+            }
+        }
+    }
+
+    LamportStamp stamp = {counter + 1, replica};
+    char *entries = (char *)arenaAlloc(arena, count * CRDT_LINE_MAX);
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (changes[i].state == 'X') {
+            records[i].deleted_stamp = stamp;
+        } else {
+            records[i].state = changes[i].state;
+            records[i].status_stamp = stamp;
+        }
+        length += formatCrdtLine(entries + length, CRDT_LINE_MAX, &records[i]);
+    }
+    if (write(fileno(file), entries, length) != (ssize_t)length) { // Nothing is buffered for writing
+        perror("Error writing crdt.txt");
+    }
+    fclose(file);
+}
+
+// Next task ID as of the last add, valid while tasks.txt still has the stamp that add left behind
+// The daemon adds to a file nothing else touched in between over and over; this spares it a scan
+// of the whole file per commit. Any other writer changes the stamp and the next add scans again.
+StoreStamp next_id_stamp = {-1, 0, 0};
+int next_id_known = 0;
+
+// Persisted hash set of the descriptions of pending tasks (fingerprints.bin), used to reject or
+// merge duplicate adds without scanning tasks.txt. Like the Merkle tree it carries the stamp of
+// the tasks.txt it matches: addTasks() and applyMutations() keep it in sync, and any other writer
+// leaves it stale, in which case it is rebuilt on next use. The header is followed by 'capacity'
+// slots of an open-addressing table (linear probing).
+typedef struct {
+    char magic[8];
+    uint64_t capacity; // Always a power of two
+    uint64_t used;     // Slots ever taken (emptied ones stay taken so probe chains hold)
+    StoreStamp stamp;  // tasks.txt the set was last synchronized with
+} FingerprintHeader;
+
+#define FINGERPRINT_MAGIC "TKFPSET"
+
+// One slot: a fingerprint (0 if the slot is free) and how many pending tasks have it
+typedef struct {
+    uint64_t fingerprint;
+    int32_t id;        // One of those tasks
+    uint32_t count;
+} FingerprintSlot;
+
+// A pending task gained (delta 1) or lost (delta -1), applied after a mutation
+typedef struct {
+    uint64_t fingerprint;
+    int id;
+    int delta;
+} FingerprintChange;
+
+// What 'add' does with a description that is already pending (policy.txt, 'policy' command)
+typedef enum {
+    UNIQUE_OFF,    // Add it anyway (unless 'add --unique' asks to reject it)
+    UNIQUE_REJECT, // Refuse the add
+    UNIQUE_MERGE   // Report the existing task instead of adding a copy
+} UniquePolicy;
+
+// Function to fingerprint a description for duplicate detection
+// Case and runs of whitespace don't count, so "Nightly  sync" and "nightly sync" are duplicates.
+uint64_t descriptionFingerprint(const char *description) {
+    char normalized[MAX_DESCRIPTION_LEN];
+    size_t length = 0;
+    bool space = false;
+    for (const unsigned char *c = (const unsigned char *)description; *c != '\0' && length < sizeof(normalized) - 1; c++) {
+        if (*c == ' ' || *c == '\t') {
+            space = length > 0;
+            continue;
+        }
+        if (space) normalized[length++] = ' ';
+        space = false;
+        if (length < sizeof(normalized) - 1) normalized[length++] = (char)(*c >= 'A' && *c <= 'Z' ? *c + 32 : *c);
+    }
+    uint64_t fingerprint = hashBytes(normalized, length, 0x6a09e667f3bcc908ULL);
+    return fingerprint != 0 ? fingerprint : 1; // 0 marks free slots
+}
+
+// Function to apply one change to a fingerprint table in memory
+// Returns false when the table needs rebuilding: a new slot would be needed but it is full
+// enough, or the task a slot names went away while other tasks still have its fingerprint.
+bool fingerprintApply(FingerprintSlot *slots, uint64_t capacity, uint64_t *used, const FingerprintChange *change) {
+    uint64_t slot = change->fingerprint & (capacity - 1);
+    while (slots[slot].fingerprint != 0 && slots[slot].fingerprint != change->fingerprint) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    if (slots[slot].fingerprint == 0) {
+        if (change->delta < 0) {
+            return true; // Not there to begin with
+        }
+        if (4 * (*used + 1) > 3 * capacity) { // Keep probe chains short
+            return false;
+        }
+        slots[slot].fingerprint = change->fingerprint;
+        (*used)++;
+    }
+    if (change->delta > 0) {
+        if (slots[slot].count == 0) slots[slot].id = change->id;
+        slots[slot].count++;
+    } else if (slots[slot].count > 0) {
+        slots[slot].count--;
+        if (slots[slot].count > 0 && slots[slot].id == change->id) {
+            return false; // The other tasks with it are not known here
+        }
+    }
+    return true;
+}
+
+// Function to look a fingerprint up in a table (the ID of a pending task with it, or 0)
+int fingerprintFind(const FingerprintSlot *slots, uint64_t capacity, uint64_t fingerprint) {
+    for (uint64_t slot = fingerprint & (capacity - 1); slots[slot].fingerprint != 0; slot = (slot + 1) & (capacity - 1)) {
+        if (slots[slot].fingerprint == fingerprint) {
+            return slots[slot].count > 0 ? slots[slot].id : 0;
+        }
+    }
+    return 0;
+}
+
+// Function to build the fingerprint set from tasks.txt and persist it
+// Returns false if it could not be written (e.g. a read-only store).
+bool rebuildFingerprintSet() {
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDONLY, "r");
+    struct stat st;
+    FingerprintHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FINGERPRINT_MAGIC, sizeof(header.magic));
+    header.stamp.size = -1;
+    if (file != NULL && fstat(fileno(file), &st) == 0) {
+        header.stamp = stampFromStat(&st);
+    }
+    header.capacity = 1024;
+    while (header.capacity < (uint64_t)(header.stamp.size > 0 ? header.stamp.size : 0) / 8) {
+        header.capacity *= 2; // Records are at least 6 bytes, so this leaves room for every task
+    }
+    FingerprintSlot *slots = (FingerprintSlot *)calloc(header.capacity, sizeof(FingerprintSlot));
+    if (file != NULL) {
+        char line[MAX_DESCRIPTION_LEN + 20];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            int id, status;
+            char description[MAX_DESCRIPTION_LEN];
+            if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) == 3 && status != 1) {
+                FingerprintChange change = {descriptionFingerprint(description), id, 1};
+                fingerprintApply(slots, header.capacity, &header.used, &change);
+            }
+        }
+        fclose(file);
+    }
+
+    const char *temp_name = FINGERPRINT_FILENAME ".tmp";
+    FILE *out = openStoreStream(temp_name, O_WRONLY | O_CREAT | O_TRUNC, "wb");
+    bool ok = out != NULL && fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(slots, sizeof(FingerprintSlot), header.capacity, out) == header.capacity;
+    ok = out != NULL && fclose(out) == 0 && ok;
+    if (!ok || renameat(task_dir_fd, temp_name, task_dir_fd, FINGERPRINT_FILENAME) == -1) {
+        unlinkat(task_dir_fd, temp_name, 0);
+        ok = false;
+    }
+    free(slots);
+    return ok;
+}
+
+// Function to map the fingerprint set, rebuilding it first if it is missing or stale
+// Returns the slots (NULL if unavailable) and sets *capacity and *map_size for munmap().
+FingerprintSlot *mapFingerprintSet(uint64_t *capacity, size_t *map_size) {
+    StoreStamp current = stampStoreFile(TASK_FILENAME);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = openStoreFile(FINGERPRINT_FILENAME, O_RDONLY);
+        FingerprintHeader header;
+        if (fd != -1 && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, FINGERPRINT_MAGIC, sizeof(header.magic)) == 0 && stampsEqual(&header.stamp, &current)) {
+            *capacity = header.capacity;
+            *map_size = sizeof(header) + header.capacity * sizeof(FingerprintSlot);
+            void *map = mmap(NULL, *map_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            return map == MAP_FAILED ? NULL : (FingerprintSlot *)((char *)map + sizeof(header));
+        }
+        if (fd != -1) close(fd);
+        if (attempt == 0 && !rebuildFingerprintSet()) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Function to apply changes to the persisted fingerprint set after a mutation
+// 'before' and 'after' are the stamps of tasks.txt just before and after the mutation. A set
+// that was not in sync with 'before' (or that fills up) is dropped and rebuilt on next use.
+void updateFingerprintSet(const StoreStamp *before, const StoreStamp *after, const FingerprintChange *changes, size_t count) {
+    int fd = openStoreFile(FINGERPRINT_FILENAME, O_RDWR);
+    if (fd == -1) {
+        return; // No set yet: nothing to maintain
+    }
+    FingerprintHeader header;
+    void *map = MAP_FAILED;
+    size_t map_size = 0;
+    if (pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        memcmp(header.magic, FINGERPRINT_MAGIC, sizeof(header.magic)) == 0 && stampsEqual(&header.stamp, before)) {
+        map_size = sizeof(header) + header.capacity * sizeof(FingerprintSlot);
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    bool ok = map != MAP_FAILED;
+    if (ok) {
+        FingerprintSlot *slots = (FingerprintSlot *)((char *)map + sizeof(header));
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = fingerprintApply(slots, header.capacity, &header.used, &changes[i]);
+        }
+        header.stamp = *after; // The set now matches the new tasks.txt
+        if (ok) memcpy(map, &header, sizeof(header));
+        munmap(map, map_size);
+    }
+    if (!ok) {
+        unlinkat(task_dir_fd, FINGERPRINT_FILENAME, 0); // Stale or full: rebuilt from tasks.txt when next needed
+    }
+}
+
+// Function to read the store's duplicate policy from policy.txt ("unique=off|reject|merge")
+UniquePolicy uniquePolicy() {
+    char line[64];
+    FILE *file = openStoreStream(POLICY_FILENAME, O_RDONLY, "r");
+    UniquePolicy policy = UNIQUE_OFF;
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "unique=reject", 13) == 0) policy = UNIQUE_REJECT;
+        else if (strncmp(line, "unique=merge", 12) == 0) policy = UNIQUE_MERGE;
+        else if (strncmp(line, "unique=off", 10) == 0) policy = UNIQUE_OFF;
+    }
+    if (file != NULL) fclose(file);
+    return policy;
+}
+
+// Function to write the store's duplicate policy (one of "off", "reject", "merge") to policy.txt
+bool setPolicy(const char *unique) {
+    FILE *file = openStoreStream(POLICY_FILENAME, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (file == NULL) {
+        perror("Error writing policy.txt");
+        return false;
+    }
+    fprintf(file, "unique=%s\n", unique);
+    return fclose(file) == 0;
+}
+
+// Function to resolve the duplicate policy for an add ('add --unique' rejects unless the store merges)
+UniquePolicy addPolicy(bool unique) {
+    UniquePolicy policy = uniquePolicy();
+    return unique && policy == UNIQUE_OFF ? UNIQUE_REJECT : policy;
+}
+
+// Function to add several tasks with a single append to tasks.txt
+// New IDs are assigned consecutively from getNextTaskId() and stored in ids[]. Unless 'policy' is
+// UNIQUE_OFF, a description that matches a pending task (or an earlier one in the batch) is not
+// added: duplicates[i] is set and ids[i] is the ID of the task it duplicates.
+bool addTasks(const char *const *descriptions, size_t count, int *ids, UniquePolicy policy, bool *duplicates) {
+    TASAKMAN_PROBE1(add__start, count);
+    uint64_t started = metricClock();
+    // tasks.txt is opened once: read for the next ID, then appended to (creating it if needed)
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDWR | O_APPEND | O_CREAT, "a+");
+    if (file == NULL) {
+        perror("Error opening task file for writing"); // Print system error message
+        TASAKMAN_PROBE2(add__done, count, false);
+        return false;
+    }
+    struct stat st;
+    fstat(fileno(file), &st);
+    StoreStamp before = stampFromStat(&st); // tasks.txt before this mutation (for the Merkle tree)
+    Arena *arena = scratchArena();
+    FingerprintChange *fingerprints = (FingerprintChange *)arenaAlloc(arena, (count + 1) * sizeof(FingerprintChange));
+    for (size_t i = 0; i < count; i++) {
+        fingerprints[i].fingerprint = descriptionFingerprint(descriptions[i]);
+        fingerprints[i].delta = 1;
+        if (duplicates != NULL) duplicates[i] = false;
+    }
+    size_t added = count;
+    if (policy != UNIQUE_OFF) {
+        uint64_t capacity;
+        size_t map_size;
+        FingerprintSlot *slots = mapFingerprintSet(&capacity, &map_size);
+        // Fingerprints of this batch, to catch a description given twice
+        uint64_t batch_capacity = 16;
+        while (batch_capacity < 2 * count) batch_capacity *= 2;
+        FingerprintSlot *batch = (FingerprintSlot *)arenaAlloc(arena, batch_capacity * sizeof(FingerprintSlot));
+        memset(batch, 0, batch_capacity * sizeof(FingerprintSlot));
+        uint64_t batch_used = 0;
+        for (size_t i = 0; i < count; i++) {
+            int existing = slots != NULL ? fingerprintFind(slots, capacity, fingerprints[i].fingerprint) : 0;
+            size_t earlier = (size_t)fingerprintFind(batch, batch_capacity, fingerprints[i].fingerprint);
+            if (existing != 0 || earlier != 0) {
+                duplicates[i] = true;
+                ids[i] = existing != 0 ? existing : -(int)earlier; // Resolved to the new ID below
+                added--;
+                continue;
+            }
+            FingerprintChange position = {fingerprints[i].fingerprint, (int)i + 1, 1};
+            fingerprintApply(batch, batch_capacity, &batch_used, &position);
+        }
+        if (slots != NULL) {
+            munmap((char *)slots - sizeof(FingerprintHeader), map_size);
+        }
+    }
+
+    MerkleDelta *deltas = (MerkleDelta *)arenaAlloc(arena, (count + 1) * sizeof(MerkleDelta));
+    size_t delta_count = 0;
+    int id;
+    if (next_id_known > 0 && stampsEqual(&before, &next_id_stamp)) {
+        id = next_id_known; // Unchanged since our last add
+    } else {
+        id = getNextTaskId(file); // Get a new unique ID
+        countMetric(COUNTER_STORE_READ, before.size); // getNextTaskId() scans it
+    }
+    fseek(file, 0, SEEK_END); // Switch from reading to appending
+    uint64_t offset = before.size > 0 ? (uint64_t)before.size : 0; // Appended at the old end
+    for (size_t i = 0; i < count; i++) {
+        if (duplicates != NULL && duplicates[i]) {
+            if (ids[i] < 0) ids[i] = ids[-ids[i] - 1]; // Same as an earlier task of this batch
+            continue;
+        }
+        // Write task in format: ID,STATUS,DESCRIPTION\n
+        // STATUS: 0 for pending, 1 for completed
+        int length = fprintf(file, "%d,%d,%s\n", id, 0, descriptions[i]); // Write the new task (initially pending)
+        ids[i] = id;
+        deltas[delta_count].id = id;
+        deltas[delta_count].delta = recordHash(id, 0, descriptions[i]);
+        deltas[delta_count].line.start = offset;
+        deltas[delta_count].line.end = offset + (uint64_t)(length > 0 ? length : 0);
+        offset = deltas[delta_count++].line.end;
+        fingerprints[i].id = id++;
+    }
+    bool ok = fflush(file) == 0;
+    if (!ok && ftruncate(fileno(file), before.size > 0 ? (off_t)before.size : 0) == -1) { // Drop a partly written record
+        perror("Error truncating task file");
+    }
+    fstat(fileno(file), &st);
+    StoreStamp after = stampFromStat(&st);
+    ok = fclose(file) == 0 && ok; // Close the file
+    TASAKMAN_PROBE2(add__commit, added, ok);
+    if (!ok) {
+        // Nothing was added, so the Merkle tree and the logs must not record it
+        perror("Error writing task file");
+        TASAKMAN_PROBE2(add__done, count, false);
+        return false;
+    }
+    next_id_stamp = after;
+    next_id_known = id;
+
+    TASAKMAN_PROBE1(index__start, added);
+    updateMerkleTree(&before, &after, deltas, delta_count, NULL);
+    if (added < count) { // Only new tasks go into the fingerprint set
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!duplicates[i]) fingerprints[kept++] = fingerprints[i];
+        }
+    }
+    updateFingerprintSet(&before, &after, fingerprints, added);
+
+    // One append each to the operation log and crdt.txt for the whole batch
+    OplogBatch log = {NULL, 0, 0, false};
+    char *crdt_entries = (char *)arenaAlloc(arena, added * CRDT_LINE_MAX + 1);
+    size_t crdt_length = 0;
+    CrdtRecord record;
+    memset(&record, 0, sizeof(record)); // Status and deletion never written yet
+    record.state = 'P';
+    FILE *crdt = openCrdtLog(&record.replica);
+    for (size_t i = 0; i < count; i++) {
+        if (duplicates != NULL && duplicates[i]) continue;
+        batchOperation(&log, 'A', ids[i], "%s", descriptions[i]);
+        record.id = ids[i];
+        record.origin = nowNanoseconds(); // A unique creation stamp
+        crdt_length += formatCrdtLine(crdt_entries + crdt_length, CRDT_LINE_MAX, &record);
+    }
+    appendOplog(log.data, log.length);
+    free(log.data);
+    if (crdt != NULL) {
+        if (crdt_length > 0 && write(fileno(crdt), crdt_entries, crdt_length) != (ssize_t)crdt_length) {
+            perror("Error writing crdt.txt");
+        }
+        fclose(crdt);
+    }
+    TASAKMAN_PROBE1(index__done, added);
+    countMetric(COUNTER_STORE_WRITTEN, after.size - before.size);
+    recordLatency(METRIC_COMMIT, started);
+    TASAKMAN_PROBE2(add__done, count, true);
+    return true;
+}
+
+// Function to add a new task
+// With 'unique' (or a store policy) a description that is already pending is rejected or merged
+// into the existing task. Returns false if the task was rejected or could not be added.
+bool addTask(FILE *out, const char *description, bool unique) {
+    int id;
+    bool duplicate;
+    UniquePolicy policy = addPolicy(unique);
+    if (!addTasks(&description, 1, &id, policy, &duplicate)) {
+        return false;
+    }
+    if (!duplicate) {
+        fprintf(out, "Task added: ID %d - \"%s\"\n", id, description); // Confirm to user
+    } else if (policy == UNIQUE_MERGE) {
+        fprintf(out, "Task already exists: ID %d - \"%s\"\n", id, description);
+    } else {
+        fprintf(out, "Task not added: duplicate of pending task ID %d.\n", id);
+        return false;
+    }
+    return true;
+}
+
+// Structure to represent a due date entry from the due date sidecar file
+typedef struct {
+    time_t due; // Due time as seconds since the epoch
+    int id;     // Task ID the due date belongs to
+} DueEntry;
+
+// Function to parse a due time given on the command line
+// Accepts "YYYY-MM-DD", "YYYY-MM-DD HH:MM", a relative "+N[m|h|d]" offset or raw epoch seconds.
+// Returns 0 for "none" (clear the due date) and -1 if the text cannot be parsed.
+time_t parseDueTime(const char *text) {
+    if (strcmp(text, "none") == 0) {
+        return 0;
+    }
+
+    if (text[0] == '+') { // Relative offset from now
+        char *end;
+        long amount = strtol(text + 1, &end, 10);
+        if (end == text + 1 || amount <= 0) {
+            return -1;
+        }
+        long unit = 60; // Minutes by default
+        if (*end == 'h') unit = 3600;
+        else if (*end == 'd') unit = 86400;
+        else if (*end != 'm' && *end != '\0') return -1;
+        return time(NULL) + (time_t)amount * unit;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int year, month, day, hour = 0, minute = 0;
+    int fields = sscanf(text, "%d-%d-%d %d:%d", &year, &month, &day, &hour, &minute);
+    if (fields == 3 || fields == 5) { // Calendar date in local time
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = minute;
+        tm.tm_isdst = -1; // Let mktime figure out daylight saving time
+        time_t due = mktime(&tm);
+        return due > 0 ? due : -1;
+    }
+
+    char *end;
+    long long epoch = strtoll(text, &end, 10);
+    if (*end != '\0' || epoch <= 0) {
+        return -1;
+    }
+    return (time_t)epoch;
+}
+
+// Function to format a due time as "YYYY-MM-DD HH:MM" in local time
+void formatDueTime(time_t due, char *buffer, size_t size) {
+    struct tm tm;
+    localtime_r(&due, &tm);
+    strftime(buffer, size, "%Y-%m-%d %H:%M", &tm);
+}
+
+// Function to compare due entries by task ID (for qsort/bsearch)
+int compareDueEntriesById(const void *a, const void *b) {
+    int idA = ((const DueEntry *)a)->id;
+    int idB = ((const DueEntry *)b)->id;
+    return (idA > idB) - (idA < idB);
+}
+
+// Function to load all due entries from the sidecar file of a store directory
+// Returns a malloc'd array (or NULL if there are none) and stores its length in *count
+DueEntry *loadDueEntries(int dir_fd, size_t *count) {
+    *count = 0;
+    FILE *file = openDirectoryStream(dir_fd, DUE_FILENAME, O_RDONLY, "r");
+    if (file == NULL) {
+        return NULL; // No due dates have been set yet
+    }
+
+    DueEntry *entries = NULL;
+    size_t capacity = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int id;
+        long long due;
+        if (sscanf(line, "%d,%lld", &id, &due) != 2) {
+            continue; // Skip malformed lines
+        }
+        if (*count == capacity) { // Grow the array geometrically
+            capacity = capacity ? capacity * 2 : 64;
+            DueEntry *grown = (DueEntry *)realloc(entries, capacity * sizeof(DueEntry));
+            if (grown == NULL) {
+                perror("Error loading due dates");
+                break;
+            }
+            entries = grown;
+        }
+        entries[*count].id = id;
+        entries[*count].due = (time_t)due;
+        (*count)++;
+    }
+    fclose(file);
+    return entries;
+}
+
+// Function to set or clear the due dates of several tasks at once (entries with due 0 clear)
+// Rewrites the sidecar file through a temporary file, like applyMutations() does for tasks.txt
+bool updateDueDates(DueEntry *changes, size_t count) {
+    FILE *originalFile = openStoreStream(DUE_FILENAME, O_RDONLY, "r");
+    bool any_set = false;
+    for (size_t i = 0; i < count; i++) any_set = any_set || changes[i].due > 0;
+    if (originalFile == NULL && !any_set) {
+        return true; // Nothing to clear
+    }
+    if (count > 1) {
+        qsort(changes, count, sizeof(DueEntry), compareDueEntriesById);
+    }
+
+    FILE *tempFile = openStoreStream("temp_due.txt", O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (tempFile == NULL) {
+        perror("Error creating temporary file");
+        if (originalFile != NULL) fclose(originalFile);
+        return false;
+    }
+
+    if (originalFile != NULL) {
+        char line[64];
+        while (fgets(line, sizeof(line), originalFile) != NULL) {
+            DueEntry key = {0, 0};
+            if (sscanf(line, "%d,", &key.id) == 1 &&
+                bsearch(&key, changes, count, sizeof(DueEntry), compareDueEntriesById) != NULL) {
+                continue; // Drop the old entry for this task
+            }
+            fprintf(tempFile, "%s", line);
+        }
+        fclose(originalFile);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (changes[i].due > 0) {
+            fprintf(tempFile, "%d,%lld\n", changes[i].id, (long long)changes[i].due);
+        }
+    }
+    if (fclose(tempFile) != 0) {
+        perror("Error writing temporary file");
+        unlinkat(task_dir_fd, "temp_due.txt", 0);
+        return false;
+    }
+
+    // renameat() atomically replaces the sidecar, which is what the reminder loop watches for
+    if (renameat(task_dir_fd, "temp_due.txt", task_dir_fd, DUE_FILENAME) == -1) {
+        perror("Error replacing due date file");
+        unlinkat(task_dir_fd, "temp_due.txt", 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to set (or clear, when due is 0) the due date of a single task
+bool setDueDate(int taskId, time_t due) {
+    DueEntry change = {due, taskId};
+    return updateDueDates(&change, 1);
+}
+
+// Function to replace the due date sidecar with the given entries
+bool saveDueEntries(const DueEntry *entries, size_t count) {
+    FILE *tempFile = openStoreStream("temp_due.txt", O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (tempFile == NULL) {
+        perror("Error creating temporary file");
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(tempFile, "%d,%lld\n", entries[i].id, (long long)entries[i].due);
+    }
+    if (fclose(tempFile) != 0 || renameat(task_dir_fd, "temp_due.txt", task_dir_fd, DUE_FILENAME) == -1) {
+        perror("Error replacing due date file");
+        unlinkat(task_dir_fd, "temp_due.txt", 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to print one row of the task list
+void printTaskRow(FILE *out, int id, bool completed, const char *description, const DueEntry *due) {
+    // Print task details formatted with colors
+    const char* status_text = (completed ? "[DONE]" : "[PENDING]");
+    const char* status_color = (completed ? ANSI_COLOR_GREEN : ANSI_COLOR_YELLOW);
+
+    fprintf(out, "%sID: %-4d%s Status: %s%-10s%s Description: %s%s",
+           ANSI_COLOR_CYAN, id, ANSI_COLOR_RESET, // ID in Cyan
+           status_color, status_text, ANSI_COLOR_RESET, // Status in Green/Yellow
+           description, ANSI_COLOR_RESET); // Description (default color)
+
+    if (due != NULL) {
+        char when_text[32];
+        formatDueTime(due->due, when_text, sizeof(when_text));
+        fprintf(out, " %s(due %s)%s", ANSI_COLOR_MAGENTA, when_text, ANSI_COLOR_RESET); // Due date in Magenta
+    }
+    fprintf(out, "\n");
+}
+
+// Function to parse an ID range given as "A-B", "A-" (A and above) or "A"
+// Returns false if it is malformed.
+bool parseIdRange(const char *text, int *low, int *high) {
+    char *end;
+    long first = strtol(text, &end, 10);
+    if (end == text || first <= 0 || first > INT_MAX) {
+        return false;
+    }
+    long last = first;
+    if (*end == '-') {
+        const char *rest = end + 1;
+        if (*rest == '\0') {
+            last = INT_MAX;
+            end = (char *)rest;
+        } else {
+            last = strtol(rest, &end, 10);
+            if (end == rest || last > INT_MAX) {
+                return false;
+            }
+        }
+    }
+    if (*end != '\0' || last < first) {
+        return false;
+    }
+    *low = (int)first;
+    *high = (int)last;
+    return true;
+}
+
+// Orders 'list' can print tasks in besides file order
+typedef enum {
+    SORT_NONE,
+    SORT_DESCRIPTION, // Case-insensitive
+    SORT_CREATED,     // Oldest first (from the operation log; unknown last)
+    SORT_DUE,         // Soonest first; tasks without a due date last
+    SORT_PRIORITY     // Pending before done, then by due date
+} ListSort;
+
+// Options of 'list'
+typedef struct {
+    int low, high;    // Inclusive ID range, 1..INT_MAX when none is given
+    ListSort sort;
+    size_t limit;     // Print at most this many tasks (0: all)
+} ListOptions;
+
+// Function to parse the options of 'list' ([--id-range A-B] [--sort-by KEY] [--limit K])
+// Prints usage and returns false on bad options.
+bool parseListOptions(const char *program, int argc, char *argv[], ListOptions *options, FILE *out) {
+    static const char *const sorts[] = {"", "description", "created", "due", "priority"};
+    options->low = 1;
+    options->high = INT_MAX;
+    options->sort = SORT_NONE;
+    options->limit = 0;
+    for (int i = 2; i < argc; i++) {
+        bool ok = i + 1 < argc;
+        if (ok && strcmp(argv[i], "--id-range") == 0) {
+            ok = parseIdRange(argv[i + 1], &options->low, &options->high);
+        } else if (ok && strcmp(argv[i], "--sort-by") == 0) {
+            int sort = SORT_PRIORITY;
+            while (sort > SORT_NONE && strcmp(argv[i + 1], sorts[sort]) != 0) sort--;
+            options->sort = (ListSort)sort;
+            ok = sort != SORT_NONE;
+        } else if (ok && strcmp(argv[i], "--limit") == 0) {
+            char *end;
+            long limit = strtol(argv[i + 1], &end, 10);
+            options->limit = limit > 0 && *end == '\0' ? (size_t)limit : 0;
+            ok = options->limit > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(out, "Usage: %s list [--id-range A-B] [--sort-by description|created|due|priority] [--limit K]\n", program);
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+// Function to list all tasks, or those with IDs in [low, high]
+void listTasks(FILE *out, int low, int high) {
+    // tasks.txt is opened relative to the task directory
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDONLY, "r"); // Open in read mode
+    if (file == NULL) {
+        fprintf(out, "No tasks found. Create one using 'add' command.\n"); // Inform if file doesn't exist
+        return;
+    }
+
+    // Load due dates once and sort them by ID so each row can be matched with a binary search
+    size_t due_count;
+    DueEntry *due_entries = loadDueEntries(task_dir_fd, &due_count);
+    if (due_count > 1) {
+        qsort(due_entries, due_count, sizeof(DueEntry), compareDueEntriesById);
+    }
+
+    fprintf(out, "\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    char line[MAX_DESCRIPTION_LEN + 20]; // Buffer for reading lines
+    int count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) { // Read file line by line
+        int id, status;
+        char description[MAX_DESCRIPTION_LEN];
+        // Parse the line: ID,STATUS,DESCRIPTION
+        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) == 3 && id >= low && id <= high) {
+            TASAKMAN_PROBE2(list__record, id, status);
+            DueEntry key = {0, id};
+            DueEntry *due = due_count > 0 ? (DueEntry *)bsearch(&key, due_entries, due_count, sizeof(DueEntry), compareDueEntriesById) : NULL;
+            printTaskRow(out, id, status == 1, description, due);
+            count++;
+        }
+    }
+    fclose(file); // Close the file
+    free(due_entries);
+    if (count == 0) {
+        fprintf(out, "No tasks found.\n"); // Handle case where file exists but is empty
+    }
+    fprintf(out, "%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+}
+
+// A change to one task, applied together with others by applyMutations()
+typedef struct {
+    int id;
+    char op;    // 'C' mark as done, 'P' mark as pending, 'X' delete
+    bool found; // Set by applyMutations() if the task existed when the change was applied
+} Mutation;
+
+// Position of a mutation in its batch, sorted by (ID, position) to look changes up per line
+typedef struct {
+    int id;
+    size_t position;
+} MutationRef;
+
+// Function to order mutation references by task ID, keeping batch order for the same ID
+int compareMutationRefs(const void *a, const void *b) {
+    const MutationRef *x = (const MutationRef *)a, *y = (const MutationRef *)b;
+    if (x->id != y->id) return x->id < y->id ? -1 : 1;
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Function to apply a batch of status changes and deletions with a single rewrite of tasks.txt
+// Scripts that change many tasks pay for one pass over the file instead of one per task. Changes
+// to the same task are applied in batch order. The due dates, Merkle tree, operation log and
+// crdt.txt are updated once for the whole batch as well.
+// Returns false if there is no task file (or it could not be rewritten).
+bool applyMutations(Mutation *mutations, size_t count) {
+    TASAKMAN_PROBE1(mutation__start, count);
+    uint64_t started = metricClock();
+    FILE *originalFile = openStoreStream(TASK_FILENAME, O_RDONLY, "r"); // Open original file for reading
+    if (originalFile == NULL) {
+        TASAKMAN_PROBE2(mutation__done, count, false);
+        return false;
+    }
+
+    // Create a temporary file in the same directory as tasks.txt
+    const char *temp_name = "temp_tasks.txt";
+    FILE *tempFile = openStoreStream(temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w"); // Open temporary file for writing
+    if (tempFile == NULL) {
+        perror("Error creating temporary file");
+        fclose(originalFile);
+        TASAKMAN_PROBE2(mutation__done, count, false);
+        return false;
+    }
+
+    struct stat st;
+    fstat(fileno(originalFile), &st);
+    StoreStamp before = stampFromStat(&st); // tasks.txt before this mutation (for the Merkle tree)
+
+    // Sort positions so each line can find its changes with a binary search
+    Arena *arena = scratchArena();
+    MutationRef *refs = (MutationRef *)arenaAlloc(arena, (count + 1) * sizeof(MutationRef));
+    for (size_t i = 0; i < count; i++) {
+        refs[i].id = mutations[i].id;
+        refs[i].position = i;
+        mutations[i].found = false;
+    }
+    qsort(refs, count, sizeof(MutationRef), compareMutationRefs);
+
+    MerkleDelta *deltas = (MerkleDelta *)arenaAlloc(arena, (count + 1) * sizeof(MerkleDelta));
+    CrdtChange *changes = (CrdtChange *)arenaAlloc(arena, (count + 1) * sizeof(CrdtChange));
+    DueEntry *cleared_due = (DueEntry *)arenaAlloc(arena, (count + 1) * sizeof(DueEntry));
+    FingerprintChange *fingerprints = (FingerprintChange *)arenaAlloc(arena, (2 * count + 1) * sizeof(FingerprintChange));
+    OplogBatch log = {NULL, 0, 0, false};
+    size_t delta_count = 0, change_count = 0, cleared_count = 0, fingerprint_count = 0;
+    LeafSpanIndex spans = {NULL, 0}; // Where each leaf's records end up in the new file
+    bool indexed = true;
+
+    char line[MAX_DESCRIPTION_LEN + 20];
+    uint64_t offset = 0;
+    while (fgets(line, sizeof(line), originalFile) != NULL) {
+        int id, status, length;
+        char description[MAX_DESCRIPTION_LEN];
+        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) != 3) {
+            // Copy malformed lines as they are (to preserve file integrity)
+            length = fprintf(tempFile, "%s", line);
+            offset += length > 0 ? (uint64_t)length : 0;
+            continue;
+        }
+
+        // Find the first change for this ID
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (refs[mid].id < id) low = mid + 1;
+            else high = mid;
+        }
+        if (low == count || refs[low].id != id) {
+            length = fprintf(tempFile, "%s", line); // Copy other tasks as they are
+            if (id > 0 && length > 0) indexed = noteLeafSpan(&spans, id, offset, offset + (uint64_t)length) && indexed;
+            offset += length > 0 ? (uint64_t)length : 0;
+            continue;
+        }
+
+        // Apply every change for this task in order
+        int new_status = status;
+        bool deleted = false;
+        for (size_t k = low; k < count && refs[k].id == id && !deleted; k++) {
+            Mutation *mutation = &mutations[refs[k].position];
+            mutation->found = true;
+            if (mutation->op == 'X') {
+                deleted = true;
+                batchOperation(&log, 'D', id, NULL);
+            } else {
+                new_status = mutation->op == 'C' ? 1 : 0;
+                batchOperation(&log, 'S', id, "%d", new_status);
+            }
+        }
+
+        deltas[delta_count].id = id;
+        if (deleted) { // Found the task to delete, so DON'T write this line to tempFile
+            deltas[delta_count++].delta = 0 - recordHash(id, status, description); // Remove it from the tree
+            cleared_due[cleared_count].id = id; // Drop the task's due date along with it
+            cleared_due[cleared_count++].due = 0;
+        } else {
+            length = fprintf(tempFile, "%d,%d,%s\n", id, new_status, description);
+            if (id > 0 && length > 0) indexed = noteLeafSpan(&spans, id, offset, offset + (uint64_t)length) && indexed;
+            offset += length > 0 ? (uint64_t)length : 0;
+            deltas[delta_count++].delta = recordHash(id, new_status, description) - recordHash(id, status, description);
+        }
+        bool was_pending = status != 1, is_pending = !deleted && new_status != 1;
+        if (was_pending != is_pending) { // The task enters or leaves the set of pending descriptions
+            FingerprintChange *fingerprint = &fingerprints[fingerprint_count++];
+            fingerprint->fingerprint = descriptionFingerprint(description);
+            fingerprint->id = id;
+            fingerprint->delta = is_pending ? 1 : -1;
+        }
+        char state = deleted ? 'X' : new_status == 1 ? 'C' : 'P';
+        TASAKMAN_PROBE2(mutation__record, id, state);
+        changes[change_count].id = id;
+        changes[change_count].state = state;
+        changes[change_count++].description = arenaStrdup(arena, description);
+    }
+
+    fclose(originalFile); // Close both files
+    bool ok = fflush(tempFile) == 0;
+    fstat(fileno(tempFile), &st); // rename() keeps the inode and times, so this is tasks.txt after the mutation
+    StoreStamp after = stampFromStat(&st);
+    ok = fclose(tempFile) == 0 && ok;
+    TASAKMAN_PROBE2(mutation__commit, change_count, ok);
+
+    // rename() atomically replaces the original file with the temporary file
+    TASAKMAN_PROBE0(rename__start);
+    ok = ok && renameat(task_dir_fd, temp_name, task_dir_fd, TASK_FILENAME) == 0;
+    TASAKMAN_PROBE1(rename__done, ok);
+    if (!ok) {
+        perror("Error replacing task file");
+        unlinkat(task_dir_fd, temp_name, 0);
+    } else {
+        TASAKMAN_PROBE1(index__start, change_count);
+        appendOplog(log.data, log.length);
+        if (indexed) {
+            updateMerkleTree(&before, &after, deltas, delta_count, &spans);
+        } else {
+            unlinkat(task_dir_fd, MERKLE_FILENAME, 0); // Out of memory for the spans: 'diff' rebuilds the tree
+        }
+        updateFingerprintSet(&before, &after, fingerprints, fingerprint_count);
+        crdtRecordChanges(changes, change_count);
+        if (cleared_count > 0) {
+            updateDueDates(cleared_due, cleared_count);
+        }
+        TASAKMAN_PROBE1(index__done, change_count);
+    }
+    countMetric(COUNTER_STORE_READ, before.size);
+    countMetric(COUNTER_STORE_WRITTEN, after.size);
+    recordLatency(METRIC_COMMIT, started);
+    free(log.data);
+    free(spans.items);
+    TASAKMAN_PROBE2(mutation__done, count, ok);
+    return ok;
+}
+
+// Function to parse the task IDs given on the command line
+// Returns a malloc'd array, or NULL (after saying why on out) if one of them is not a positive integer
+int *parseTaskIds(FILE *out, char *const *args, size_t count) {
+    int *taskIds = (int *)malloc((count + 1) * sizeof(int));
+    if (taskIds == NULL) {
+        perror("Error parsing task IDs");
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        taskIds[i] = atoi(args[i]);
+        if (taskIds[i] <= 0) {
+            fprintf(out, "Invalid task ID. Please provide a positive integer.\n");
+            free(taskIds);
+            return NULL;
+        }
+    }
+    return taskIds;
+}
+
+// Function to modify the status of one or more tasks (mark as done or pending)
+void modifyTaskStatus(FILE *out, const int *taskIds, size_t count, bool complete) {
+    Mutation *mutations = (Mutation *)malloc((count + 1) * sizeof(Mutation));
+    for (size_t i = 0; i < count; i++) {
+        mutations[i].id = taskIds[i];
+        mutations[i].op = complete ? 'C' : 'P';
+    }
+    if (!applyMutations(mutations, count)) {
+        fprintf(out, "No tasks found.\n");
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            if (mutations[i].found) {
+                fprintf(out, "Task ID %d marked as %s.\n", taskIds[i], complete ? "DONE" : "PENDING");
+            } else {
+                fprintf(out, "Task ID %d not found.\n", taskIds[i]);
+            }
+        }
+    }
+    free(mutations);
+}
+
+// Function to delete one or more tasks
+void deleteTask(FILE *out, const int *taskIds, size_t count) {
+    Mutation *mutations = (Mutation *)malloc((count + 1) * sizeof(Mutation));
+    for (size_t i = 0; i < count; i++) {
+        mutations[i].id = taskIds[i];
+        mutations[i].op = 'X';
+    }
+    if (!applyMutations(mutations, count)) {
+        fprintf(out, "No tasks found.\n");
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            if (mutations[i].found) {
+                fprintf(out, "Task ID %d deleted.\n", taskIds[i]);
+            } else {
+                fprintf(out, "Task ID %d not found.\n", taskIds[i]);
+            }
+        }
+    }
+    free(mutations);
+}
+
+
+// Function to look up a single task by ID
+// Copies its description into the buffer and returns true if the task exists
+bool findTask(int taskId, char *description, size_t size, bool *completed) {
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDONLY, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    char line[MAX_DESCRIPTION_LEN + 20];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int id, status;
+        char text[MAX_DESCRIPTION_LEN];
+        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, text) == 3 && id == taskId) {
+            snprintf(description, size, "%s", text);
+            *completed = (status == 1);
+            found = true;
+            break;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// Function to handle the 'due' command
+void dueTask(FILE *out, int taskId, const char *when) {
+    char description[MAX_DESCRIPTION_LEN];
+    bool completed;
+    if (!findTask(taskId, description, sizeof(description), &completed)) {
+        fprintf(out, "Task ID %d not found.\n", taskId);
+        return;
+    }
+
+    time_t due = parseDueTime(when);
+    if (due == -1) {
+        fprintf(out, "Invalid due time: %s (use YYYY-MM-DD [HH:MM], +N[m|h|d] or none)\n", when);
+        return;
+    }
+    if (!setDueDate(taskId, due)) {
+        return;
+    }
+    logOperation('U', taskId, "%lld", (long long)due);
+
+    if (due == 0) {
+        fprintf(out, "Task ID %d due date cleared.\n", taskId);
+    } else {
+        char when_text[32];
+        formatDueTime(due, when_text, sizeof(when_text));
+        fprintf(out, "Task ID %d due %s.\n", taskId, when_text);
+    }
+}
+
+// Min-heap of due entries ordered by due time, used by the reminder loop
+typedef struct {
+    DueEntry *items;
+    size_t count;
+} ReminderHeap;
+
+// Function to restore the heap property downwards from the given index
+void reminderHeapSiftDown(ReminderHeap *heap, size_t index) {
+    for (;;) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1, right = left + 1;
+        if (left < heap->count && heap->items[left].due < heap->items[smallest].due) smallest = left;
+        if (right < heap->count && heap->items[right].due < heap->items[smallest].due) smallest = right;
+        if (smallest == index) {
+            return;
+        }
+        DueEntry tmp = heap->items[index];
+        heap->items[index] = heap->items[smallest];
+        heap->items[smallest] = tmp;
+        index = smallest;
+    }
+}
+
+// Function to remove the earliest reminder from the heap
+void reminderHeapPop(ReminderHeap *heap) {
+    heap->items[0] = heap->items[--heap->count];
+    reminderHeapSiftDown(heap, 0);
+}
+
+// Function to compare due entries by task ID and then by due time (for qsort/bsearch)
+int compareDueEntries(const void *a, const void *b) {
+    const DueEntry *entryA = (const DueEntry *)a, *entryB = (const DueEntry *)b;
+    if (entryA->id != entryB->id) {
+        return (entryA->id > entryB->id) - (entryA->id < entryB->id);
+    }
+    return (entryA->due > entryB->due) - (entryA->due < entryB->due);
+}
+
+// Function to compare due entries by due time, latest first (for qsort)
+int compareDueEntriesLatestFirst(const void *a, const void *b) {
+    time_t dueA = ((const DueEntry *)a)->due, dueB = ((const DueEntry *)b)->due;
+    return (dueA < dueB) - (dueA > dueB);
+}
+
+// Delivered reminders, one "ID,EPOCH" line per due entry in remind.sent
+// A reminder belongs to a due entry rather than to a point in time: it fires once for each
+// (task, due time) pair, whether that time passed while 'remind' was watching, while it was not
+// running, or before the due date was even set. Setting a new due time makes a new entry.
+typedef struct {
+    DueEntry *items; // Sorted with compareDueEntries()
+    size_t count;
+} DeliveredSet;
+
+// Function to load the delivered reminders that still match an entry of due.txt
+// 'entries' must be sorted with compareDueEntries(). Pairs whose due date was changed or cleared
+// since they fired are dropped, and remind.sent is rewritten without them so it stays as small
+// as due.txt.
+void loadDeliveredReminders(DeliveredSet *sent, const DueEntry *entries, size_t count) {
+    free(sent->items);
+    sent->items = NULL;
+    sent->count = 0;
+    FILE *file = openStoreStream(REMIND_FILENAME, O_RDONLY, "r");
+    if (file == NULL) {
+        return; // Nothing delivered yet
+    }
+
+    size_t capacity = 0, stale = 0;
+    char line[64];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        long long due;
+        DueEntry entry;
+        if (sscanf(line, "%d,%lld", &entry.id, &due) != 2) {
+            stale++;
+            continue;
+        }
+        entry.due = (time_t)due;
+        if (count == 0 || bsearch(&entry, entries, count, sizeof(DueEntry), compareDueEntries) == NULL) {
+            stale++; // The due date has changed since
+            continue;
+        }
+        if (sent->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            DueEntry *grown = (DueEntry *)realloc(sent->items, capacity * sizeof(DueEntry));
+            if (grown == NULL) {
+                perror("Error loading delivered reminders");
+                break;
+            }
+            sent->items = grown;
+        }
+        sent->items[sent->count++] = entry;
+    }
+    fclose(file);
+    if (sent->count > 1) {
+        qsort(sent->items, sent->count, sizeof(DueEntry), compareDueEntries);
+    }
+    if (stale == 0) {
+        return;
+    }
+
+    // Compact through a temporary file; remind.sent is not the file the loop watches
+    FILE *tempFile = openStoreStream("temp_remind.txt", O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (tempFile == NULL) {
+        return; // Keep the stale lines; they are filtered out again on the next load
+    }
+    for (size_t i = 0; i < sent->count; i++) {
+        fprintf(tempFile, "%d,%lld\n", sent->items[i].id, (long long)sent->items[i].due);
+    }
+    if (fclose(tempFile) != 0 || renameat(task_dir_fd, "temp_remind.txt", task_dir_fd, REMIND_FILENAME) == -1) {
+        unlinkat(task_dir_fd, "temp_remind.txt", 0);
+    }
+}
+
+// Function to record reminders as delivered, in memory and with one append to remind.sent
+void markRemindersDelivered(DeliveredSet *sent, const DueEntry *entries, size_t count) {
+    DueEntry *grown = (DueEntry *)realloc(sent->items, (sent->count + count) * sizeof(DueEntry));
+    if (grown == NULL) {
+        perror("Error recording delivered reminders");
+        return;
+    }
+    sent->items = grown;
+    memcpy(sent->items + sent->count, entries, count * sizeof(DueEntry));
+    sent->count += count;
+    qsort(sent->items, sent->count, sizeof(DueEntry), compareDueEntries);
+
+    FILE *file = openStoreStream(REMIND_FILENAME, O_WRONLY | O_APPEND | O_CREAT, "a");
+    if (file == NULL) {
+        perror("Error recording delivered reminders");
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "%d,%lld\n", entries[i].id, (long long)entries[i].due);
+    }
+    if (fclose(file) != 0) {
+        perror("Error recording delivered reminders");
+    }
+}
+
+// Function to (re)build the reminder heap from the sidecar file
+// Every entry that has not been delivered yet is kept, including ones whose time has already
+// passed; those fire on the next wakeup. The delivered set is reloaded along with it.
+void loadReminders(ReminderHeap *heap, DeliveredSet *sent) {
+    free(heap->items);
+    size_t count;
+    heap->items = loadDueEntries(task_dir_fd, &count);
+    if (count > 1) {
+        qsort(heap->items, count, sizeof(DueEntry), compareDueEntries);
+    }
+    loadDeliveredReminders(sent, heap->items, count);
+    heap->count = 0;
+    for (size_t i = 0; i < count; i++) { // Keep only reminders that have not been delivered
+        if (sent->count == 0 || bsearch(&heap->items[i], sent->items, sent->count, sizeof(DueEntry), compareDueEntries) == NULL) {
+            heap->items[heap->count++] = heap->items[i];
+        }
+    }
+    for (size_t i = heap->count / 2; i-- > 0;) { // Heapify bottom-up in O(n)
+        reminderHeapSiftDown(heap, i);
+    }
+}
+
+// Function to deliver a single reminder, either by printing it or by running the hook
+void fireReminder(const DueEntry *entry, const char *description, const char *hook) {
+    char when_text[32];
+    formatDueTime(entry->due, when_text, sizeof(when_text));
+    if (hook == NULL) {
+        printf("%sReminder:%s Task ID %d is due (%s) - \"%s\"\n",
+               ANSI_COLOR_MAGENTA, ANSI_COLOR_RESET, entry->id, when_text, description);
+        fflush(stdout);
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) { // Child: expose the task to the hook through the environment
+        char id_text[16];
+        snprintf(id_text, sizeof(id_text), "%d", entry->id);
+        setenv("TASAKMAN_TASK_ID", id_text, 1);
+        setenv("TASAKMAN_TASK_DESCRIPTION", description, 1);
+        setenv("TASAKMAN_TASK_DUE", when_text, 1);
+        execl("/bin/sh", "sh", "-c", hook, (char *)NULL);
+        _exit(127); // Only reached if exec failed
+    } else if (pid == -1) {
+        perror("Error running reminder hook");
+    }
+}
+
+// Function to deliver the reminders that came due together
+// The first 'late' entries were missed rather than reached (the loop was not running, or the due
+// date was set in the past) and must be sorted latest first; only the REMIND_CATCH_UP most recent
+// of those fire individually, so a long absence does not start a hook per overdue task. Their
+// tasks are looked up in one scan of tasks.txt at fire time, so status changes and deletions are
+// respected without a scan per reminder.
+void fireReminders(const DueEntry *entries, size_t count, size_t late, const char *hook) {
+    DueEntry *by_id = (DueEntry *)malloc(count * sizeof(DueEntry));
+    char (*descriptions)[MAX_DESCRIPTION_LEN] = (char (*)[MAX_DESCRIPTION_LEN])malloc(count * MAX_DESCRIPTION_LEN);
+    bool *pending = (bool *)calloc(count, sizeof(bool));
+    if (by_id == NULL || descriptions == NULL || pending == NULL) {
+        perror("Error delivering reminders");
+        free(by_id);
+        free(descriptions);
+        free(pending);
+        return;
+    }
+    memcpy(by_id, entries, count * sizeof(DueEntry));
+    qsort(by_id, count, sizeof(DueEntry), compareDueEntriesById); // due.txt has one entry per task
+
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDONLY, "r");
+    char line[MAX_DESCRIPTION_LEN + 20];
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        DueEntry key;
+        char text[MAX_DESCRIPTION_LEN];
+        int status;
+        if (sscanf(line, "%d,%d,%[^\n]", &key.id, &status, text) != 3) {
+            continue;
+        }
+        DueEntry *match = (DueEntry *)bsearch(&key, by_id, count, sizeof(DueEntry), compareDueEntriesById);
+        if (match != NULL) {
+            size_t index = (size_t)(match - by_id);
+            snprintf(descriptions[index], MAX_DESCRIPTION_LEN, "%s", text);
+            pending[index] = status != 1;
+        }
+    }
+    if (file != NULL) fclose(file);
+
+    size_t caught_up = 0, skipped = 0;
+    for (size_t i = 0; i < count; i++) {
+        const DueEntry *match = (const DueEntry *)bsearch(&entries[i], by_id, count, sizeof(DueEntry), compareDueEntriesById);
+        size_t index = (size_t)(match - by_id);
+        if (!pending[index]) {
+            continue;
+        }
+        if (i < late && caught_up == REMIND_CATCH_UP) {
+            skipped++;
+        } else {
+            caught_up += i < late;
+            fireReminder(&entries[i], descriptions[index], hook);
+        }
+    }
+    if (skipped > 0) {
+        printf("%sReminder:%s %zu more overdue task(s) not shown individually.\n",
+               ANSI_COLOR_MAGENTA, ANSI_COLOR_RESET, skipped);
+        fflush(stdout);
+    }
+    free(by_id);
+    free(descriptions);
+    free(pending);
+}
+
+// Function to run the reminder loop (the 'remind' command)
+// Sleeps in poll() until the nearest due time or until inotify reports a change to the due date
+// file, so an idle loop costs no CPU no matter how many reminders are scheduled.
+void remindTasks(const char *hook) {
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        perror("Error initializing inotify");
+        return;
+    }
+    // Watch the directory rather than the file, because setDueDate() replaces it through rename()
+    if (inotify_add_watch(inotify_fd, task_dir_path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) == -1) {
+        perror("Error watching task directory");
+        close(inotify_fd);
+        return;
+    }
+    signal(SIGCHLD, SIG_IGN); // Let the kernel reap finished hooks
+
+    time_t last_check = time(NULL);
+    ReminderHeap heap = {NULL, 0};
+    DeliveredSet sent = {NULL, 0};
+    loadReminders(&heap, &sent); // Undelivered reminders that are already overdue fire right away
+    printf("Watching %zu reminder(s). Press Ctrl+C to stop.\n", heap.count);
+    fflush(stdout);
+
+    DueEntry *due_now = NULL;
+    size_t due_capacity = 0;
+    for (;;) {
+        time_t now = time(NULL);
+        size_t due_count = 0, late = 0;
+        while (heap.count > 0 && heap.items[0].due <= now) { // Collect everything that is due
+            if (due_count == due_capacity) {
+                due_capacity = due_capacity ? due_capacity * 2 : 16;
+                DueEntry *grown = (DueEntry *)realloc(due_now, due_capacity * sizeof(DueEntry));
+                if (grown == NULL) {
+                    perror("Error collecting reminders");
+                    break;
+                }
+                due_now = grown;
+            }
+            DueEntry entry = heap.items[0];
+            reminderHeapPop(&heap);
+            // Entries already due at the previous check were missed, not reached: keep them in front
+            due_now[due_count++] = entry;
+            if (entry.due <= last_check) {
+                due_now[due_count - 1] = due_now[late];
+                due_now[late++] = entry;
+            }
+        }
+        if (due_count > 0) {
+            qsort(due_now, late, sizeof(DueEntry), compareDueEntriesLatestFirst);
+            fireReminders(due_now, due_count, late, hook);
+            markRemindersDelivered(&sent, due_now, due_count);
+        }
+        last_check = now;
+
+        int timeout_ms = -1; // Block indefinitely when nothing is scheduled
+        if (heap.count > 0) {
+            long long wait_ms = (long long)(heap.items[0].due - now) * 1000;
+            timeout_ms = wait_ms > INT_MAX ? INT_MAX : (int)wait_ms;
+        }
+
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            perror("Error waiting for reminders");
+            break;
+        }
+        if (ready == 0) {
+            continue; // Timed out: the nearest reminder is due now
+        }
+
+        // Drain the inotify events and reload only if the due date file changed
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t length = read(inotify_fd, events, sizeof(events));
+        bool reload = false;
+        for (char *ptr = events; length > 0 && ptr < events + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            if (event->len > 0 && strcmp(event->name, DUE_FILENAME) == 0) {
+                reload = true;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+        if (reload) {
+            loadReminders(&heap, &sent);
+        }
+    }
+
+    free(heap.items);
+    free(sent.items);
+    free(due_now);
+    close(inotify_fd);
+}
+
+
+// Read access to a Merkle tree while diffing, either persisted (read on demand) or in memory
+typedef struct {
+    uint64_t capacity;
+    uint64_t *nodes; // Freshly built tree kept in memory, or NULL
+    LeafSpan *spans; // Leaf spans of the in-memory tree
+    int fd;          // Persisted tree read node-by-node with pread, or -1
+} MerkleTree;
+
+// A task record with a heap-allocated description (used by diff and replicate)
+typedef struct {
+    int id;
+    int status;
+    char *description;
+} TaskRecord;
+
+// A store named on the command line: its directory and the name of its tasks file in it
+typedef struct {
+    int dir_fd;
+    char tasks_name[MAX_PATH_LEN];
+} StoreLocation;
+
+// Function to resolve a store argument (a task directory or a tasks file) into a StoreLocation
+// The directory is opened once here and everything else is opened relative to it. Returns false
+// (after printing why) if it can't be opened; close location->dir_fd when done.
+bool openStoreLocation(const char *store, StoreLocation *location) {
+    struct stat st;
+    if (stat(store, &st) == 0 && S_ISDIR(st.st_mode)) {
+        location->dir_fd = open(store, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        snprintf(location->tasks_name, sizeof(location->tasks_name), "%s", TASK_FILENAME);
+    } else {
+        const char *slash = strrchr(store, '/');
+        char dir_path[MAX_PATH_LEN];
+        if (slash == NULL) {
+            snprintf(dir_path, sizeof(dir_path), ".");
+        } else if (slash == store) {
+            snprintf(dir_path, sizeof(dir_path), "/");
+        } else {
+            snprintf(dir_path, sizeof(dir_path), "%.*s", (int)(slash - store), store);
+        }
+        location->dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        snprintf(location->tasks_name, sizeof(location->tasks_name), "%s", slash != NULL ? slash + 1 : store);
+    }
+    if (location->dir_fd == -1) {
+        fprintf(stderr, "Error opening store %s: %s\n", store, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Function to open the Merkle tree of a store, rebuilding (and persisting) it if it is stale
+bool openMerkleTree(const StoreLocation *location, MerkleTree *tree) {
+    StoreStamp stamp = stampDirectoryFile(location->dir_fd, location->tasks_name);
+    tree->nodes = NULL;
+    tree->spans = NULL;
+    tree->fd = openDirectoryFile(location->dir_fd, MERKLE_FILENAME, O_RDONLY);
+    if (tree->fd != -1) {
+        MerkleHeader header;
+        if (pread(tree->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, MERKLE_MAGIC, sizeof(header.magic)) == 0 &&
+            stampsEqual(&header.stamp, &stamp)) {
+            tree->capacity = header.capacity;
+            return true; // Up to date: nodes are read on demand
+        }
+        close(tree->fd);
+        tree->fd = -1;
+    }
+
+    // Missing or stale: one linear scan rebuilds it, after which mutations keep it current
+    tree->nodes = buildMerkleTree(location->dir_fd, location->tasks_name, &tree->capacity, &tree->spans);
+    if (tree->nodes == NULL) {
+        return false;
+    }
+    saveMerkleTree(location->dir_fd, &stamp, tree->nodes, tree->spans, tree->capacity);
+    return true;
+}
+
+// Function to release a tree opened with openMerkleTree()
+void closeMerkleTree(MerkleTree *tree) {
+    free(tree->nodes);
+    free(tree->spans);
+    if (tree->fd != -1) close(tree->fd);
+}
+
+// Function to read the hash covering 'span' leaves starting at leaf 'first'
+// Trees of different capacities are compared as if the smaller one were padded with empty leaves.
+uint64_t merkleRangeHash(const MerkleTree *tree, uint64_t first, uint64_t span) {
+    if (first >= tree->capacity) {
+        return 0; // Entirely past this tree's last leaf: empty
+    }
+    uint64_t index = span >= tree->capacity ? 1 : (tree->capacity + first) / span;
+    if (tree->nodes != NULL) {
+        return tree->nodes[index];
+    }
+    uint64_t hash = 0;
+    if (pread(tree->fd, &hash, sizeof(hash), sizeof(MerkleHeader) + index * sizeof(uint64_t)) != (ssize_t)sizeof(hash)) {
+        return 0;
+    }
+    return hash;
+}
+
+// Function to compare records by ID (for qsort)
+int compareTaskRecords(const void *a, const void *b) {
+    int idA = ((const TaskRecord *)a)->id;
+    int idB = ((const TaskRecord *)b)->id;
+    return (idA > idB) - (idA < idB);
+}
+
+// Function to compare leaf numbers (for bsearch)
+int compareLeaves(const void *a, const void *b) {
+    uint64_t leafA = *(const uint64_t *)a;
+    uint64_t leafB = *(const uint64_t *)b;
+    return (leafA > leafB) - (leafA < leafB);
+}
+
+// Function to compare leaf spans by start offset (for qsort)
+int compareLeafSpans(const void *a, const void *b) {
+    uint64_t startA = ((const LeafSpan *)a)->start;
+    uint64_t startB = ((const LeafSpan *)b)->start;
+    return (startA > startB) - (startA < startB);
+}
+
+// Function to read where the records of one leaf are in the tasks file
+LeafSpan merkleLeafSpan(const MerkleTree *tree, uint64_t leaf) {
+    LeafSpan span = {0, 0};
+    if (leaf >= tree->capacity) {
+        return span; // Past this tree's last leaf: no records
+    }
+    if (tree->nodes != NULL) {
+        return tree->spans[leaf];
+    }
+    off_t position = (off_t)(sizeof(MerkleHeader) + 2 * tree->capacity * sizeof(uint64_t) + leaf * sizeof(LeafSpan));
+    if (pread(tree->fd, &span, sizeof(span), position) != (ssize_t)sizeof(span)) {
+        span.start = span.end = 0;
+    }
+    return span;
+}
+
+// Function to collect the records of a tasks file that fall into the given (sorted) leaves
+// Only the byte ranges the tree records for those leaves are read, so the cost follows the
+// number of differing records rather than the size of the store. The records and their
+// descriptions are allocated from the arena.
+TaskRecord *collectTaskRecords(Arena *arena, const StoreLocation *location, const MerkleTree *tree, const uint64_t *leaves, size_t leaf_count, size_t *count) {
+    *count = 0;
+    LeafSpan *ranges = (LeafSpan *)malloc(leaf_count * sizeof(LeafSpan));
+    int fd = openDirectoryFile(location->dir_fd, location->tasks_name, O_RDONLY);
+    if (ranges == NULL || fd == -1) {
+        free(ranges);
+        if (fd != -1) close(fd);
+        return NULL;
+    }
+
+    // Sort the ranges into file order and merge overlapping ones, so no line is read twice
+    size_t range_count = 0;
+    for (size_t i = 0; i < leaf_count; i++) {
+        LeafSpan span = merkleLeafSpan(tree, leaves[i]);
+        if (span.end > span.start) {
+            ranges[range_count++] = span;
+        }
+    }
+    qsort(ranges, range_count, sizeof(LeafSpan), compareLeafSpans);
+    size_t merged = 0;
+    for (size_t i = 0; i < range_count; i++) {
+        if (merged > 0 && ranges[i].start <= ranges[merged - 1].end) {
+            if (ranges[i].end > ranges[merged - 1].end) ranges[merged - 1].end = ranges[i].end;
+        } else {
+            ranges[merged++] = ranges[i];
+        }
+    }
+
+    TaskRecord *records = NULL;
+    size_t capacity = 0;
+    char *buffer = NULL;
+    for (size_t r = 0; r < merged; r++) {
+        size_t size = (size_t)(ranges[r].end - ranges[r].start);
+        char *grown_buffer = (char *)realloc(buffer, size + 1);
+        if (grown_buffer == NULL) {
+            perror("Error collecting differences");
+            break;
+        }
+        buffer = grown_buffer;
+        ssize_t got = pread(fd, buffer, size, (off_t)ranges[r].start);
+        if (got <= 0) {
+            continue; // tasks.txt shrank since the tree was checked
+        }
+        buffer[got] = '\0';
+        for (char *line = buffer; line < buffer + got;) {
+            char *newline = strchr(line, '\n');
+            int id, status;
+            char description[MAX_DESCRIPTION_LEN];
+            bool parsed = sscanf(line, "%d,%d,%255[^\n]", &id, &status, description) == 3 && id > 0;
+            line = newline != NULL ? newline + 1 : buffer + got;
+            if (!parsed) {
+                continue;
+            }
+            uint64_t leaf = (uint64_t)id / MERKLE_LEAF_SPAN;
+            if (bsearch(&leaf, leaves, leaf_count, sizeof(uint64_t), compareLeaves) == NULL) {
+                continue; // Another leaf's record inside the range
+            }
+            if (*count == capacity) {
+                TaskRecord *grown = (TaskRecord *)arenaGrow(arena, records, capacity * sizeof(TaskRecord), (capacity ? capacity * 2 : 64) * sizeof(TaskRecord));
+                if (grown == NULL) {
+                    perror("Error collecting differences");
+                    break;
+                }
+                records = grown;
+                capacity = capacity ? capacity * 2 : 64;
+            }
+            records[*count].id = id;
+            records[*count].status = status;
+            records[*count].description = arenaStrdup(arena, description);
+            (*count)++;
+        }
+    }
+    free(buffer);
+    free(ranges);
+    close(fd);
+    if (*count > 1) {
+        qsort(records, *count, sizeof(TaskRecord), compareTaskRecords);
+    }
+    return records;
+}
+
+// Function to print one side of a difference
+void printTaskRecord(const char *marker, const char *color, const TaskRecord *record) {
+    printf("%s%s ID: %-4d [%s] %s%s\n", color, marker, record->id,
+           record->status == 1 ? "DONE" : "PENDING", record->description, ANSI_COLOR_RESET);
+}
+
+// Function to compare two task stores (the 'diff' command)
+// Walks both Merkle trees from the root and only descends into ranges whose hashes differ, so
+// stores that differ in k records are compared with O(k log n) hashes. Only the differing leaf
+// ranges are then read back to report individual records.
+// Returns the number of differing records, or -1 on error.
+int diffStores(const char *storeA, const char *storeB) {
+    StoreLocation locationA, locationB;
+    if (!openStoreLocation(storeA, &locationA)) {
+        return -1;
+    }
+    if (!openStoreLocation(storeB, &locationB)) {
+        close(locationA.dir_fd);
+        return -1;
+    }
+
+    MerkleTree treeA, treeB;
+    if (!openMerkleTree(&locationA, &treeA)) {
+        close(locationA.dir_fd);
+        close(locationB.dir_fd);
+        return -1;
+    }
+    if (!openMerkleTree(&locationB, &treeB)) {
+        closeMerkleTree(&treeA);
+        close(locationA.dir_fd);
+        close(locationB.dir_fd);
+        return -1;
+    }
+
+    // Depth-first walk over (first leaf, span) ranges with an explicit stack
+    uint64_t capacity = treeA.capacity > treeB.capacity ? treeA.capacity : treeB.capacity;
+    uint64_t stack[2 * 64][2];
+    size_t depth = 0;
+    stack[depth][0] = 0;
+    stack[depth][1] = capacity;
+    depth++;
+    uint64_t *leaves = NULL;
+    size_t leaf_count = 0, leaf_capacity = 0;
+    unsigned long hashes_compared = 0;
+    while (depth > 0) {
+        depth--;
+        uint64_t first = stack[depth][0], span = stack[depth][1];
+        hashes_compared++;
+        if (merkleRangeHash(&treeA, first, span) == merkleRangeHash(&treeB, first, span)) {
+            continue; // Identical range: skip the whole subtree
+        }
+        if (span == 1) { // Differing leaf
+            if (leaf_count == leaf_capacity) {
+                leaf_capacity = leaf_capacity ? leaf_capacity * 2 : 16;
+                leaves = (uint64_t *)realloc(leaves, leaf_capacity * sizeof(uint64_t));
+            }
+            leaves[leaf_count++] = first;
+            continue;
+        }
+        // Push the right half first so leaves come out in ascending order
+        stack[depth][0] = first + span / 2;
+        stack[depth][1] = span / 2;
+        depth++;
+        stack[depth][0] = first;
+        stack[depth][1] = span / 2;
+        depth++;
+    }
+    if (leaf_count == 0) {
+        closeMerkleTree(&treeA);
+        closeMerkleTree(&treeB);
+        close(locationA.dir_fd);
+        close(locationB.dir_fd);
+        printf("Stores are identical (compared %lu hash%s).\n", hashes_compared, hashes_compared == 1 ? "" : "es");
+        return 0;
+    }
+
+    // Merge the records of the differing ranges from both sides
+    size_t countA, countB;
+    TaskRecord *recordsA = collectTaskRecords(scratchArena(), &locationA, &treeA, leaves, leaf_count, &countA);
+    TaskRecord *recordsB = collectTaskRecords(scratchArena(), &locationB, &treeB, leaves, leaf_count, &countB);
+    closeMerkleTree(&treeA);
+    closeMerkleTree(&treeB);
+    close(locationA.dir_fd);
+    close(locationB.dir_fd);
+    int differences = 0;
+    size_t i = 0, j = 0;
+    while (i < countA || j < countB) {
+        if (j == countB || (i < countA && recordsA[i].id < recordsB[j].id)) {
+            printTaskRecord("-", ANSI_COLOR_RED, &recordsA[i++]); // Only in A
+            differences++;
+        } else if (i == countA || recordsB[j].id < recordsA[i].id) {
+            printTaskRecord("+", ANSI_COLOR_GREEN, &recordsB[j++]); // Only in B
+            differences++;
+        } else {
+            if (recordsA[i].status != recordsB[j].status ||
+                strcmp(recordsA[i].description, recordsB[j].description) != 0) {
+                printTaskRecord("-", ANSI_COLOR_RED, &recordsA[i]); // Changed between A and B
+                printTaskRecord("+", ANSI_COLOR_GREEN, &recordsB[j]);
+                differences++;
+            }
+            i++;
+            j++;
+        }
+    }
+    printf("%d difference%s found (compared %lu hashes).\n", differences, differences == 1 ? "" : "s", hashes_compared);
+
+    free(leaves);
+    return differences;
+}
+
+
+// In-memory copy of a follower store, kept by 'replicate' between batches
+typedef struct {
+    int dir_fd;            // The follower's directory; its files are opened relative to it
+    char position_key[32]; // Name of the follower's position file under the leader's followers/
+    TaskRecord *records; // Sorted by ID
+    size_t count, capacity;
+    DueEntry *due;       // Sorted by ID
+    size_t due_count, due_capacity;
+} FollowerStore;
+
+// Function to copy a file of the store into a follower through a temporary file and renameat()
+// A missing source is not an error. On a read or write error the follower's file is left as it was.
+bool copyStoreFile(const char *name, int dir_fd) {
+    FILE *in = openStoreStream(name, O_RDONLY, "r");
+    if (in == NULL) {
+        return errno == ENOENT;
+    }
+    char temp_name[64];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", name);
+    FILE *out = openDirectoryStream(dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (out == NULL) {
+        perror("Error creating follower file");
+        fclose(in);
+        return false;
+    }
+    char buffer[65536];
+    size_t length;
+    bool ok = true;
+    while (ok && (length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, length, out) == length;
+    }
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+    ok = ok && renameat(dir_fd, temp_name, dir_fd, name) == 0;
+    if (!ok) {
+        perror("Error writing follower file");
+        unlinkat(dir_fd, temp_name, 0);
+    }
+    return ok;
+}
+
+// Function to load the follower's tasks and due dates into memory
+void loadFollowerStore(FollowerStore *store) {
+    for (size_t i = 0; i < store->count; i++) free(store->records[i].description);
+    store->count = 0;
+
+    FILE *file = openDirectoryStream(store->dir_fd, TASK_FILENAME, O_RDONLY, "r");
+    if (file != NULL) {
+        char line[MAX_DESCRIPTION_LEN + 20];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            int id, status;
+            char description[MAX_DESCRIPTION_LEN];
+            if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) != 3) {
+                continue;
+            }
+            if (store->count == store->capacity) {
+                store->capacity = store->capacity ? store->capacity * 2 : 1024;
+                store->records = (TaskRecord *)realloc(store->records, store->capacity * sizeof(TaskRecord));
+            }
+            TaskRecord *record = &store->records[store->count++];
+            record->id = id;
+            record->status = status;
+            record->description = strdup(description);
+        }
+        fclose(file);
+    }
+    qsort(store->records, store->count, sizeof(TaskRecord), compareTaskRecords);
+
+    free(store->due);
+    store->due = loadDueEntries(store->dir_fd, &store->due_count);
+    store->due_capacity = store->due_count;
+    if (store->due_count > 1) {
+        qsort(store->due, store->due_count, sizeof(DueEntry), compareDueEntriesById);
+    }
+}
+
+// Function to find the position of an ID in the follower's records (or where it would be inserted)
+size_t findFollowerRecord(const FollowerStore *store, int id, bool *found) {
+    size_t low = 0, high = store->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (store->records[mid].id < id) low = mid + 1;
+        else high = mid;
+    }
+    *found = low < store->count && store->records[low].id == id;
+    return low;
+}
+
+// Function to set or clear (due == 0) a due date in the follower's in-memory copy
+void setFollowerDue(FollowerStore *store, int id, time_t due) {
+    size_t low = 0, high = store->due_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (store->due[mid].id < id) low = mid + 1;
+        else high = mid;
+    }
+    bool found = low < store->due_count && store->due[low].id == id;
+    if (due == 0) {
+        if (found) {
+            memmove(&store->due[low], &store->due[low + 1], (store->due_count - low - 1) * sizeof(DueEntry));
+            store->due_count--;
+        }
+        return;
+    }
+    if (!found) {
+        if (store->due_count == store->due_capacity) {
+            store->due_capacity = store->due_capacity ? store->due_capacity * 2 : 64;
+            store->due = (DueEntry *)realloc(store->due, store->due_capacity * sizeof(DueEntry));
+        }
+        memmove(&store->due[low + 1], &store->due[low], (store->due_count - low) * sizeof(DueEntry));
+        store->due_count++;
+    }
+    store->due[low].id = id;
+    store->due[low].due = due;
+}
+
+// Function to write the follower's tasks file
+// When a batch only appended new tasks, just those are appended; otherwise the file is rewritten
+// once for the whole batch through a temporary file.
+bool writeFollowerTasks(const FollowerStore *store, size_t append_from, bool rewrite) {
+    if (!rewrite && append_from == store->count) {
+        return true; // Nothing changed
+    }
+    const char *temp_name = "temp_tasks.txt";
+    FILE *file = rewrite ? openDirectoryStream(store->dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w")
+                         : openDirectoryStream(store->dir_fd, TASK_FILENAME, O_WRONLY | O_APPEND | O_CREAT, "a");
+    if (file == NULL) {
+        perror("Error writing follower tasks");
+        return false;
+    }
+    for (size_t i = rewrite ? 0 : append_from; i < store->count; i++) {
+        const TaskRecord *record = &store->records[i];
+        fprintf(file, "%d,%d,%s\n", record->id, record->status, record->description);
+    }
+    if (fclose(file) != 0 || (rewrite && renameat(store->dir_fd, temp_name, store->dir_fd, TASK_FILENAME) == -1)) {
+        perror("Error writing follower tasks");
+        if (rewrite) unlinkat(store->dir_fd, temp_name, 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to write the follower's due date file
+bool writeFollowerDue(const FollowerStore *store) {
+    const char *temp_name = "temp_due.txt";
+    FILE *file = openDirectoryStream(store->dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (file == NULL) {
+        perror("Error writing follower due dates");
+        return false;
+    }
+    for (size_t i = 0; i < store->due_count; i++) {
+        fprintf(file, "%d,%lld\n", store->due[i].id, (long long)store->due[i].due);
+    }
+    if (fclose(file) != 0 || renameat(store->dir_fd, temp_name, store->dir_fd, DUE_FILENAME) == -1) {
+        perror("Error writing follower due dates");
+        unlinkat(store->dir_fd, temp_name, 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to write "POSITION LOG_ID" to a file of a directory through a temporary file and renameat()
+bool writeLogPosition(int dir_fd, const char *name, long long offset, uint64_t log_id) {
+    char temp_name[64];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", name);
+    FILE *file = openDirectoryStream(dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "%lld %016" PRIx64 "\n", offset, log_id);
+    if (fclose(file) != 0 || renameat(dir_fd, temp_name, dir_fd, name) == -1) {
+        unlinkat(dir_fd, temp_name, 0);
+        return false;
+    }
+    return true;
+}
+
+// Function to record how far into the leader's operation log (identified by its ID) the follower
+// has applied, in the follower's replica.offset and in the leader's followers/ directory, which
+// tells log compaction what it may drop
+bool writeReplicaOffset(const FollowerStore *store, long long offset, uint64_t log_id) {
+    if (!writeLogPosition(store->dir_fd, REPLICA_OFFSET_FILENAME, offset, log_id)) {
+        perror("Error writing replica offset");
+        return false;
+    }
+    int followers_fd = -1;
+    if ((mkdirat(task_dir_fd, FOLLOWERS_DIRNAME, 0700) == -1 && errno != EEXIST) ||
+        (followers_fd = openat(task_dir_fd, FOLLOWERS_DIRNAME, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 ||
+        !writeLogPosition(followers_fd, store->position_key, offset, log_id)) {
+        perror("Error recording follower position");
+    }
+    if (followers_fd != -1) close(followers_fd);
+    return true;
+}
+
+// Function to apply a batch of complete operation log lines to the follower
+// Every operation is idempotent (adds of an existing ID overwrite it), so re-applying entries
+// after a crash or an overlapping bootstrap copy is harmless. Returns the number applied.
+int applyOperations(FollowerStore *store, char *batch, size_t length) {
+    size_t append_from = store->count;
+    bool rewrite = false, due_changed = false;
+    int applied = 0;
+
+    char *line = batch;
+    while (line < batch + length) {
+        char *end = (char *)memchr(line, '\n', batch + length - line);
+        *end = '\0';
+        char op;
+        long long when;
+        int id, consumed = 0;
+        if (sscanf(line, "%c,%lld,%d%n", &op, &when, &id, &consumed) == 3) {
+            const char *argument = line[consumed] == ',' ? line + consumed + 1 : "";
+            bool found;
+            size_t index = findFollowerRecord(store, id, &found);
+            if (op == 'A') {
+                if (found) { // Already present (e.g. from the bootstrap copy): overwrite
+                    free(store->records[index].description);
+                    rewrite = true;
+                } else {
+                    if (store->count == store->capacity) {
+                        store->capacity = store->capacity ? store->capacity * 2 : 1024;
+                        store->records = (TaskRecord *)realloc(store->records, store->capacity * sizeof(TaskRecord));
+                    }
+                    memmove(&store->records[index + 1], &store->records[index], (store->count - index) * sizeof(TaskRecord));
+                    store->count++;
+                    if (index < append_from) { // Not an append at the end: needs a rewrite
+                        append_from++;
+                        rewrite = true;
+                    }
+                }
+                store->records[index].id = id;
+                store->records[index].status = 0;
+                store->records[index].description = strdup(argument);
+            } else if (op == 'S' && found) {
+                store->records[index].status = atoi(argument);
+                rewrite = true;
+            } else if (op == 'D') {
+                if (found) {
+                    free(store->records[index].description);
+                    memmove(&store->records[index], &store->records[index + 1], (store->count - index - 1) * sizeof(TaskRecord));
+                    store->count--;
+                    if (index < append_from) append_from--;
+                    rewrite = true;
+                }
+                setFollowerDue(store, id, 0);
+                due_changed = true;
+            } else if (op == 'U') {
+                setFollowerDue(store, id, (time_t)atoll(argument));
+                due_changed = true;
+            }
+            applied++;
+        }
+        line = end + 1;
+    }
+
+    writeFollowerTasks(store, append_from, rewrite);
+    if (due_changed) {
+        writeFollowerDue(store);
+    }
+    return applied;
+}
+
+// Function to ship the operation log to a follower store (the 'replicate' command)
+// The follower is bootstrapped with a copy of the leader's files, then kept current by tailing
+// oplog.txt: each wakeup applies every complete entry written since the last one as a single
+// batch, so the follower costs one write per batch rather than one per operation.
+void replicateTasks(const char *follower_dir, bool once) {
+    if (mkdir(follower_dir, 0700) == -1 && errno != EEXIST) {
+        perror("Error creating follower directory");
+        return;
+    }
+
+    FollowerStore store;
+    memset(&store, 0, sizeof(store));
+    store.dir_fd = open(follower_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (store.dir_fd == -1) {
+        perror("Error opening follower directory");
+        return;
+    }
+    followerKey(follower_dir, store.position_key, sizeof(store.position_key));
+
+    int inotify_fd = -1;
+    if (!once) { // Watch before reading so no append can slip in between
+        inotify_fd = inotify_init1(IN_CLOEXEC);
+        // IN_MOVED_TO: a compaction replaces the log through rename()
+        if (inotify_fd == -1 || inotify_add_watch(inotify_fd, task_dir_path, IN_MODIFY | IN_CREATE | IN_MOVED_TO) == -1) {
+            perror("Error watching task directory");
+            if (inotify_fd != -1) close(inotify_fd);
+            close(store.dir_fd);
+            return;
+        }
+    }
+
+    long long offset = -1;
+    uint64_t log_id = 0;
+    FILE *offset_file = openDirectoryStream(store.dir_fd, REPLICA_OFFSET_FILENAME, O_RDONLY, "r");
+    if (offset_file != NULL) {
+        if (fscanf(offset_file, "%lld %" SCNx64, &offset, &log_id) != 2) offset = -1;
+        fclose(offset_file);
+    }
+
+    if (!once) {
+        printf("Replicating to %s. Press Ctrl+C to stop.\n", follower_dir);
+    }
+    char *batch = NULL;
+    size_t batch_capacity = 0;
+    bool loaded = false;
+    for (;;) {
+        // Keep the log open for the whole pass: a compaction renames a new file over it, but this
+        // one stays readable and its header matches what is read from it
+        struct stat st;
+        OplogHeader header = {0, 0, 0};
+        int log_fd = openStoreFile(OPLOG_FILENAME, O_RDONLY);
+        if (log_fd != -1 && fstat(log_fd, &st) == 0) {
+            readOplogHeader(log_fd, &header);
+        } else {
+            st.st_size = 0;
+        }
+        long long log_end = oplogEnd(&header, &st);
+        if (log_id == 0 && header.id != 0 && header.base == 0 && offset >= 0) {
+            log_id = header.id; // The first entry created the log this follower was copied before
+        }
+        if (offset < 0 || log_id != header.id || offset < header.base || offset > log_end) {
+            // New follower, a log that was replaced, or entries this follower still needed were
+            // compacted away: bootstrap from a full copy. Taking the log end first means anything
+            // logged during the copy is re-applied, which is idempotent.
+            offset = log_end;
+            log_id = header.id;
+            if (!copyStoreFile(TASK_FILENAME, store.dir_fd) ||
+                !copyStoreFile(DUE_FILENAME, store.dir_fd) ||
+                !writeReplicaOffset(&store, offset, log_id)) {
+                if (log_fd != -1) close(log_fd);
+                break;
+            }
+            printf("Follower %s bootstrapped from a full copy.\n", follower_dir);
+            loaded = false;
+        }
+        if (!loaded) {
+            loadFollowerStore(&store);
+            loaded = true;
+        }
+
+        if (log_end > offset) { // Read everything new in one go and apply it as one batch
+            size_t length = (size_t)(log_end - offset);
+            if (length > batch_capacity) {
+                batch_capacity = length;
+                batch = (char *)realloc(batch, batch_capacity);
+            }
+            ssize_t got = pread(log_fd, batch, length, (off_t)header.length + (off_t)(offset - header.base));
+            if (got > 0) {
+                // Only apply complete lines; a partial trailing line is picked up next time
+                char *last_newline = (char *)memrchr(batch, '\n', (size_t)got);
+                if (last_newline != NULL) {
+                    size_t complete = (size_t)(last_newline - batch) + 1;
+                    int applied = applyOperations(&store, batch, complete);
+                    offset += (long long)complete;
+                    writeReplicaOffset(&store, offset, log_id);
+                    if (once) printf("Replicated %d operation%s to %s.\n", applied, applied == 1 ? "" : "s", follower_dir);
+                }
+            }
+        }
+        if (log_fd != -1) close(log_fd);
+        fflush(stdout);
+
+        if (once) {
+            break;
+        }
+        // Sleep until the leader's log changes
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            perror("Error waiting for operations");
+            break;
+        }
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        if (read(inotify_fd, events, sizeof(events)) == -1 && errno != EINTR) {
+            perror("Error reading inotify events");
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < store.count; i++) free(store.records[i].description);
+    free(store.records);
+    free(store.due);
+    free(batch);
+    if (inotify_fd != -1) close(inotify_fd);
+    close(store.dir_fd);
+}
+
+
+// Work-stealing executor shared by parallel scans, index builds, merges and restores
+// Every thread that spawns work owns a deque (Chase-Lev, fixed ring): it pushes and pops at the
+// bottom without locking, while idle threads steal the oldest item from the top of someone
+// else's deque. There is no central queue, so busy threads only touch their own deque. The pool
+// has one worker per core but the calling thread, which runs work itself while it waits.
+#define EXECUTOR_MAX_DEQUES 320 // Pool workers plus every thread that spawns (daemon workers too)
+#define EXECUTOR_DEQUE_SIZE 4096 // Items per deque (a power of two); spawning past it runs inline
+
+// Join counter of a fork-join group
+typedef struct {
+    size_t pending;
+} WorkGroup;
+
+// A spawned piece of work: run(arg, begin, end), then count it off its group
+typedef struct {
+    void (*run)(void *arg, size_t begin, size_t end);
+    void *arg;
+    size_t begin, end;
+    WorkGroup *group;
+} WorkItem;
+
+typedef struct {
+    size_t top;               // Next item to steal (advanced by thieves with a CAS)
+    char padding[56];         // Keep thieves off the owner's cache line
+    size_t bottom;            // Next free slot (only the owner writes it)
+    WorkItem items[EXECUTOR_DEQUE_SIZE];
+} WorkDeque;
+
+struct {
+    pthread_once_t started;
+    int worker_count;
+    WorkDeque *deques[EXECUTOR_MAX_DEQUES];
+    int deque_count;
+    int sleepers;             // Pool workers blocked on 'wake'
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+} executor = {PTHREAD_ONCE_INIT, 0, {NULL}, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+__thread int executor_deque = -1;
+__thread uint64_t executor_seed = 0;
+
+// Function to give the calling thread a deque of its own
+// Returns -1 if every slot is taken; the thread then runs what it spawns inline.
+int executorDeque() {
+    if (executor_deque == -1) {
+        int index = __atomic_fetch_add(&executor.deque_count, 1, __ATOMIC_ACQ_REL);
+        if (index >= EXECUTOR_MAX_DEQUES) {
+            return -1; // deque_count stays above the limit; thieves clamp it
+        }
+        __atomic_store_n(&executor.deques[index], (WorkDeque *)calloc(1, sizeof(WorkDeque)), __ATOMIC_RELEASE);
+        executor_deque = index;
+        executor_seed = mix64((uint64_t)index + 1);
+    }
+    return executor_deque;
+}
+
+// Function to push an item on the calling thread's deque (false if it is full)
+bool dequePush(WorkDeque *deque, const WorkItem *item) {
+    size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= EXECUTOR_DEQUE_SIZE) {
+        return false;
+    }
+    deque->items[bottom & (EXECUTOR_DEQUE_SIZE - 1)] = *item;
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Function to pop the newest item of the calling thread's deque
+bool dequePop(WorkDeque *deque, WorkItem *item) {
+    size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    size_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if ((ptrdiff_t)(bottom - top) < 0) { // Empty
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *item = deque->items[bottom & (EXECUTOR_DEQUE_SIZE - 1)];
+    if (bottom != top) {
+        return true;
+    }
+    // Last item: race the thieves for it
+    bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+// Function to steal the oldest item of another thread's deque
+bool dequeSteal(WorkDeque *deque, WorkItem *item) {
+    size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if ((ptrdiff_t)(bottom - top) <= 0) {
+        return false;
+    }
+    // The slot cannot be reused before top moves past it, so this copy is only kept if the CAS wins
+    *item = deque->items[top & (EXECUTOR_DEQUE_SIZE - 1)];
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// Function to run an item and count it off its group
+void executorRun(const WorkItem *item) {
+    item->run(item->arg, item->begin, item->end);
+    __atomic_sub_fetch(&item->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+// Function to find work for a thread: its own newest item first, then the oldest of a victim
+// Victims are scanned from a random starting point so thieves spread out.
+bool executorFindWork(int self, WorkItem *item) {
+    if (self != -1 && dequePop(executor.deques[self], item)) {
+        return true;
+    }
+    int count = __atomic_load_n(&executor.deque_count, __ATOMIC_ACQUIRE);
+    if (count > EXECUTOR_MAX_DEQUES) count = EXECUTOR_MAX_DEQUES;
+    if (count == 0) {
+        return false;
+    }
+    executor_seed ^= executor_seed << 13, executor_seed ^= executor_seed >> 7, executor_seed ^= executor_seed << 17;
+    int start = (int)(executor_seed % (uint64_t)count);
+    for (int i = 0; i < count; i++) {
+        int victim = (start + i) % count;
+        WorkDeque *deque = __atomic_load_n(&executor.deques[victim], __ATOMIC_ACQUIRE);
+        if (victim != self && deque != NULL && dequeSteal(deque, item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to tell whether any deque has work (checked by workers before they sleep)
+bool executorHasWork() {
+    int count = __atomic_load_n(&executor.deque_count, __ATOMIC_SEQ_CST);
+    if (count > EXECUTOR_MAX_DEQUES) count = EXECUTOR_MAX_DEQUES;
+    for (int i = 0; i < count; i++) {
+        WorkDeque *deque = __atomic_load_n(&executor.deques[i], __ATOMIC_ACQUIRE);
+        if (deque != NULL && (ptrdiff_t)(__atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST) -
+                                         __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST)) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function run by each pool worker: steal and run work, spinning briefly before sleeping
+void *executorWorker(void *arg) {
+    (void)arg;
+    int self = executorDeque();
+    WorkItem item;
+    int idle = 0;
+    for (;;) {
+        if (executorFindWork(self, &item)) {
+            executorRun(&item);
+            idle = 0;
+        } else if (++idle < 64) {
+            sched_yield();
+        } else {
+            // Announce the sleep before the last look, so a spawner either sees the sleeper
+            // (and signals) or this look sees its item
+            pthread_mutex_lock(&executor.sleep_lock);
+            __atomic_add_fetch(&executor.sleepers, 1, __ATOMIC_SEQ_CST);
+            if (!executorHasWork()) {
+                pthread_cond_wait(&executor.wake, &executor.sleep_lock);
+            }
+            __atomic_sub_fetch(&executor.sleepers, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&executor.sleep_lock);
+            idle = 0;
+        }
+    }
+    return NULL;
+}
+
+// Function to start the pool (once): one worker per core besides the calling thread
+void executorStart() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 1 ? (int)cpus - 1 : 0;
+    if (workers > 63) workers = 63;
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attributes, executorWorker, NULL) == 0) {
+            executor.worker_count++;
+        }
+        pthread_attr_destroy(&attributes);
+    }
+}
+
+// Function to spawn run(arg, begin, end) as part of a group
+// The item goes on the calling thread's deque where an idle thread can steal it; it runs inline
+// when the deque is full or the thread has none.
+void executorSpawn(WorkGroup *group, void (*run)(void *, size_t, size_t), void *arg, size_t begin, size_t end) {
+    WorkItem item = {run, arg, begin, end, group};
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    int self = executorDeque();
+    if (self == -1 || !dequePush(executor.deques[self], &item)) {
+        executorRun(&item);
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&executor.sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&executor.sleep_lock);
+        pthread_cond_signal(&executor.wake);
+        pthread_mutex_unlock(&executor.sleep_lock);
+    }
+}
+
+// Function to wait for every item of a group, running pending work (own or stolen) meanwhile
+void executorWait(WorkGroup *group) {
+    int self = executorDeque();
+    WorkItem item;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (executorFindWork(self, &item)) {
+            executorRun(&item);
+        } else {
+            sched_yield(); // The rest is running on other threads
+        }
+    }
+}
+
+// A parallel loop being split up by parallelFor()
+typedef struct {
+    void (*body)(void *arg, size_t begin, size_t end);
+    void *arg;
+    size_t grain;
+} ParallelLoop;
+
+// Function to run a range of a parallel loop: split off halves for thieves, run the rest here
+void parallelForRange(void *arg, size_t begin, size_t end) {
+    ParallelLoop *loop = (ParallelLoop *)arg;
+    WorkGroup group = {0};
+    while (end - begin > loop->grain) {
+        size_t middle = begin + (end - begin) / 2;
+        executorSpawn(&group, parallelForRange, loop, middle, end);
+        end = middle;
+    }
+    loop->body(loop->arg, begin, end);
+    executorWait(&group);
+}
+
+// Function to run body(arg, begin, end) over [0, count) in ranges of at most 'grain' items
+// Ranges run on the executor's threads and the call returns when all of them are done. Small
+// loops (or a single core) run on the calling thread alone.
+void parallelFor(size_t count, size_t grain, void (*body)(void *, size_t, size_t), void *arg) {
+    if (grain == 0) grain = 1;
+    pthread_once(&executor.started, executorStart);
+    if (count <= grain || executor.worker_count == 0) {
+        if (count > 0) body(arg, 0, count);
+        return;
+    }
+    ParallelLoop loop = {body, arg, grain};
+    parallelForRange(&loop, 0, count);
+}
+
+// Creation time of a task, from the operation log
+typedef struct {
+    time_t created;
+    int id;
+} CreationEntry;
+
+// Function to order creation entries by task ID, then time
+int compareCreationEntries(const void *a, const void *b) {
+    const CreationEntry *x = (const CreationEntry *)a, *y = (const CreationEntry *)b;
+    if (x->id != y->id) return x->id < y->id ? -1 : 1;
+    return (x->created > y->created) - (x->created < y->created);
+}
+
+// Function to load when each task was added, from created.txt and the operation log's 'A' entries
+// created.txt holds the times of the entries log compaction dropped. Returns entries sorted by
+// ID, one per ID (the latest, for IDs that were reused). Tasks added before the log existed have
+// none.
+CreationEntry *loadCreationEntries(size_t *count) {
+    size_t capacity = 1024;
+    CreationEntry *entries = (CreationEntry *)malloc(capacity * sizeof(CreationEntry));
+    *count = 0;
+    FILE *files[2] = {openStoreStream(CREATED_FILENAME, O_RDONLY, "r"), openStoreStream(OPLOG_FILENAME, O_RDONLY, "r")};
+    for (int f = 0; f < 2; f++) {
+        FILE *file = files[f];
+        if (file == NULL) {
+            continue;
+        }
+        char line[MAX_DESCRIPTION_LEN + 64];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            long long when;
+            int id;
+            if (f == 0 ? sscanf(line, "%d,%lld", &id, &when) == 2 : line[0] == 'A' && sscanf(line, "A,%lld,%d", &when, &id) == 2) {
+                if (*count == capacity) {
+                    capacity *= 2;
+                    entries = (CreationEntry *)realloc(entries, capacity * sizeof(CreationEntry));
+                }
+                entries[*count].created = (time_t)when;
+                entries[(*count)++].id = id;
+            }
+            if (strchr(line, '\n') == NULL) { // Skip the rest of an overlong line
+                int c;
+                while ((c = fgetc(file)) != EOF && c != '\n') {}
+            }
+        }
+        fclose(file);
+    }
+    qsort(entries, *count, sizeof(CreationEntry), compareCreationEntries);
+    size_t kept = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (i + 1 < *count && entries[i + 1].id == entries[i].id) continue; // A later one follows
+        entries[kept++] = entries[i];
+    }
+    *count = kept;
+    return entries;
+}
+
+// Function to find when a task was added (-1 if unknown)
+time_t findCreationTime(const CreationEntry *entries, size_t count, int id) {
+    CreationEntry key = {0, id};
+    size_t low = 0, high = count;
+    while (low < high) { // Lower bound by ID alone
+        size_t mid = low + (high - low) / 2;
+        if (entries[mid].id < key.id) low = mid + 1;
+        else high = mid;
+    }
+    return low < count && entries[low].id == id ? entries[low].created : -1;
+}
+
+// A 64-bit key with the position of what it belongs to, sorted by radixSort()
+typedef struct {
+    uint64_t key;
+    uint32_t index;
+} RadixItem;
+
+#define RADIX_SORT_MIN 65536  // Below this a comparison sort is faster
+#define RADIX_CHUNK 16384     // Items per parallel histogram/scatter range
+
+// One 8-bit pass of radixSort(), split into chunks that are counted and scattered in parallel
+typedef struct {
+    const RadixItem *from;
+    RadixItem *to;
+    size_t count;
+    unsigned shift;
+    size_t *offsets;          // [chunk][256]: counts, then where each chunk writes each digit
+} RadixPass;
+
+// Function to count the digits of some chunks (a parallelFor body)
+void radixCount(void *arg, size_t begin, size_t end) {
+    RadixPass *pass = (RadixPass *)arg;
+    for (size_t chunk = begin; chunk < end; chunk++) {
+        size_t *counts = pass->offsets + chunk * 256;
+        size_t last = (chunk + 1) * RADIX_CHUNK < pass->count ? (chunk + 1) * RADIX_CHUNK : pass->count;
+        memset(counts, 0, 256 * sizeof(size_t));
+        for (size_t i = chunk * RADIX_CHUNK; i < last; i++) {
+            counts[(pass->from[i].key >> pass->shift) & 0xff]++;
+        }
+    }
+}
+
+// Function to move the items of some chunks to their place for this digit (a parallelFor body)
+void radixScatter(void *arg, size_t begin, size_t end) {
+    RadixPass *pass = (RadixPass *)arg;
+    for (size_t chunk = begin; chunk < end; chunk++) {
+        size_t *offsets = pass->offsets + chunk * 256;
+        size_t last = (chunk + 1) * RADIX_CHUNK < pass->count ? (chunk + 1) * RADIX_CHUNK : pass->count;
+        for (size_t i = chunk * RADIX_CHUNK; i < last; i++) {
+            pass->to[offsets[(pass->from[i].key >> pass->shift) & 0xff]++] = pass->from[i];
+        }
+    }
+}
+
+// Function to sort items by key, keeping the order of equal keys (LSD radix sort)
+// Each byte is one pass whose counting and scattering run on the executor; bytes that are the
+// same in every key (like the high bytes of timestamps) are skipped.
+void radixSort(RadixItem *items, size_t count) {
+    size_t chunks = (count + RADIX_CHUNK - 1) / RADIX_CHUNK;
+    RadixItem *buffer = (RadixItem *)malloc((count + 1) * sizeof(RadixItem));
+    RadixPass pass = {items, buffer, count, 0, (size_t *)malloc((chunks + 1) * 256 * sizeof(size_t))};
+    for (pass.shift = 0; pass.shift < 64; pass.shift += 8) {
+        parallelFor(chunks, 1, radixCount, &pass);
+        size_t total = 0;
+        bool trivial = false;
+        for (size_t digit = 0; digit < 256 && !trivial; digit++) {
+            size_t digit_total = 0;
+            for (size_t chunk = 0; chunk < chunks; chunk++) {
+                size_t counted = pass.offsets[chunk * 256 + digit];
+                pass.offsets[chunk * 256 + digit] = total + digit_total;
+                digit_total += counted;
+            }
+            trivial = digit_total == count;
+            total += digit_total;
+        }
+        if (trivial) {
+            continue; // Every key has the same byte here
+        }
+        parallelFor(chunks, 1, radixScatter, &pass);
+        RadixItem *swap = (RadixItem *)pass.from;
+        pass.from = pass.to;
+        pass.to = swap;
+    }
+    if (pass.from != items) {
+        memcpy(items, pass.from, count * sizeof(RadixItem));
+    }
+    free(pass.from == items ? pass.to : (RadixItem *)pass.from);
+    free(pass.offsets);
+}
+
+// One row of a sorted listing
+typedef struct {
+    uint64_t key;        // Numeric sort key (all but SORT_DESCRIPTION)
+    int id;
+    bool done;
+    time_t due;          // 0 if none
+    const char *description;
+} SortedRow;
+
+// Rows collected for a sorted listing
+// With a limit only the best 'limit' rows are kept, in a heap whose root is the worst of them,
+// so a listing costs O(n log K) time and O(K) memory however large the store is.
+typedef struct {
+    ListSort sort;
+    size_t limit;
+    bool copy;           // Descriptions are copied (the caller's buffer is reused)
+    SortedRow *rows;
+    size_t count, capacity;
+} SortedListing;
+
+// Function to compute the numeric sort key of a row
+uint64_t sortedRowKey(ListSort sort, bool done, time_t due, time_t created) {
+    switch (sort) {
+    case SORT_CREATED: return created < 0 ? UINT64_MAX : (uint64_t)created;
+    case SORT_DUE: return due <= 0 ? UINT64_MAX : (uint64_t)due;
+    case SORT_PRIORITY: return ((uint64_t)done << 63) | (due <= 0 ? (1ULL << 62) : (uint64_t)due);
+    default: return 0;
+    }
+}
+
+// Function to compare two rows in listing order (ties by ID)
+int compareSortedRows(const SortedRow *x, const SortedRow *y, ListSort sort) {
+    if (sort == SORT_DESCRIPTION) {
+        int result = strcasecmp(x->description, y->description);
+        if (result != 0) return result;
+    } else if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+// qsort_r adapter for compareSortedRows()
+int compareSortedRowsWith(const void *a, const void *b, void *sort) {
+    return compareSortedRows((const SortedRow *)a, (const SortedRow *)b, *(const ListSort *)sort);
+}
+
+// Function to restore the heap property downwards (the worst row at the root)
+void siftSortedRows(SortedListing *listing, size_t index) {
+    for (;;) {
+        size_t worst = index, left = 2 * index + 1, right = left + 1;
+        if (left < listing->count && compareSortedRows(&listing->rows[left], &listing->rows[worst], listing->sort) > 0) worst = left;
+        if (right < listing->count && compareSortedRows(&listing->rows[right], &listing->rows[worst], listing->sort) > 0) worst = right;
+        if (worst == index) return;
+        SortedRow swap = listing->rows[index];
+        listing->rows[index] = listing->rows[worst];
+        listing->rows[worst] = swap;
+        index = worst;
+    }
+}
+
+// Function to tell whether a listing in file order already has all the rows it needs
+bool sortedListingFull(const SortedListing *listing) {
+    return listing->sort == SORT_NONE && listing->limit > 0 && listing->count == listing->limit;
+}
+
+// Function to offer a row to a sorted listing
+void sortedListingAdd(SortedListing *listing, const SortedRow *row) {
+    if (listing->limit > 0 && listing->count == listing->limit) {
+        if (listing->sort == SORT_NONE || compareSortedRows(row, &listing->rows[0], listing->sort) >= 0) {
+            return; // Not among the best K
+        }
+        if (listing->copy) free((char *)listing->rows[0].description);
+        listing->rows[0] = *row;
+        if (listing->copy) listing->rows[0].description = strdup(row->description);
+        siftSortedRows(listing, 0);
+        return;
+    }
+    if (listing->count == listing->capacity) {
+        listing->capacity = listing->capacity ? listing->capacity * 2 : 256;
+        listing->rows = (SortedRow *)realloc(listing->rows, listing->capacity * sizeof(SortedRow));
+    }
+    listing->rows[listing->count] = *row;
+    if (listing->copy) listing->rows[listing->count].description = strdup(row->description);
+    listing->count++;
+    if (listing->sort != SORT_NONE && listing->limit > 0 && listing->count == listing->limit) {
+        for (size_t i = listing->count / 2; i-- > 0;) siftSortedRows(listing, i);
+    }
+}
+
+// Function to put the collected rows of a listing in order
+// Large unlimited listings on a numeric key are radix sorted; the rest use a comparison sort.
+void sortedListingFinish(SortedListing *listing) {
+    if (listing->sort == SORT_NONE) {
+        return;
+    }
+    if (listing->limit > 0 || listing->sort == SORT_DESCRIPTION || listing->count < RADIX_SORT_MIN) {
+        qsort_r(listing->rows, listing->count, sizeof(SortedRow), compareSortedRowsWith, &listing->sort);
+        return;
+    }
+    // Rows arrive in ID order (or file order, normally the same), which the stable sort keeps for ties
+    RadixItem *items = (RadixItem *)malloc(listing->count * sizeof(RadixItem));
+    for (size_t i = 0; i < listing->count; i++) {
+        items[i].key = listing->rows[i].key;
+        items[i].index = (uint32_t)i;
+    }
+    radixSort(items, listing->count);
+    SortedRow *rows = (SortedRow *)malloc(listing->capacity * sizeof(SortedRow));
+    for (size_t i = 0; i < listing->count; i++) {
+        rows[i] = listing->rows[items[i].index];
+    }
+    free(items);
+    free(listing->rows);
+    listing->rows = rows;
+}
+
+// Function to print a finished sorted listing like 'list' and free it
+void printSortedListing(FILE *out, SortedListing *listing) {
+    fprintf(out, "\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    for (size_t i = 0; i < listing->count; i++) {
+        const SortedRow *row = &listing->rows[i];
+        DueEntry due = {row->due, row->id};
+        printTaskRow(out, row->id, row->done, row->description, row->due > 0 ? &due : NULL);
+        if (listing->copy) free((char *)row->description);
+    }
+    if (listing->count == 0) {
+        fprintf(out, "No tasks found.\n");
+    }
+    fprintf(out, "%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    free(listing->rows);
+}
+
+// Memory a sorted listing may hold before spilling sorted runs to disk (TASAKMAN_SORT_MEMORY, MiB)
+size_t sort_memory_budget = (size_t)256 << 20;
+
+// Header of one row in a spilled run (followed by the description)
+typedef struct {
+    uint64_t key;
+    int64_t due;
+    int32_t id;
+    uint16_t length;
+    uint8_t done;
+} SpilledRow;
+
+// A sorted run being read back for the merge
+typedef struct {
+    FILE *file;
+    SortedRow head;      // Current row (valid unless exhausted)
+    bool exhausted;
+    char description[MAX_DESCRIPTION_LEN];
+} SortedRun;
+
+// Function to read the next row of a run into its head
+void advanceSortedRun(SortedRun *run) {
+    SpilledRow spilled;
+    if (fread(&spilled, sizeof(spilled), 1, run->file) != 1 || spilled.length >= sizeof(run->description) ||
+        fread(run->description, 1, spilled.length, run->file) != spilled.length) {
+        run->exhausted = true;
+        return;
+    }
+    run->description[spilled.length] = '\0';
+    run->head.key = spilled.key;
+    run->head.id = spilled.id;
+    run->head.done = spilled.done != 0;
+    run->head.due = (time_t)spilled.due;
+    run->head.description = run->description;
+}
+
+#define SORT_MAX_RUNS 64 // Runs merged at once; more are first merged into one
+
+// Function to create the file of a new sorted run in the task directory
+// The file is unlinked right away: it lives as long as it is open.
+FILE *createSortedRun() {
+    static size_t created = 0;
+    char name[48];
+    snprintf(name, sizeof(name), "temp_sort_%d_%zu", (int)getpid(), created++);
+    FILE *file = openStoreStream(name, O_RDWR | O_CREAT | O_TRUNC, "w+");
+    if (file == NULL) {
+        perror("Error creating sort run");
+        return NULL;
+    }
+    unlinkat(task_dir_fd, name, 0);
+    setvbuf(file, NULL, _IOFBF, 1 << 16);
+    return file;
+}
+
+// Function to append a row to a sorted run
+bool writeSpilledRow(FILE *file, const SortedRow *row) {
+    SpilledRow spilled = {row->key, (int64_t)row->due, row->id, (uint16_t)strlen(row->description), row->done};
+    return fwrite(&spilled, sizeof(spilled), 1, file) == 1 && fwrite(row->description, 1, spilled.length, file) == spilled.length;
+}
+
+// Function to finish writing a run and rewind it for the merge
+bool finishSortedRun(FILE *file, bool ok) {
+    if (!ok || fflush(file) != 0) {
+        perror("Error writing sort run");
+        fclose(file);
+        return false;
+    }
+    rewind(file);
+    return true;
+}
+
+// Function to sort the rows collected so far and write them out as one run, then drop them
+bool spillSortedRun(SortedListing *listing, FILE **runs, size_t *run_count) {
+    FILE *file = createSortedRun();
+    if (file == NULL) {
+        return false;
+    }
+    qsort_r(listing->rows, listing->count, sizeof(SortedRow), compareSortedRowsWith, &listing->sort);
+    bool ok = true;
+    for (size_t i = 0; i < listing->count; i++) {
+        ok = ok && writeSpilledRow(file, &listing->rows[i]);
+        free((char *)listing->rows[i].description);
+    }
+    free(listing->rows); // The next run starts small again
+    listing->rows = NULL;
+    listing->count = listing->capacity = 0;
+    if (!finishSortedRun(file, ok)) {
+        return false;
+    }
+    runs[(*run_count)++] = file;
+    return true;
+}
+
+// Function to tell whether run a's head comes before run b's in a loser tree
+// Index 'count' stands for a virtual run that beats every other (used to build the tree), and
+// exhausted runs lose to everything.
+bool sortedRunBeats(const SortedRun *runs, size_t count, size_t a, size_t b, ListSort sort) {
+    if (a == count || b == count) return a == count;
+    if (runs[a].exhausted || runs[b].exhausted) return !runs[a].exhausted;
+    return compareSortedRows(&runs[a].head, &runs[b].head, sort) < 0;
+}
+
+// Function to replay a loser tree from one run up to the root after its head changed
+// losers[1..count) hold the loser of each match; losers[0] is the overall winner.
+void replayLoserTree(const SortedRun *runs, size_t count, size_t *losers, size_t run, ListSort sort) {
+    size_t winner = run;
+    for (size_t node = (run + count) / 2; node > 0; node /= 2) {
+        if (sortedRunBeats(runs, count, losers[node], winner, sort)) {
+            size_t swap = losers[node];
+            losers[node] = winner;
+            winner = swap;
+        }
+    }
+    losers[0] = winner;
+}
+
+// Function to merge sorted runs and close them
+// The merged rows are printed as a listing to 'out', or written as one run to 'run' (then 'out'
+// is NULL). A loser tree picks the next row with about log2(runs) comparisons, one per level.
+// Returns false if the run could not be written.
+bool mergeSortedRuns(FILE *out, FILE *run_file, FILE **files, size_t count, ListSort sort) {
+    SortedRun *runs = (SortedRun *)calloc(count, sizeof(SortedRun));
+    size_t *losers = (size_t *)malloc((count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        runs[i].file = files[i];
+        advanceSortedRun(&runs[i]);
+        losers[i] = count; // Virtual winner, replaced while the tree is built
+    }
+    for (size_t i = count; i-- > 0;) {
+        replayLoserTree(runs, count, losers, i, sort);
+    }
+
+    if (out != NULL) {
+        fprintf(out, "\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    }
+    size_t merged = 0;
+    bool ok = true;
+    while (!runs[losers[0]].exhausted) {
+        SortedRun *run = &runs[losers[0]];
+        if (out != NULL) {
+            DueEntry due = {run->head.due, run->head.id};
+            printTaskRow(out, run->head.id, run->head.done, run->head.description, run->head.due > 0 ? &due : NULL);
+        } else {
+            ok = ok && writeSpilledRow(run_file, &run->head);
+        }
+        merged++;
+        advanceSortedRun(run);
+        replayLoserTree(runs, count, losers, losers[0], sort);
+    }
+    if (out != NULL) {
+        if (merged == 0) {
+            fprintf(out, "No tasks found.\n");
+        }
+        fprintf(out, "%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    }
+    for (size_t i = 0; i < count; i++) fclose(files[i]);
+    free(losers);
+    free(runs);
+    return out != NULL || finishSortedRun(run_file, ok);
+}
+
+// Function to list tasks from tasks.txt sorted and/or limited ('list --sort-by/--limit')
+// Rows stream through the listing, so only the kept ones are held in memory. A full sort that
+// outgrows sort_memory_budget becomes an external sort: each budget's worth of rows is sorted
+// and spilled as a run into the task directory, and the runs are merged while printing.
+void listTasksSorted(FILE *out, const ListOptions *options) {
+    FILE *file = openStoreStream(TASK_FILENAME, O_RDONLY, "r");
+    if (file == NULL) {
+        fprintf(out, "No tasks found. Create one using 'add' command.\n");
+        return;
+    }
+    size_t due_count, creation_count = 0;
+    DueEntry *due_entries = loadDueEntries(task_dir_fd, &due_count);
+    if (due_count > 1) {
+        qsort(due_entries, due_count, sizeof(DueEntry), compareDueEntriesById);
+    }
+    CreationEntry *creations = options->sort == SORT_CREATED ? loadCreationEntries(&creation_count) : NULL;
+
+    SortedListing listing = {options->sort, options->limit, true, NULL, 0, 0};
+    bool spill = options->sort != SORT_NONE && options->limit == 0, failed = false;
+    size_t held = 0, run_count = 0; // Bytes of descriptions held (approximately)
+    FILE *runs[SORT_MAX_RUNS + 1];
+    char line[MAX_DESCRIPTION_LEN + 20];
+    while (!sortedListingFull(&listing) && !failed && fgets(line, sizeof(line), file) != NULL) {
+        int id, status;
+        char description[MAX_DESCRIPTION_LEN];
+        if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) != 3 || id < options->low || id > options->high) {
+            continue;
+        }
+        DueEntry key = {0, id};
+        DueEntry *due = due_count > 0 ? (DueEntry *)bsearch(&key, due_entries, due_count, sizeof(DueEntry), compareDueEntriesById) : NULL;
+        SortedRow row = {0, id, status == 1, due != NULL ? due->due : 0, description};
+        row.key = sortedRowKey(options->sort, row.done, row.due, creations != NULL ? findCreationTime(creations, creation_count, id) : -1);
+        sortedListingAdd(&listing, &row);
+        held += strlen(description) + 17; // Plus malloc overhead
+        if (spill && held + listing.capacity * sizeof(SortedRow) > sort_memory_budget) {
+            if (run_count == SORT_MAX_RUNS) { // Merge what there is into one run first
+                FILE *merged = createSortedRun();
+                failed = merged == NULL || !mergeSortedRuns(NULL, merged, runs, run_count, options->sort);
+                run_count = 0;
+                if (!failed) runs[run_count++] = merged;
+            }
+            failed = failed || !spillSortedRun(&listing, runs, &run_count);
+            held = 0;
+        }
+    }
+    fclose(file);
+    free(due_entries);
+    free(creations);
+    if (run_count > 0 && !failed && listing.count > 0) { // The rest becomes the last run
+        failed = !spillSortedRun(&listing, runs, &run_count);
+    }
+    if (failed) { // Merging what was written would silently lose rows
+        fprintf(out, "Error: could not write sort runs to %s.\n", task_dir_path);
+        for (size_t i = 0; i < listing.count; i++) free((char *)listing.rows[i].description);
+        free(listing.rows);
+        for (size_t i = 0; i < run_count; i++) fclose(runs[i]);
+        return;
+    }
+    if (run_count > 0) {
+        mergeSortedRuns(out, NULL, runs, run_count, options->sort);
+        return;
+    }
+    sortedListingFinish(&listing);
+    printSortedListing(out, &listing);
+}
+
+// A crdt.txt line together with its position in the file (later lines win)
+typedef struct {
+    CrdtRecord record;
+    size_t sequence;
+} CrdtEntry;
+
+// Function to order crdt.txt entries by identity, then by file position
+int compareCrdtEntries(const void *a, const void *b) {
+    const CrdtEntry *x = (const CrdtEntry *)a, *y = (const CrdtEntry *)b;
+    if (x->record.replica != y->record.replica) return x->record.replica < y->record.replica ? -1 : 1;
+    if (x->record.origin != y->record.origin) return x->record.origin < y->record.origin ? -1 : 1;
+    return (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+// Function to order records by identity
+int compareCrdtRecords(const void *a, const void *b) {
+    const CrdtRecord *x = (const CrdtRecord *)a, *y = (const CrdtRecord *)b;
+    if (x->replica != y->replica) return x->replica < y->replica ? -1 : 1;
+    return (x->origin > y->origin) - (x->origin < y->origin);
+}
+
+// Function to load a store as CRDT records sorted by identity
+// tasks.txt is the source of truth for which tasks exist and their status; crdt.txt supplies
+// identities, timestamps and tombstones. Tasks without an entry get their legacy identity.
+// The records and their descriptions are allocated from the arena.
+CrdtRecord *loadCrdtStore(Arena *arena, const StoreLocation *location, size_t *count) {
+    *count = 0;
+
+    // Latest crdt.txt entry per identity
+    CrdtEntry *entries = NULL;
+    size_t entry_count = 0, entry_capacity = 0;
+    FILE *file = openDirectoryStream(location->dir_fd, CRDT_FILENAME, O_RDONLY, "r");
+    if (file != NULL) {
+        char line[CRDT_LINE_MAX];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            CrdtEntry entry;
+            if (!parseCrdtLine(line, &entry.record)) {
+                continue; // Header or malformed line
+            }
+            if (entry_count == entry_capacity) {
+                entry_capacity = entry_capacity ? entry_capacity * 2 : 1024;
+                entries = (CrdtEntry *)realloc(entries, entry_capacity * sizeof(CrdtEntry));
+            }
+            entry.sequence = entry_count;
+            entries[entry_count++] = entry;
+        }
+        fclose(file);
+    }
+    if (entry_count > 1) {
+        qsort(entries, entry_count, sizeof(CrdtEntry), compareCrdtEntries);
+    }
+
+    // The tasks themselves, sorted by ID so entries can be joined to them
+    TaskRecord *tasks = NULL;
+    size_t task_count = 0, task_capacity = 0;
+    file = openDirectoryStream(location->dir_fd, location->tasks_name, O_RDONLY, "r");
+    if (file != NULL) {
+        char line[MAX_DESCRIPTION_LEN + 20];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            int id, status;
+            char description[MAX_DESCRIPTION_LEN];
+            if (sscanf(line, "%d,%d,%[^\n]", &id, &status, description) != 3) {
+                continue;
+            }
+            if (task_count == task_capacity) {
+                task_capacity = task_capacity ? task_capacity * 2 : 1024;
+                tasks = (TaskRecord *)realloc(tasks, task_capacity * sizeof(TaskRecord));
+            }
+            tasks[task_count].id = id;
+            tasks[task_count].status = status;
+            tasks[task_count].description = arenaStrdup(arena, description);
+            task_count++;
+        }
+        fclose(file);
+    }
+    if (task_count > 1) {
+        qsort(tasks, task_count, sizeof(TaskRecord), compareTaskRecords);
+    }
+    bool *claimed = (bool *)calloc(task_count + 1, sizeof(bool));
+
+    CrdtRecord *records = (CrdtRecord *)arenaAlloc(arena, (entry_count + task_count + 1) * sizeof(CrdtRecord));
+    for (size_t i = 0; i < entry_count; i++) {
+        if (i + 1 < entry_count && compareCrdtRecords(&entries[i].record, &entries[i + 1].record) == 0) {
+            continue; // Superseded by a later line for the same identity
+        }
+        CrdtRecord record = entries[i].record;
+        if (!crdtDeleted(&record)) { // Attach the live task shown under this ID
+            TaskRecord key = {record.id, 0, NULL};
+            TaskRecord *task = task_count > 0 ? (TaskRecord *)bsearch(&key, tasks, task_count, sizeof(TaskRecord), compareTaskRecords) : NULL;
+            if (task != NULL && !claimed[task - tasks]) {
+                claimed[task - tasks] = true;
+                record.description = task->description;
+                record.state = task->status == 1 ? 'C' : 'P';
+            } else { // The task was removed from tasks.txt by other means
+                record.deleted_stamp.counter = record.status_stamp.counter + 1;
+                record.deleted_stamp.replica = record.status_stamp.replica;
+            }
+        }
+        if (crdtDeleted(&record)) {
+            record.id = 0;
+        }
+        records[(*count)++] = record;
+    }
+    for (size_t i = 0; i < task_count; i++) { // Tasks that predate crdt.txt
+        if (claimed[i]) {
+            continue;
+        }
+        CrdtRecord record;
+        legacyCrdtRecord(tasks[i].id, tasks[i].description, &record);
+        record.state = tasks[i].status == 1 ? 'C' : 'P';
+        record.description = tasks[i].description;
+        records[(*count)++] = record;
+    }
+    free(tasks);
+    free(claimed);
+    free(entries);
+
+    qsort(records, *count, sizeof(CrdtRecord), compareCrdtRecords);
+    // Two legacy records can share an identity only if the same ID and description appear twice
+    size_t unique = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (unique > 0 && compareCrdtRecords(&records[unique - 1], &records[i]) == 0) {
+            continue;
+        }
+        records[unique++] = records[i];
+    }
+    *count = unique;
+    return records;
+}
+
+// Function to resolve two states of the same record, field by field
+// Each field takes the value with the later timestamp, so the result is the same whichever copy
+// is merged into which. Equal timestamps with different statuses can only come from tasks.txt
+// being changed without crdt.txt (e.g. by a follower); completion wins those.
+CrdtRecord resolveCrdtRecords(const CrdtRecord *local, const CrdtRecord *other) {
+    CrdtRecord record = *local;
+    int order = compareLamportStamps(&local->status_stamp, &other->status_stamp);
+    if (order < 0 || (order == 0 && other->state == 'C')) {
+        record.state = other->state;
+        record.status_stamp = other->status_stamp;
+    }
+    if (compareLamportStamps(&other->deleted_stamp, &local->deleted_stamp) > 0) {
+        record.deleted_stamp = other->deleted_stamp;
+    }
+    return record;
+}
+
+// A record being merged, with the ID and status it had in this store (ID 0: absent or deleted
+// here) and the ID it had in the other one
+typedef struct {
+    CrdtRecord record;
+    int local_id, other_id;
+    char local_state;
+} MergeRecord;
+
+// Function to order merge records by age (creation stamp, then replica)
+int compareMergeRecordAge(const void *a, const void *b) {
+    const CrdtRecord *x = &(*(MergeRecord *const *)a)->record, *y = &(*(MergeRecord *const *)b)->record;
+    if (x->origin != y->origin) return x->origin < y->origin ? -1 : 1;
+    return (x->replica > y->replica) - (x->replica < y->replica);
+}
+
+// Function to order merge records by their new local ID
+int compareMergeRecordIds(const void *a, const void *b) {
+    int idA = ((const MergeRecord *)a)->record.id, idB = ((const MergeRecord *)b)->record.id;
+    return (idA > idB) - (idA < idB);
+}
+
+// A store to load as CRDT records (both sides of a merge load in parallel)
+typedef struct {
+    const StoreLocation *location;
+    CrdtRecord *records;
+    size_t count;
+    Arena arena;              // Each side allocates from its own arena (they load on different threads)
+} CrdtLoad;
+
+// Function to load a range of stores (a parallelFor body)
+void loadCrdtStores(void *arg, size_t begin, size_t end) {
+    CrdtLoad *loads = (CrdtLoad *)arg;
+    for (size_t i = begin; i < end; i++) {
+        loads[i].records = loadCrdtStore(&loads[i].arena, loads[i].location, &loads[i].count);
+    }
+}
+
+// Function to merge another copy of the store into this one (the 'merge' command)
+// Both stores are turned into records sorted by identity and combined in one linear merge-join;
+// no conflict ever needs manual resolution. IDs are assigned so that merging A into B and B into
+// A give the same store: a record both copies show under the same ID keeps it, then records
+// claim the lowest of their IDs that is still free, oldest first, and any record left without
+// one gets a new ID past all of them. A local task can therefore be renumbered by a merge.
+void mergeStores(const char *other_store) {
+    StoreLocation local_location = {task_dir_fd, TASK_FILENAME};
+    StoreLocation other_location;
+    if (!openStoreLocation(other_store, &other_location)) {
+        return;
+    }
+    struct stat local_st, other_st;
+    if (fstatat(task_dir_fd, TASK_FILENAME, &local_st, 0) == 0 &&
+        fstatat(other_location.dir_fd, other_location.tasks_name, &other_st, 0) == 0 &&
+        local_st.st_dev == other_st.st_dev && local_st.st_ino == other_st.st_ino) {
+        printf("Cannot merge a store into itself.\n");
+        close(other_location.dir_fd);
+        return;
+    }
+
+    StoreStamp before = stampStoreFile(TASK_FILENAME);
+    CrdtLoad loads[2] = {{&local_location, NULL, 0, {}}, {&other_location, NULL, 0, {}}};
+    parallelFor(2, 1, loadCrdtStores, loads);
+    close(other_location.dir_fd);
+    CrdtRecord *local = loads[0].records, *other = loads[1].records;
+    size_t local_count = loads[0].count, other_count = loads[1].count;
+    uint64_t replica = crdtReplicaId();
+
+    Arena *arena = scratchArena();
+    size_t capacity = local_count + other_count + 1;
+    MergeRecord *merged = (MergeRecord *)arenaAlloc(arena, capacity * sizeof(MergeRecord));
+    memset(merged, 0, capacity * sizeof(MergeRecord));
+    MergeRecord **contested = (MergeRecord **)arenaAlloc(arena, capacity * sizeof(MergeRecord *));
+    MerkleDelta *deltas = (MerkleDelta *)arenaAlloc(arena, 2 * capacity * sizeof(MerkleDelta));
+    memset(deltas, 0, 2 * capacity * sizeof(MerkleDelta)); // A renumbered task moves between two leaves
+    size_t merged_count = 0, contested_count = 0, delta_count = 0;
+    int highest = 0; // Highest ID either copy shows
+
+    size_t i = 0, j = 0;
+    while (i < local_count || j < other_count) {
+        int order = i == local_count ? 1 : j == other_count ? -1 : compareCrdtRecords(&local[i], &other[j]);
+        MergeRecord *entry = &merged[merged_count++];
+        if (order <= 0) {
+            entry->local_id = local[i].id;
+            entry->local_state = local[i].state;
+        }
+        if (order < 0) { // Only here
+            entry->record = local[i++];
+        } else if (order > 0) { // Only in the other copy
+            entry->other_id = other[j].id;
+            entry->record = other[j++];
+        } else { // In both: resolve each register
+            entry->other_id = other[j].id;
+            entry->record = resolveCrdtRecords(&local[i], &other[j]);
+            entry->record.description = local[i].description != NULL ? local[i].description : other[j].description;
+            i++;
+            j++;
+        }
+        if (entry->local_id > highest) highest = entry->local_id;
+        if (entry->other_id > highest) highest = entry->other_id;
+        entry->record.id = 0;
+    }
+
+    // Assign the new IDs (see above)
+    bool *used = (bool *)calloc((size_t)highest + 1, sizeof(bool));
+    for (size_t k = 0; k < merged_count; k++) {
+        MergeRecord *entry = &merged[k];
+        if (crdtDeleted(&entry->record)) {
+            continue;
+        }
+        if (entry->local_id != 0 && entry->local_id == entry->other_id) {
+            entry->record.id = entry->local_id;
+            used[entry->local_id] = true;
+        } else {
+            contested[contested_count++] = entry;
+        }
+    }
+    if (contested_count > 1) {
+        qsort(contested, contested_count, sizeof(MergeRecord *), compareMergeRecordAge);
+    }
+    size_t unplaced = 0;
+    for (size_t k = 0; k < contested_count; k++) {
+        MergeRecord *entry = contested[k];
+        int first = entry->local_id, second = entry->other_id;
+        if (first == 0 || (second != 0 && second < first)) {
+            first = entry->other_id;
+            second = entry->local_id;
+        }
+        if (first != 0 && !used[first]) {
+            entry->record.id = first;
+        } else if (second != 0 && !used[second]) {
+            entry->record.id = second;
+        } else {
+            contested[unplaced++] = entry; // Still in age order
+            continue;
+        }
+        used[entry->record.id] = true;
+    }
+    int next_id = highest;
+    for (size_t k = 0; k < unplaced; k++) {
+        contested[k]->record.id = ++next_id;
+    }
+    free(used);
+
+    // Work out what changed here; removals are logged before additions, so a follower never
+    // sees an ID added while the record it is about to lose still holds it
+    int *moved = (int *)calloc((size_t)highest + 1, sizeof(int)); // Old local ID -> new one (-1: deleted)
+    OplogBatch log = {NULL, 0, 0, false};
+    int added = 0, updated = 0, deleted = 0, renumbered = 0;
+    for (size_t k = 0; k < merged_count; k++) {
+        const MergeRecord *entry = &merged[k];
+        const CrdtRecord *record = &entry->record;
+        if (entry->local_id == 0 || (!crdtDeleted(record) && record->id == entry->local_id)) {
+            continue; // Not here before, or still under the same ID
+        }
+        deltas[delta_count].id = entry->local_id;
+        deltas[delta_count++].delta = 0 - recordHash(entry->local_id, entry->local_state == 'C', record->description);
+        batchOperation(&log, 'D', entry->local_id, NULL);
+        if (crdtDeleted(record)) {
+            moved[entry->local_id] = -1;
+            deleted++;
+        } else {
+            moved[entry->local_id] = record->id;
+            renumbered++;
+        }
+    }
+    for (size_t k = 0; k < merged_count; k++) {
+        const MergeRecord *entry = &merged[k];
+        const CrdtRecord *record = &entry->record;
+        if (crdtDeleted(record)) {
+            continue;
+        }
+        if (entry->local_id != record->id) { // New here, or renumbered
+            deltas[delta_count].id = record->id;
+            deltas[delta_count++].delta = recordHash(record->id, record->state == 'C', record->description);
+            batchOperation(&log, 'A', record->id, "%s", record->description);
+            if (record->state == 'C') {
+                batchOperation(&log, 'S', record->id, "%d", 1);
+            }
+            added += entry->local_id == 0;
+        } else if (record->state != entry->local_state) { // Status changed there
+            deltas[delta_count].id = record->id;
+            deltas[delta_count++].delta = recordHash(record->id, record->state == 'C', record->description) -
+                                          recordHash(record->id, entry->local_state == 'C', record->description);
+            batchOperation(&log, 'S', record->id, "%d", record->state == 'C' ? 1 : 0);
+            updated++;
+        }
+    }
+
+    // Due dates follow renumbered tasks and are dropped with deleted ones
+    size_t due_count = 0;
+    DueEntry *due = loadDueEntries(task_dir_fd, &due_count);
+    size_t due_kept = 0;
+    bool due_changed = false;
+    for (size_t k = 0; k < due_count; k++) {
+        int id = due[k].id;
+        if (id > 0 && id <= highest && moved[id] != 0) {
+            due_changed = true;
+            if (moved[id] == -1) {
+                continue;
+            }
+            due[k].id = moved[id];
+            batchOperation(&log, 'U', due[k].id, "%lld", (long long)due[k].due);
+        }
+        due[due_kept++] = due[k];
+    }
+    free(moved);
+
+    // Write the new crdt.txt (compacted to one line per identity, tombstones included) and
+    // tasks.txt side by side, then put tasks.txt in place first and crdt.txt last: crdt.txt maps
+    // identities to the IDs in tasks.txt, so it must never describe a tasks.txt that didn't land
+    bool ok = !log.failed;
+    const char *crdt_temp = CRDT_FILENAME ".tmp", *tasks_temp = TASK_FILENAME ".tmp";
+    FILE *crdt = ok ? openStoreStream(crdt_temp, O_WRONLY | O_CREAT | O_TRUNC, "w") : NULL;
+    if (crdt != NULL) {
+        fprintf(crdt, "#replica=%016" PRIx64 "\n", replica);
+        for (size_t k = 0; k < merged_count; k++) {
+            char line[CRDT_LINE_MAX];
+            formatCrdtLine(line, sizeof(line), &merged[k].record);
+            fputs(line, crdt);
+        }
+        ok = fclose(crdt) == 0;
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        perror("Error writing crdt.txt");
+    }
+
+    qsort(merged, merged_count, sizeof(MergeRecord), compareMergeRecordIds);
+    LeafSpanIndex spans = {NULL, 0}; // Where each leaf's records end up in the new file
+    bool indexed = true;
+    FILE *tasks = ok ? openStoreStream(tasks_temp, O_WRONLY | O_CREAT | O_TRUNC, "w") : NULL;
+    if (tasks != NULL) {
+        uint64_t offset = 0;
+        for (size_t k = 0; k < merged_count; k++) {
+            const CrdtRecord *record = &merged[k].record;
+            if (crdtDeleted(record)) {
+                continue;
+            }
+            int length = fprintf(tasks, "%d,%d,%s\n", record->id, record->state == 'C' ? 1 : 0, record->description);
+            if (length > 0) indexed = noteLeafSpan(&spans, record->id, offset, offset + (uint64_t)length) && indexed;
+            offset += length > 0 ? (uint64_t)length : 0;
+        }
+        ok = fclose(tasks) == 0 && renameat(task_dir_fd, tasks_temp, task_dir_fd, TASK_FILENAME) == 0;
+        if (!ok) {
+            perror("Error writing task file");
+        }
+    } else if (ok) {
+        perror("Error writing task file");
+        ok = false;
+    }
+
+    if (ok) {
+        StoreStamp after = stampStoreFile(TASK_FILENAME);
+        if (indexed) {
+            updateMerkleTree(&before, &after, deltas, delta_count, &spans);
+        } else {
+            unlinkat(task_dir_fd, MERKLE_FILENAME, 0); // Out of memory for the spans: 'diff' rebuilds the tree
+        }
+        if (due_changed && !saveDueEntries(due, due_kept)) {
+            fprintf(stderr, "Error: due dates of merged tasks were not updated.\n");
+        }
+        if (log.length > 0) {
+            appendOplog(log.data, log.length); // Only once the merge is in place
+        }
+        if (renameat(task_dir_fd, crdt_temp, task_dir_fd, CRDT_FILENAME) == -1) {
+            perror("Error writing crdt.txt");
+        }
+        printf("Merged %s: %d added, %d status update%s, %d deleted", other_store,
+               added, updated, updated == 1 ? "" : "s", deleted);
+        if (renumbered > 0) {
+            printf(", %d renumbered", renumbered);
+        }
+        printf(".\n");
+    } else {
+        unlinkat(task_dir_fd, tasks_temp, 0);
+        unlinkat(task_dir_fd, crdt_temp, 0);
+        printf("Merge of %s not applied.\n", other_store);
+    }
+
+    free(spans.items);
+    free(due);
+    free(log.data);
+    arenaReset(&loads[0].arena, false);
+    arenaReset(&loads[1].arena, false);
+}
+
+
+// Function to get the Gear table used by the rolling hash (deterministic pseudo-random values)
+const uint64_t *gearTable() {
+    static uint64_t table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (int i = 0; i < 256; i++) {
+            table[i] = mix64((uint64_t)i + 0x9e3779b97f4a7c15ULL);
+        }
+        initialized = true;
+    }
+    return table;
+}
+
+// Function to find the end of the next chunk in a buffer (FastCDC with normalized chunking)
+// A stricter mask is used before the average size and a looser one after it, which narrows
+// the chunk size distribution. Cut points depend only on nearby content, so an edit shifts
+// at most the chunks around it.
+size_t nextChunkLength(const unsigned char *data, size_t length) {
+    const uint64_t mask_strict = ~0ULL << (64 - 15); // Harder to match below the average size
+    const uint64_t mask_loose = ~0ULL << (64 - 11);  // Easier to match above it
+    if (length <= CDC_MIN_CHUNK) {
+        return length;
+    }
+    const uint64_t *gear = gearTable();
+    size_t normal = length < CDC_AVG_CHUNK ? length : CDC_AVG_CHUNK;
+    size_t limit = length < CDC_MAX_CHUNK ? length : CDC_MAX_CHUNK;
+    uint64_t fingerprint = 0;
+    size_t i = CDC_MIN_CHUNK;
+    for (; i < normal; i++) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if ((fingerprint & mask_strict) == 0) return i + 1;
+    }
+    for (; i < limit; i++) {
+        fingerprint = (fingerprint << 1) + gear[data[i]];
+        if ((fingerprint & mask_loose) == 0) return i + 1;
+    }
+    return limit;
+}
+
+// Function to name a chunk by its content (128 bits from two independent hashes)
+void chunkName(const unsigned char *data, size_t length, char *name) {
+    snprintf(name, 33, "%016" PRIx64 "%016" PRIx64, hashBytes(data, length, 0), hashBytes(data, length, 0x5bd1e995ULL));
+}
+
+// Function to build the path of a chunk relative to a backup repository (fanned out by the first byte)
+void chunkPath(const char *name, char *path, size_t size) {
+    snprintf(path, size, "chunks/%.2s/%s", name, name);
+}
+
+// Function to store one chunk unless the repository (opened as backup_fd) already has it
+// Returns true if the chunk was new.
+bool storeChunk(int backup_fd, const char *name, const unsigned char *data, size_t length, bool *failed) {
+    char path[64];
+    chunkPath(name, path, sizeof(path));
+    if (faccessat(backup_fd, path, F_OK, 0) == 0) {
+        return false; // Content-addressed: identical content is already stored
+    }
+
+    char fan_dir[16];
+    snprintf(fan_dir, sizeof(fan_dir), "chunks/%.2s", name);
+    mkdirat(backup_fd, fan_dir, 0700);
+    char temp_path[72];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = openDirectoryStream(backup_fd, temp_path, O_WRONLY | O_CREAT | O_TRUNC, "wb");
+    bool ok = file != NULL && fwrite(data, 1, length, file) == length;
+    if (file != NULL) ok = fclose(file) == 0 && ok;
+    if (!ok || renameat(backup_fd, temp_path, backup_fd, path) == -1) {
+        perror("Error writing backup chunk");
+        unlinkat(backup_fd, temp_path, 0);
+        *failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Function to tell whether a file name is a temporary file (or hidden)
+bool isTemporaryFile(const char *name) {
+    size_t length = strlen(name);
+    return name[0] == '.' || strncmp(name, "temp_", 5) == 0 ||
+           (length > 4 && strcmp(name + length - 4, ".tmp") == 0);
+}
+
+// Function to tell whether a file in the task directory stays out of backups
+// Besides temporary files that is the state of this machine rather than of the store: delivered
+// reminders, replication positions, the daemon's socket and lock, and the Merkle tree, which is
+// rebuilt from tasks.txt. The operation log is left out too; a restore starts a new one instead.
+bool isTransientFile(const char *name) {
+    static const char *const runtime_files[] = {REMIND_FILENAME, MERKLE_FILENAME, OPLOG_FILENAME,
+                                                REPLICA_OFFSET_FILENAME, FOLLOWERS_DIRNAME,
+                                                DAEMON_SOCKET_FILENAME, DAEMON_LOCK_FILENAME};
+    for (size_t i = 0; i < sizeof(runtime_files) / sizeof(runtime_files[0]); i++) {
+        if (strcmp(name, runtime_files[i]) == 0) {
+            return true;
+        }
+    }
+    return isTemporaryFile(name);
+}
+
+// Function to check that a name from a snapshot manifest names a file directly in a directory
+bool isPlainFileName(const char *name) {
+    return name[0] != '\0' && strchr(name, '/') == NULL && strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+// Function to check that a name from a snapshot manifest is a chunk name as chunkName() makes them
+bool isChunkName(const char *name) {
+    return strspn(name, "0123456789abcdef") == 32 && name[32] == '\0';
+}
+
+// Function to back up the task directory (the 'backup' command)
+// Every file is split into content-defined chunks stored under <dir>/chunks by content hash,
+// and the snapshot manifest under <dir>/snapshots lists the chunks of each file. A snapshot
+// therefore only writes the chunks that changed since any earlier snapshot.
+void backupStore(const char *backup_dir) {
+    mkdir(backup_dir, 0700);
+    int backup_fd = open(backup_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (backup_fd == -1 || (mkdirat(backup_fd, "chunks", 0700) == -1 && errno != EEXIST) ||
+        (mkdirat(backup_fd, "snapshots", 0700) == -1 && errno != EEXIST)) {
+        perror("Error creating backup directory");
+        if (backup_fd != -1) close(backup_fd);
+        return;
+    }
+
+    char snapshot_name[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(snapshot_name, sizeof(snapshot_name), "%Y%m%d-%H%M%S", &tm);
+    char manifest_path[64];
+    snprintf(manifest_path, sizeof(manifest_path), "snapshots/%s", snapshot_name);
+    for (int suffix = 1; faccessat(backup_fd, manifest_path, F_OK, 0) == 0; suffix++) { // Several snapshots in one second
+        snprintf(manifest_path, sizeof(manifest_path), "snapshots/%s.%d", snapshot_name, suffix);
+    }
+    char temp_manifest[72];
+    snprintf(temp_manifest, sizeof(temp_manifest), "%s.tmp", manifest_path);
+    FILE *manifest = openDirectoryStream(backup_fd, temp_manifest, O_WRONLY | O_CREAT | O_TRUNC, "w");
+    // A second descriptor for the store, since readdir() consumes the one it is given
+    int list_fd = openat(task_dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = list_fd != -1 ? fdopendir(list_fd) : NULL;
+    if (manifest == NULL || dir == NULL) {
+        perror("Error starting backup");
+        if (manifest != NULL) fclose(manifest);
+        if (dir != NULL) closedir(dir);
+        else if (list_fd != -1) close(list_fd);
+        close(backup_fd);
+        return;
+    }
+
+    unsigned char *buffer = (unsigned char *)malloc(4 * CDC_MAX_CHUNK);
+    size_t file_count = 0, chunk_count = 0, new_chunks = 0;
+    unsigned long long new_bytes = 0;
+    bool failed = false;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL && !failed) {
+        if (isTransientFile(dirent->d_name)) {
+            continue;
+        }
+        FILE *file = openStoreStream(dirent->d_name, O_RDONLY, "rb");
+        struct stat st;
+        if (file == NULL || fstat(fileno(file), &st) == -1 || !S_ISREG(st.st_mode)) {
+            if (file != NULL) fclose(file);
+            continue;
+        }
+        fprintf(manifest, "F %s %lld %o\n", dirent->d_name, (long long)st.st_size, (unsigned)(st.st_mode & 0777));
+        file_count++;
+
+        // Stream the file through the chunker, refilling the buffer as chunks are consumed
+        size_t filled = 0;
+        bool eof = false;
+        for (;;) {
+            if (!eof && filled < 2 * CDC_MAX_CHUNK) {
+                size_t got = fread(buffer + filled, 1, 4 * CDC_MAX_CHUNK - filled, file);
+                filled += got;
+                eof = got == 0 || feof(file);
+            }
+            if (filled == 0) {
+                break;
+            }
+            // The buffer holds at least CDC_MAX_CHUNK bytes unless the file is exhausted, so cut
+            // points never depend on how the reads happened to be split
+            size_t length = nextChunkLength(buffer, filled);
+            char name[33];
+            chunkName(buffer, length, name);
+            if (storeChunk(backup_fd, name, buffer, length, &failed)) {
+                new_chunks++;
+                new_bytes += length;
+            }
+            fprintf(manifest, "C %s %zu\n", name, length);
+            chunk_count++;
+            memmove(buffer, buffer + length, filled - length);
+            filled -= length;
+        }
+        fclose(file);
+    }
+    closedir(dir);
+    free(buffer);
+
+    if (fclose(manifest) != 0 || failed || renameat(backup_fd, temp_manifest, backup_fd, manifest_path) == -1) {
+        perror("Error writing backup snapshot");
+        unlinkat(backup_fd, temp_manifest, 0);
+        close(backup_fd);
+        return;
+    }
+    close(backup_fd);
+    printf("Snapshot %s: %zu file%s, %zu chunk%s (%zu new, %llu bytes written).\n", strrchr(manifest_path, '/') + 1,
+           file_count, file_count == 1 ? "" : "s", chunk_count, chunk_count == 1 ? "" : "s", new_chunks, new_bytes);
+}
+
+// One chunk to restore: where it comes from and where it goes
+typedef struct {
+    char name[33];
+    size_t length;
+    off_t offset; // Position in the restored file
+    int fd;       // Restored file (temporary until every chunk is in place)
+} RestoreChunk;
+
+// Work shared by the restore loop
+typedef struct {
+    int backup_fd;
+    RestoreChunk *chunks;
+    size_t count;
+    bool failed;
+} RestoreJob;
+
+// Function to restore a range of chunks (a parallelFor body): verify them and write them in place
+void restoreChunks(void *arg, size_t begin, size_t end) {
+    RestoreJob *job = (RestoreJob *)arg;
+    unsigned char *data = (unsigned char *)malloc(CDC_MAX_CHUNK);
+    for (size_t index = begin; index < end; index++) {
+        RestoreChunk *chunk = &job->chunks[index];
+        char path[64], name[33];
+        chunkPath(chunk->name, path, sizeof(path));
+        int fd = openDirectoryFile(job->backup_fd, path, O_RDONLY);
+        ssize_t got = fd == -1 ? -1 : read(fd, data, CDC_MAX_CHUNK);
+        if (fd != -1) close(fd);
+        if (got != (ssize_t)chunk->length) {
+            fprintf(stderr, "Error: backup chunk %s is missing or truncated.\n", chunk->name);
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            continue;
+        }
+        chunkName(data, chunk->length, name);
+        if (strcmp(name, chunk->name) != 0) {
+            fprintf(stderr, "Error: backup chunk %s is corrupted.\n", chunk->name);
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (pwrite(chunk->fd, data, chunk->length, chunk->offset) != (ssize_t)chunk->length) {
+            perror("Error writing restored file");
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        }
+    }
+    free(data);
+}
+
+// Function to restore a snapshot into a directory (the 'restore' command)
+// Chunks are read and verified on the executor's threads and written at their offsets into
+// temporary files, which replace the originals only once every chunk has been restored. The
+// target then gets a new operation log, so its followers copy the restored store afresh.
+void restoreStore(const char *backup_dir, const char *snapshot, const char *target_dir) {
+    int backup_fd = open(backup_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (backup_fd == -1) {
+        printf("No snapshots found in %s.\n", backup_dir);
+        return;
+    }
+    char manifest_path[MAX_PATH_LEN];
+    char latest[256] = "";
+    if (snapshot == NULL) { // Default to the newest snapshot (names sort chronologically)
+        int snapshots_fd = openat(backup_fd, "snapshots", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *dir = snapshots_fd != -1 ? fdopendir(snapshots_fd) : NULL;
+        if (dir == NULL && snapshots_fd != -1) close(snapshots_fd);
+        struct dirent *dirent;
+        while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+            if (!isTemporaryFile(dirent->d_name) && strcmp(dirent->d_name, latest) > 0) {
+                snprintf(latest, sizeof(latest), "%s", dirent->d_name);
+            }
+        }
+        if (dir != NULL) closedir(dir);
+        if (latest[0] == '\0') {
+            printf("No snapshots found in %s.\n", backup_dir);
+            close(backup_fd);
+            return;
+        }
+        snapshot = latest;
+    }
+    FILE *manifest = NULL;
+    if (isPlainFileName(snapshot) &&
+        snprintf(manifest_path, sizeof(manifest_path), "snapshots/%s", snapshot) < (int)sizeof(manifest_path)) {
+        manifest = openDirectoryStream(backup_fd, manifest_path, O_RDONLY, "r");
+    }
+    if (manifest == NULL) {
+        printf("Snapshot %s not found.\n", snapshot);
+        close(backup_fd);
+        return;
+    }
+    if (mkdir(target_dir, 0700) == -1 && errno != EEXIST) {
+        perror("Error creating restore directory");
+        fclose(manifest);
+        close(backup_fd);
+        return;
+    }
+    int target_fd = open(target_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (target_fd == -1) {
+        perror("Error opening restore directory");
+        fclose(manifest);
+        close(backup_fd);
+        return;
+    }
+    // A daemon serving the target would go on answering from the files it had; holding its lock
+    // for the whole restore also keeps one from being started meanwhile
+    int lock_fd = openDirectoryFile(target_fd, DAEMON_LOCK_FILENAME, O_RDWR | O_CREAT);
+    if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+        if (lock_fd == -1) perror("Error opening the daemon lock");
+        else fprintf(stderr, "Error: a daemon is serving %s; stop it before restoring.\n", target_dir);
+        if (lock_fd != -1) close(lock_fd);
+        fclose(manifest);
+        close(target_fd);
+        close(backup_fd);
+        return;
+    }
+
+    // Read the manifest: open a temporary file per entry and lay out its chunks
+    // Nothing in it is trusted: file names must stay inside the target directory, chunk names
+    // must be chunk names, and each file's chunks must add up to its size.
+    typedef struct {
+        char name[256];
+        char temp_name[256 + 16];
+        int fd;
+        long long size;
+    } RestoreFile;
+    RestoreFile *files = NULL;
+    size_t file_count = 0, file_capacity = 0;
+    RestoreJob job;
+    memset(&job, 0, sizeof(job));
+    job.backup_fd = backup_fd;
+    size_t chunk_capacity = 0;
+    off_t offset = 0;
+    bool skipping = false; // Inside an entry for runtime state, which is never restored
+    char line[512];
+    while (!job.failed) {
+        bool at_end = fgets(line, sizeof(line), manifest) == NULL;
+        char name[256], chunk_name[33];
+        long long size;
+        unsigned mode;
+        size_t length;
+        bool is_file = !at_end && sscanf(line, "F %255s %lld %o", name, &size, &mode) == 3;
+        if ((at_end || is_file) && file_count > 0 && offset != files[file_count - 1].size) {
+            fprintf(stderr, "Error: snapshot %s lists chunks that do not add up to the size of %s.\n", snapshot,
+                    files[file_count - 1].name);
+            job.failed = true;
+            break;
+        }
+        if (at_end) {
+            break;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (is_file) {
+            bool duplicate = false;
+            for (size_t i = 0; i < file_count; i++) duplicate = duplicate || strcmp(files[i].name, name) == 0;
+            if (!isPlainFileName(name) || duplicate || size < 0) {
+                fprintf(stderr, "Error: snapshot %s has an invalid entry: %s\n", snapshot, line);
+                job.failed = true;
+                break;
+            }
+            skipping = isTransientFile(name);
+            if (skipping) {
+                continue;
+            }
+            if (file_count == file_capacity) {
+                file_capacity = file_capacity ? file_capacity * 2 : 16;
+                files = (RestoreFile *)realloc(files, file_capacity * sizeof(RestoreFile));
+            }
+            RestoreFile *file = &files[file_count++];
+            snprintf(file->name, sizeof(file->name), "%s", name);
+            file->size = size;
+            file->fd = -1;
+            if (snprintf(file->temp_name, sizeof(file->temp_name), "%s.restore.tmp", name) >= (int)sizeof(file->temp_name)) {
+                fprintf(stderr, "Error: restore name for %s is too long.\n", name);
+                file->temp_name[0] = '\0';
+                job.failed = true;
+                break;
+            }
+            // Restored files get back the mode they were backed up with
+            file->fd = openat(target_fd, file->temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode & 0777);
+            if (file->fd == -1 || ftruncate(file->fd, (off_t)size) == -1) {
+                perror("Error creating restored file");
+                job.failed = true;
+            }
+            offset = 0;
+        } else if (sscanf(line, "C %32s %zu", chunk_name, &length) == 2 && isChunkName(chunk_name) &&
+                   length > 0 && length <= CDC_MAX_CHUNK && (file_count > 0 || skipping)) {
+            if (skipping) {
+                continue;
+            }
+            if (job.count == chunk_capacity) {
+                chunk_capacity = chunk_capacity ? chunk_capacity * 2 : 256;
+                job.chunks = (RestoreChunk *)realloc(job.chunks, chunk_capacity * sizeof(RestoreChunk));
+            }
+            RestoreChunk *chunk = &job.chunks[job.count++];
+            memcpy(chunk->name, chunk_name, sizeof(chunk->name));
+            chunk->length = length;
+            chunk->offset = offset;
+            chunk->fd = files[file_count - 1].fd;
+            offset += (off_t)length;
+        } else {
+            fprintf(stderr, "Error: snapshot %s has an invalid entry: %s\n", snapshot, line);
+            job.failed = true;
+        }
+    }
+    fclose(manifest);
+
+    if (!job.failed) {
+        parallelFor(job.count, 16, restoreChunks, &job);
+    }
+
+    // Move the restored files into place only if every chunk made it
+    for (size_t i = 0; i < file_count; i++) {
+        if (files[i].fd != -1 && (fsync(files[i].fd) == -1 || close(files[i].fd) == -1)) {
+            job.failed = true;
+        }
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        if (job.failed || renameat(target_fd, files[i].temp_name, target_fd, files[i].name) == -1) {
+            unlinkat(target_fd, files[i].temp_name, 0);
+        }
+    }
+    if (!job.failed) { // The log described the store before it went back in time: start a new one
+        const char *temp_log = "temp_oplog.txt";
+        FILE *log = openDirectoryStream(target_fd, temp_log, O_WRONLY | O_CREAT | O_TRUNC, "w");
+        bool written = log != NULL && fprintf(log, "#oplog,%016" PRIx64 ",0\n", randomId()) > 0;
+        if (log == NULL || fclose(log) != 0 || !written || renameat(target_fd, temp_log, target_fd, OPLOG_FILENAME) == -1) {
+            perror("Error starting a new operation log");
+            unlinkat(target_fd, temp_log, 0);
+        }
+    }
+    if (job.failed) {
+        printf("Restore of snapshot %s failed; %s was left unchanged.\n", snapshot, target_dir);
+    } else {
+        printf("Restored snapshot %s: %zu file%s, %zu chunk%s into %s.\n", snapshot, file_count,
+               file_count == 1 ? "" : "s", job.count, job.count == 1 ? "" : "s", target_dir);
+    }
+    close(lock_fd); // A daemon may start again
+    close(target_fd);
+    close(backup_fd);
+    free(job.chunks);
+    free(files);
+}
+
+
+// Function to combine the arguments of 'add' from argv[first] on into a single description
+// The result is bounded by MAX_DESCRIPTION_LEN, since requests can also arrive over the daemon
+// socket, and kept on one line.
+void joinDescription(char description[MAX_DESCRIPTION_LEN], int argc, char *argv[], int first) {
+    size_t length = 0;
+    description[0] = '\0';
+    for (int i = first; i < argc && length < MAX_DESCRIPTION_LEN - 1; i++) {
+        length += snprintf(description + length, MAX_DESCRIPTION_LEN - length, "%s%s", argv[i], i < argc - 1 ? " " : "");
+    }
+    for (char *c = description; *c != '\0'; c++) {
+        if (*c == '\n' || *c == '\r') *c = ' '; // One record per line in tasks.txt
+    }
+}
+
+// Function to run one of the commands that read or change the store
+// Used both by main() and by the daemon's workers, which pass a per-request output buffer.
+// Returns the command's exit status, or -1 if argv[1] is not a store command.
+int runStoreCommand(const char *program, int argc, char *argv[], FILE *out) {
+    if (strcmp(argv[1], "add") == 0) {
+        bool unique = argc >= 3 && strcmp(argv[2], "--unique") == 0;
+        int first = unique ? 3 : 2;
+        if (argc <= first) {
+            fprintf(out, "Usage: %s add [--unique] <description>\n", program);
+            return 1;
+        }
+        char description[MAX_DESCRIPTION_LEN];
+        joinDescription(description, argc, argv, first);
+        if (!addTask(out, description, unique)) {
+            return 1;
+        }
+    } else if (strcmp(argv[1], "list") == 0) {
+        ListOptions options;
+        if (!parseListOptions(program, argc, argv, &options, out)) {
+            return 1;
+        }
+        if (options.sort == SORT_NONE && options.limit == 0) {
+            listTasks(out, options.low, options.high);
+        } else {
+            listTasksSorted(out, &options);
+        }
+    } else if (strcmp(argv[1], "done") == 0) {
+        if (argc < 3) {
+            fprintf(out, "Usage: %s done <task_id>...\n", program);
+            return 1;
+        }
+        // Several IDs are applied together with a single rewrite of the task file
+        int *taskIds = parseTaskIds(out, argv + 2, (size_t)(argc - 2));
+        if (taskIds == NULL) {
+            return 1;
+        }
+        modifyTaskStatus(out, taskIds, (size_t)(argc - 2), true);
+        free(taskIds);
+    } else if (strcmp(argv[1], "pending") == 0) {
+        if (argc < 3) {
+            fprintf(out, "Usage: %s pending <task_id>...\n", program);
+            return 1;
+        }
+        // Several IDs are applied together with a single rewrite of the task file
+        int *taskIds = parseTaskIds(out, argv + 2, (size_t)(argc - 2));
+        if (taskIds == NULL) {
+            return 1;
+        }
+        modifyTaskStatus(out, taskIds, (size_t)(argc - 2), false);
+        free(taskIds);
+    } else if (strcmp(argv[1], "delete") == 0) {
+        if (argc < 3) {
+            fprintf(out, "Usage: %s delete <task_id>...\n", program);
+            return 1;
+        }
+        // Several IDs are applied together with a single rewrite of the task file
+        int *taskIds = parseTaskIds(out, argv + 2, (size_t)(argc - 2));
+        if (taskIds == NULL) {
+            return 1;
+        }
+        deleteTask(out, taskIds, (size_t)(argc - 2));
+        free(taskIds);
+    } else if (strcmp(argv[1], "due") == 0) {
+        if (argc < 4) {
+            fprintf(out, "Usage: %s due <task_id> <YYYY-MM-DD [HH:MM]|+N[m|h|d]|none>\n", program);
+            return 1;
+        }
+        int taskId = atoi(argv[2]);
+        if (taskId <= 0) {
+            fprintf(out, "Invalid task ID. Please provide a positive integer.\n");
+            return 1;
+        }
+        // Allow the date and time to be given as two arguments ("2026-01-31 09:00" unquoted)
+        char when[64];
+        snprintf(when, sizeof(when), "%s%s%s", argv[3], argc > 4 ? " " : "", argc > 4 ? argv[4] : "");
+        dueTask(out, taskId, when);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Binary wire protocol spoken by clients whose first byte is WIRE_MAGIC (text otherwise)
+// Every message is a frame: a 4-byte length (native byte order, the socket is local) covering a
+// 1-byte opcode and its payload.
+//   Requests:  'A' add (payload: the description), 'C' done, 'P' pending, 'X' delete (payload:
+//              4-byte task IDs), 'L' list (payload: 1-byte filter, 0 all, 1 pending, 2 done),
+//              'V' run a store command (payload: its arguments, each ending in a NUL),
+//              'M' map a shared-memory ring (no payload; only as the first frame)
+//   Responses: 'R' result of one request (4-byte status, then the new ID for 'A' or one found
+//              byte per ID; an 'A' with an empty description has status 1 and ID 0, and one
+//              duplicating a pending task has status 2 if it was rejected and 3 if it was
+//              merged, with that task's ID), 'T' a chunk of listed rows (each: 4-byte ID,
+//              1-byte status, 2-byte length, description), 'E' end of a listing (4-byte row
+//              count), 'O' output of a 'V' (4-byte exit status, then the text the command printed),
+//              'M' the ring (4-byte slot count, with the ring's memfd attached as SCM_RIGHTS;
+//              0 slots and no descriptor if the daemon serves too many rings already)
+// Clients may send any number of requests without waiting; responses come back in order.
+
+// How a connection talks to the daemon, decided by its first byte
+typedef enum {
+    CONNECTION_UNKNOWN,
+    CONNECTION_TEXT,   // One command line per request
+    CONNECTION_BINARY, // Length-prefixed frames, pipelined
+    CONNECTION_HTTP    // HTTP/1.1 on the loopback listener
+} ConnectionMode;
+
+// One client connection of the daemon
+typedef struct {
+    int fd;
+    ConnectionMode mode;
+    char *input;           // Bytes received but not yet handed to a worker
+    size_t input_length, input_capacity;
+    char *output;          // Responses not yet sent
+    size_t output_length, output_sent, output_capacity;
+    bool busy;             // One of its jobs is with a worker (responses stay in order)
+    bool read_blocked;     // Reading paused because too much output is queued (backpressure)
+    bool closing;          // No more input (peer hung up or protocol error)
+    bool hanging_up;       // Close once the queued output is sent (HTTP "Connection: close")
+    int ring;              // Its shared-memory ring in ring_server, plus one (0: none)
+} DaemonConnection;
+
+// Kinds of work handed from the event loop to the workers
+typedef enum {
+    JOB_TEXT,             // One text request line
+    JOB_BINARY_MUTATIONS, // A run of pipelined add/done/pending/delete frames
+    JOB_BINARY_LIST,      // One list frame, answered with streamed chunks
+    JOB_BINARY_COMMAND,   // One 'V' frame: a store command with its arguments
+    JOB_HTTP,             // One HTTP request (headers and body)
+    JOB_CHUNK             // Part of a streamed response on its way back (the job goes on)
+} JobKind;
+
+// Rendered JSON listing shared by every HTTP response that sends it (reference counted)
+typedef struct {
+    int references;
+    char *data;
+    size_t length;
+} RenderBuffer;
+
+// A job handed from the event loop to a worker, and back with its response
+typedef struct DaemonJob {
+    JobKind kind;
+    DaemonConnection *connection;
+    char *request;         // Request bytes, NUL-terminated (a line for JOB_TEXT)
+    size_t request_length;
+    char *response;        // Bytes to send back, already framed
+    size_t response_length;
+    RenderBuffer *shared;  // Sent after the response bytes, straight from the render cache
+    bool close_after;      // Close the connection once the response is sent
+    struct DaemonJob *next;
+} DaemonJob;
+
+// State shared between the event loop and the worker pool
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    DaemonJob *queue_head, *queue_tail;         // Jobs waiting for a worker
+    DaemonJob *completed_head, *completed_tail; // Responses waiting for the event loop, in order
+    int event_fd;                               // Signalled by workers when something completed
+    bool stopping;
+} DaemonQueue;
+
+// Serializes mutations of the store files; readers use store versions instead (see below)
+pthread_rwlock_t store_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Function to grow a byte buffer so it can hold 'needed' bytes
+bool reserveBuffer(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t grown = *capacity ? *capacity : 4096;
+    while (grown < needed) grown *= 2;
+    char *resized = (char *)realloc(*buffer, grown);
+    if (resized == NULL) {
+        return false;
+    }
+    *buffer = resized;
+    *capacity = grown;
+    return true;
+}
+
+// Function to append one frame to a growable buffer
+void appendFrame(char **buffer, size_t *length, size_t *capacity, char opcode, const void *payload, size_t payload_length) {
+    uint32_t frame_length = (uint32_t)(1 + payload_length);
+    if (!reserveBuffer(buffer, capacity, *length + 4 + frame_length)) {
+        return;
+    }
+    memcpy(*buffer + *length, &frame_length, 4);
+    (*buffer)[*length + 4] = opcode;
+    if (payload_length > 0) {
+        memcpy(*buffer + *length + 5, payload, payload_length);
+    }
+    *length += 4 + frame_length;
+}
+
+// Function to hand a finished (or partial) response back to the event loop
+void postCompletion(DaemonQueue *queue, DaemonJob *job) {
+    job->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->completed_tail != NULL) queue->completed_tail->next = job;
+    else queue->completed_head = job;
+    queue->completed_tail = job;
+    pthread_mutex_unlock(&queue->lock);
+    uint64_t one = 1;
+    if (write(queue->event_fd, &one, sizeof(one)) == -1) {
+        perror("Error waking the event loop");
+    }
+}
+
+// Immutable in-memory version of the store, shared by the daemon's readers
+// Writers publish a new version after every commit; readers pin the current one and read it
+// without taking store_lock, so a long listing never holds up a writer (and vice versa).
+typedef struct StoreVersion {
+    uint64_t generation;      // Increases with every published version
+    StoreStamp tasks, due;    // Files the version was loaded from
+    size_t parsed;            // Bytes of tasks.txt in the table (whole lines only)
+    TaskTable table;          // Tasks in file order
+    uint32_t *by_id;          // Table rows sorted by task ID
+    DueEntry *dues;           // Sorted by task ID
+    size_t due_count;
+    uint64_t retired_epoch;   // Global epoch when it was replaced
+    struct StoreVersion *next_retired;
+} StoreVersion;
+
+// Epoch-based reclamation of replaced versions
+// Each reading thread announces the global epoch in its own slot while it holds a version. A
+// version retired at epoch R can be freed once every announced epoch is above R: any reader that
+// started later loaded the newer pointer.
+#define VERSION_READER_SLOTS 256
+typedef struct {
+    uint64_t epoch;           // 0 while the thread holds no version
+    char padding[56];         // One slot per cache line
+} ReaderSlot;
+
+ReaderSlot reader_slots[VERSION_READER_SLOTS];
+int reader_slot_count = 0;
+__thread int reader_slot = -1;
+uint64_t global_epoch = 1;
+StoreVersion *current_version = NULL;
+StoreVersion *retired_versions = NULL;
+uint64_t version_generation = 0;
+pthread_mutex_t version_lock = PTHREAD_MUTEX_INITIALIZER; // Serializes publishing and reclaiming
+
+// Function to compare table rows by task ID (qsort_r context: the ID column)
+int compareRecordPositions(const void *a, const void *b, void *context) {
+    const int *ids = (const int *)context;
+    int idA = ids[*(const uint32_t *)a];
+    int idB = ids[*(const uint32_t *)b];
+    return (idA > idB) - (idA < idB);
+}
+
+// Slices of tasks.txt parsed in parallel by loadStoreVersion()
+#define VERSION_SLICE_SIZE 262144
+
+// Tasks parsed from one slice of tasks.txt
+typedef struct {
+    size_t start, stop;      // Line boundaries found before parsing (parsing overwrites newlines)
+    size_t parsed;           // Offset past its last whole line
+    TaskTable table;
+    bool sorted;             // IDs increase within the slice
+} VersionSlice;
+
+// A tasks.txt image being parsed slice by slice
+typedef struct {
+    char *text;
+    size_t length;
+    VersionSlice *slices;
+} VersionParse;
+
+// Function to find the first line that starts at or after an offset
+size_t lineStartAfter(const char *text, size_t length, size_t offset) {
+    if (offset == 0 || offset >= length) {
+        return offset < length ? offset : length;
+    }
+    const char *newline = (const char *)memchr(text + offset - 1, '\n', length - offset + 1);
+    return newline == NULL ? length : (size_t)(newline - text) + 1;
+}
+
+// Function to parse the whole lines of text[start, stop) onto the end of a task table
+// Lines are cut at their newline in place and a trailing line without one (an append in
+// progress) is left out. *sorted is cleared if the IDs stop increasing. Returns the offset past
+// the last whole line.
+size_t parseTaskLines(char *text, size_t start, size_t stop, TaskTable *table, bool *sorted) {
+    char *line = text + start;
+    while (line < text + stop) {
+        char *newline = (char *)memchr(line, '\n', (size_t)(text + stop - line));
+        if (newline == NULL) {
+            break; // Partial last line
+        }
+        *newline = '\0';
+        int id, status, offset = 0;
+        if (sscanf(line, "%d,%d,%n", &id, &status, &offset) == 2 && offset > 0 && line[offset] != '\0') {
+            *sorted = *sorted && (table->count == 0 || table->ids[table->count - 1] < id);
+            appendTaskRow(table, id, status == 1, line + offset, (size_t)(newline - line - offset));
+        }
+        line = newline + 1;
+    }
+    return (size_t)(line - text);
+}
+
+// Function to parse a range of slices (a parallelFor body)
+// A slice owns the lines that start inside it, so every line is parsed exactly once.
+void parseVersionSlices(void *arg, size_t begin, size_t end) {
+    VersionParse *parse = (VersionParse *)arg;
+    for (size_t index = begin; index < end; index++) {
+        VersionSlice *slice = &parse->slices[index];
+        reserveTaskTable(&slice->table, (slice->stop - slice->start) / 16 + 1, 0); // Records are at least "1,0,x\n"
+        slice->sorted = true;
+        slice->parsed = parseTaskLines(parse->text, slice->start, slice->stop, &slice->table, &slice->sorted);
+    }
+}
+
+// Function to read the due dates into a version, sorted by ID
+void loadVersionDues(StoreVersion *version) {
+    version->due = stampStoreFile(DUE_FILENAME);
+    version->dues = loadDueEntries(task_dir_fd, &version->due_count);
+    if (version->due_count > 1) {
+        qsort(version->dues, version->due_count, sizeof(DueEntry), compareDueEntriesById);
+    }
+}
+
+// Function to load a version from the task files
+// Only the bytes present when the file was opened are read, and a trailing line without its
+// newline (an append in progress) is left out, so concurrent writers are never seen half-way.
+StoreVersion *loadStoreVersion() {
+    StoreVersion *version = (StoreVersion *)calloc(1, sizeof(StoreVersion));
+    loadVersionDues(version);
+
+    version->tasks.size = -1;
+    int fd = openStoreFile(TASK_FILENAME, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) close(fd);
+        return version;
+    }
+    version->tasks = stampFromStat(&st);
+    char *text = (char *)malloc((size_t)st.st_size + 1);
+    size_t length = 0;
+    while (length < (size_t)st.st_size) {
+        ssize_t got = read(fd, text + length, (size_t)st.st_size - length);
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    close(fd);
+    text[length] = '\0';
+    countMetric(COUNTER_STORE_READ, length);
+    countMetric(COUNTER_VERSION_LOADS, 1);
+
+    // Parse slices on the executor, then stitch them together in file order
+    size_t slice_count = length / VERSION_SLICE_SIZE + 1;
+    VersionParse parse = {text, length, (VersionSlice *)calloc(slice_count, sizeof(VersionSlice))};
+    for (size_t i = 0; i < slice_count; i++) {
+        parse.slices[i].start = i == 0 ? 0 : parse.slices[i - 1].stop;
+        parse.slices[i].stop = lineStartAfter(text, length, (i + 1) * VERSION_SLICE_SIZE);
+    }
+    parallelFor(slice_count, 1, parseVersionSlices, &parse);
+    free(text); // Descriptions were copied into the slices' tables
+    TaskTable *table = &version->table;
+    size_t total = 0, arena_total = 0;
+    for (size_t i = 0; i < slice_count; i++) {
+        total += parse.slices[i].table.count;
+        arena_total += parse.slices[i].table.arena_length;
+    }
+    reserveTaskTable(table, total + 1, arena_total + 1);
+    bool sorted = true;
+    for (size_t i = 0; i < slice_count; i++) {
+        VersionSlice *slice = &parse.slices[i];
+        if (slice->stop > slice->start) {
+            version->parsed = slice->parsed;
+        }
+        if (slice->table.count > 0) {
+            sorted = sorted && slice->sorted && (table->count == 0 || table->ids[table->count - 1] < slice->table.ids[0]);
+            appendTaskTable(table, &slice->table);
+        }
+        freeTaskTable(&slice->table);
+    }
+    free(parse.slices);
+    sealTaskTable(table);
+
+    version->by_id = (uint32_t *)malloc((table->count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < table->count; i++) version->by_id[i] = (uint32_t)i;
+    if (!sorted) { // tasks.txt is normally in ID order already
+        qsort_r(version->by_id, table->count, sizeof(uint32_t), compareRecordPositions, table->ids);
+    }
+    return version;
+}
+
+// Function to build a version from the previous one when tasks were only appended to tasks.txt
+// addTasks() is the only writer that changes tasks.txt in place; every other one replaces it with
+// rename(). So while the inode is the same, the file did not shrink and a newline still ends the
+// bytes the old version parsed, those rows are unchanged: they are copied and only the new bytes
+// are parsed. Returns NULL otherwise, and the caller loads the version from scratch.
+StoreVersion *extendStoreVersion(const StoreVersion *old) {
+    int fd = old->tasks.size >= 0 ? openStoreFile(TASK_FILENAME, O_RDONLY) : -1;
+    struct stat st;
+    char last = '\n';
+    if (fd == -1 || fstat(fd, &st) == -1 || (uint64_t)st.st_ino != old->tasks.inode ||
+        st.st_size < old->tasks.size || (old->parsed > 0 && (pread(fd, &last, 1, (off_t)old->parsed - 1) != 1 || last != '\n'))) {
+        if (fd != -1) close(fd);
+        return NULL;
+    }
+    StoreVersion *version = (StoreVersion *)calloc(1, sizeof(StoreVersion));
+    version->tasks = stampFromStat(&st);
+    size_t wanted = (size_t)st.st_size - old->parsed, length = 0;
+    char *text = (char *)malloc(wanted + 1);
+    while (length < wanted) {
+        ssize_t got = pread(fd, text + length, wanted - length, (off_t)(old->parsed + length));
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    close(fd);
+    text[length] = '\0';
+    countMetric(COUNTER_STORE_READ, length);
+    countMetric(COUNTER_VERSION_EXTENDS, 1);
+
+    TaskTable *table = &version->table;
+    copyTaskTable(table, &old->table);
+    bool sorted = true;
+    version->parsed = old->parsed + parseTaskLines(text, 0, length, table, &sorted);
+    free(text);
+    sealTaskTable(table);
+
+    // The index stays sorted if the first new ID is above every old one
+    size_t old_count = old->table.count;
+    version->by_id = (uint32_t *)malloc((table->count + 1) * sizeof(uint32_t));
+    memcpy(version->by_id, old->by_id, old_count * sizeof(uint32_t));
+    for (size_t i = old_count; i < table->count; i++) version->by_id[i] = (uint32_t)i;
+    if (!sorted || (old_count > 0 && table->count > old_count && table->ids[old_count] <= table->ids[old->by_id[old_count - 1]])) {
+        qsort_r(version->by_id, table->count, sizeof(uint32_t), compareRecordPositions, table->ids);
+    }
+
+    StoreStamp due = stampStoreFile(DUE_FILENAME);
+    if (stampsEqual(&due, &old->due)) {
+        version->due = due;
+        version->due_count = old->due_count;
+        version->dues = (DueEntry *)malloc((old->due_count + 1) * sizeof(DueEntry));
+        memcpy(version->dues, old->dues, old->due_count * sizeof(DueEntry));
+    } else {
+        loadVersionDues(version);
+    }
+    return version;
+}
+
+// Function to free a version
+void freeStoreVersion(StoreVersion *version) {
+    freeTaskTable(&version->table);
+    free(version->by_id);
+    free(version->dues);
+    free(version);
+}
+
+// Function to tell whether a version still matches the files on disk
+bool storeVersionIsCurrent(const StoreVersion *version) {
+    StoreStamp tasks = stampStoreFile(TASK_FILENAME);
+    StoreStamp due = stampStoreFile(DUE_FILENAME);
+    return stampsEqual(&tasks, &version->tasks) && stampsEqual(&due, &version->due);
+}
+
+// Function to publish a new version if the files changed since the current one was loaded
+// Writers call it (holding store_lock) after every commit, so their clients read their writes.
+void refreshStoreVersion() {
+    pthread_mutex_lock(&version_lock);
+    StoreVersion *old = current_version;
+    if (old != NULL && storeVersionIsCurrent(old)) {
+        pthread_mutex_unlock(&version_lock);
+        return;
+    }
+    StoreVersion *version = old != NULL ? extendStoreVersion(old) : NULL;
+    if (version == NULL) {
+        version = loadStoreVersion();
+    }
+    version->generation = ++version_generation;
+    __atomic_store_n(&current_version, version, __ATOMIC_SEQ_CST);
+
+    if (old != NULL) {
+        old->retired_epoch = __atomic_fetch_add(&global_epoch, 1, __ATOMIC_SEQ_CST);
+        old->next_retired = retired_versions;
+        retired_versions = old;
+    }
+    // Free every retired version no reader can still hold
+    uint64_t oldest = UINT64_MAX;
+    int slots = __atomic_load_n(&reader_slot_count, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < slots && i < VERSION_READER_SLOTS; i++) {
+        uint64_t epoch = __atomic_load_n(&reader_slots[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    for (StoreVersion **link = &retired_versions; *link != NULL;) {
+        if ((*link)->retired_epoch < oldest) {
+            StoreVersion *freed = *link;
+            *link = freed->next_retired;
+            freeStoreVersion(freed);
+        } else {
+            link = &(*link)->next_retired;
+        }
+    }
+    pthread_mutex_unlock(&version_lock);
+}
+
+// Function to pin the current version for reading; release it with unpinStoreVersion()
+// If the files were changed behind the daemon's back the version is reloaded first, unless
+// 'reload' is false (the event loop must not stall): then NULL is returned instead.
+StoreVersion *pinStoreVersion(bool reload) {
+    if (reader_slot == -1) {
+        reader_slot = __atomic_fetch_add(&reader_slot_count, 1, __ATOMIC_SEQ_CST);
+        if (reader_slot >= VERSION_READER_SLOTS) {
+            fprintf(stderr, "Error: too many daemon threads.\n");
+            abort();
+        }
+    }
+    uint64_t *announced = &reader_slots[reader_slot].epoch;
+    for (int attempt = 0;; attempt++) {
+        __atomic_store_n(announced, __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        StoreVersion *version = __atomic_load_n(&current_version, __ATOMIC_SEQ_CST);
+        if (version != NULL && (attempt > 0 || storeVersionIsCurrent(version))) {
+            return version;
+        }
+        __atomic_store_n(announced, 0, __ATOMIC_SEQ_CST);
+        if (!reload) {
+            return NULL;
+        }
+        refreshStoreVersion();
+    }
+}
+
+// Function to release the version pinned by this thread
+void unpinStoreVersion() {
+    __atomic_store_n(&reader_slots[reader_slot].epoch, 0, __ATOMIC_SEQ_CST);
+}
+
+// Function to find where task ID 'id' is, or would be, in a version's ID index
+// The index is immutable once published, so lookups and range scans need no locks at all and
+// scale with the number of reading threads.
+size_t versionLowerBound(const StoreVersion *version, int id) {
+    size_t low = 0, high = version->table.count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (version->table.ids[version->by_id[middle]] < id) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// Function to find the table row of a task in a version by ID
+// Returns false if it doesn't exist.
+bool findVersionTask(const StoreVersion *version, int id, size_t *row) {
+    size_t position = versionLowerBound(version, id);
+    if (position < version->table.count && version->table.ids[version->by_id[position]] == id) {
+        *row = version->by_id[position];
+        return true;
+    }
+    return false;
+}
+
+// Function to get the rows of a version to visit for an ID range
+// Sets *positions to the ID index (NULL for all rows in file order) and [*first, *last)
+// to the range within it.
+void versionRange(const StoreVersion *version, int low, int high, const uint32_t **positions, size_t *first, size_t *last) {
+    if (low <= 1 && high == INT_MAX) {
+        *positions = NULL;
+        *first = 0;
+        *last = version->table.count;
+        return;
+    }
+    *positions = version->by_id;
+    *first = versionLowerBound(version, low);
+    *last = high == INT_MAX ? version->table.count : versionLowerBound(version, high + 1);
+}
+
+// Function to find the due entry of a task in a version (NULL if it has none)
+const DueEntry *findVersionDue(const StoreVersion *version, int id) {
+    DueEntry key = {0, id};
+    return version->due_count > 0 ? (const DueEntry *)bsearch(&key, version->dues, version->due_count, sizeof(DueEntry), compareDueEntriesById) : NULL;
+}
+
+// Function to print the task list from a version, exactly like listTasks()
+// An ID range is a binary search plus a scan of just the matching part of the ID index.
+void listStoreVersion(FILE *out, const StoreVersion *version, int low, int high) {
+    if (version->tasks.size == -1) {
+        fprintf(out, "No tasks found. Create one using 'add' command.\n");
+        return;
+    }
+    fprintf(out, "\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    const uint32_t *positions;
+    size_t first, last;
+    versionRange(version, low, high, &positions, &first, &last);
+    const TaskTable *table = &version->table;
+    for (size_t i = first; i < last; i++) {
+        size_t row = positions != NULL ? positions[i] : i;
+        TASAKMAN_PROBE2(list__record, table->ids[row], taskDone(table, row));
+        printTaskRow(out, table->ids[row], taskDone(table, row), taskDescription(table, row), findVersionDue(version, table->ids[row]));
+    }
+    if (first == last) {
+        fprintf(out, "No tasks found.\n");
+    }
+    fprintf(out, "%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+}
+
+// Function to print a sorted and/or limited listing from a version ('list --sort-by/--limit')
+// Rows are visited in ID order and only point into the version, so nothing is copied.
+void listStoreVersionSorted(FILE *out, const StoreVersion *version, const ListOptions *options) {
+    if (version->tasks.size == -1) {
+        fprintf(out, "No tasks found. Create one using 'add' command.\n");
+        return;
+    }
+    const uint32_t *positions;
+    size_t first, last, creation_count = 0;
+    versionRange(version, options->low, options->high, &positions, &first, &last);
+    CreationEntry *creations = options->sort == SORT_CREATED ? loadCreationEntries(&creation_count) : NULL;
+    const TaskTable *table = &version->table;
+    SortedListing listing = {options->sort, options->limit, false, NULL, 0, 0};
+    for (size_t i = first; i < last && !sortedListingFull(&listing); i++) {
+        size_t row = positions != NULL ? positions[i] : i;
+        const DueEntry *due = findVersionDue(version, table->ids[row]);
+        SortedRow sorted = {0, table->ids[row], taskDone(table, row), due != NULL ? due->due : 0, taskDescription(table, row)};
+        sorted.key = sortedRowKey(options->sort, sorted.done, sorted.due,
+                                  creations != NULL ? findCreationTime(creations, creation_count, sorted.id) : -1);
+        sortedListingAdd(&listing, &sorted);
+    }
+    free(creations);
+    sortedListingFinish(&listing);
+    printSortedListing(out, &listing);
+}
+
+// Function to run one store command on a worker thread
+// A text request is a line in the command-line syntax ("done 4 7", "add Buy milk"), answered
+// with "<status> <length>\n" and the text the command would have printed. A 'V' frame carries
+// the arguments NUL-separated and is answered with an 'O' frame.
+void runDaemonRequest(DaemonJob *job) {
+    char **argv = (char **)malloc((job->request_length + 3) * sizeof(char *)); // At most one argument per byte
+    int argc = 0;
+    argv[argc++] = (char *)"tasakman";
+    if (job->kind == JOB_BINARY_COMMAND) {
+        for (size_t offset = 5; offset < job->request_length; offset += strlen(job->request + offset) + 1) {
+            argv[argc++] = job->request + offset;
+        }
+    } else {
+        char *save = NULL;
+        for (char *token = strtok_r(job->request, " \t\r", &save); token != NULL; token = strtok_r(NULL, " \t\r", &save)) {
+            argv[argc++] = token;
+        }
+    }
+    argv[argc] = NULL;
+
+    char *text = NULL;
+    size_t text_length = 0;
+    int status;
+    FILE *out = open_memstream(&text, &text_length);
+    if (argc < 2) {
+        fprintf(out, "Empty request.\n");
+        status = 1;
+    } else if (strcmp(argv[1], "metrics") == 0) { // Needs no store access
+        bool prometheus = argc > 2 && strcmp(argv[2], "--prometheus") == 0;
+        status = 0;
+        if (argc > 2 + (int)prometheus) {
+            fprintf(out, "Usage: tasakman metrics [--prometheus]\n");
+            status = 1;
+        } else {
+            printMetrics(out, prometheus);
+        }
+    } else if (strcmp(argv[1], "list") == 0) {
+        request_metric = METRIC_LIST;
+        ListOptions options;
+        status = 1;
+        if (parseListOptions("tasakman", argc, argv, &options, out)) {
+            StoreVersion *version = pinStoreVersion(true);
+            if (options.sort == SORT_NONE && options.limit == 0) {
+                listStoreVersion(out, version, options.low, options.high);
+            } else {
+                listStoreVersionSorted(out, version, &options);
+            }
+            unpinStoreVersion();
+            status = 0;
+        }
+    } else {
+        request_metric = metricOpByName(argv[1]);
+        pthread_rwlock_wrlock(&store_lock);
+        status = runStoreCommand("tasakman", argc, argv, out);
+        refreshStoreVersion();
+        pthread_rwlock_unlock(&store_lock);
+        if (status == -1) {
+            fprintf(out, "Unknown command: %s\n", argv[1]);
+            status = 1;
+        }
+    }
+    fclose(out);
+    free(argv);
+
+    if (job->kind == JOB_BINARY_COMMAND) {
+        char *payload = (char *)malloc(4 + text_length);
+        int32_t code = status;
+        memcpy(payload, &code, 4);
+        memcpy(payload + 4, text, text_length);
+        size_t capacity = 0;
+        appendFrame(&job->response, &job->response_length, &capacity, 'O', payload, 4 + text_length);
+        free(payload);
+        free(text);
+        return;
+    }
+    char header[48];
+    int header_length = snprintf(header, sizeof(header), "%d %zu\n", status, text_length);
+    job->response = (char *)malloc(header_length + text_length);
+    memcpy(job->response, header, header_length);
+    memcpy(job->response + header_length, text, text_length);
+    job->response_length = header_length + text_length;
+    free(text);
+}
+
+// Function to answer a binary list request, streaming rows back in chunks as they are read
+// so the client can render the first rows while the rest of the file is still being scanned.
+void runBinaryList(DaemonQueue *queue, DaemonJob *job) {
+    request_metric = METRIC_LIST;
+    int filter = job->request_length > 5 ? (unsigned char)job->request[5] : 0;
+    char *chunk = NULL;
+    size_t chunk_length = 0, chunk_capacity = 0;
+    uint32_t rows = 0;
+
+    StoreVersion *version = pinStoreVersion(true);
+    const TaskTable *table = &version->table;
+    for (size_t i = 0; i < table->count; i++) {
+        bool done = taskDone(table, i);
+        if ((filter == 1 && done) || (filter == 2 && !done)) {
+            continue;
+        }
+        TASAKMAN_PROBE2(list__record, table->ids[i], done);
+        size_t description_length = table->texts[i].length;
+        uint16_t length = (uint16_t)(description_length < UINT16_MAX ? description_length : UINT16_MAX);
+        if (chunk_length == 0) { // Start a new 'T' frame; its length is patched in when sent
+            chunk_length = 5;
+        }
+        if (!reserveBuffer(&chunk, &chunk_capacity, chunk_length + 7 + length)) {
+            break;
+        }
+        chunk[4] = 'T';
+        uint32_t row_id = (uint32_t)table->ids[i];
+        memcpy(chunk + chunk_length, &row_id, 4);
+        chunk[chunk_length + 4] = (char)done;
+        memcpy(chunk + chunk_length + 5, &length, 2);
+        memcpy(chunk + chunk_length + 7, taskDescription(table, i), length);
+        chunk_length += 7 + length;
+        rows++;
+
+        if (chunk_length >= WIRE_LIST_CHUNK) { // Ship this chunk now
+            uint32_t frame_length = (uint32_t)(chunk_length - 4);
+            memcpy(chunk, &frame_length, 4);
+            DaemonJob *part = (DaemonJob *)calloc(1, sizeof(DaemonJob));
+            part->kind = JOB_CHUNK;
+            part->connection = job->connection;
+            part->response = chunk;
+            part->response_length = chunk_length;
+            postCompletion(queue, part);
+            chunk = NULL;
+            chunk_length = chunk_capacity = 0;
+        }
+    }
+    unpinStoreVersion();
+
+    if (chunk_length > 0) {
+        uint32_t frame_length = (uint32_t)(chunk_length - 4);
+        memcpy(chunk, &frame_length, 4);
+    }
+    appendFrame(&chunk, &chunk_length, &chunk_capacity, 'E', &rows, 4);
+    job->response = chunk;
+    job->response_length = chunk_length;
+}
+
+// Function to tell whether an 'A' frame has no description (rejected like an empty 'add')
+bool emptyAddFrame(const char *payload, size_t length) {
+    return length == 0 || payload[0] == '\0';
+}
+
+// Function to copy a description out of a frame into an arena, keeping it on one line and within bounds
+char *frameDescription(Arena *arena, const char *payload, size_t length) {
+    if (length > MAX_DESCRIPTION_LEN - 1) {
+        length = MAX_DESCRIPTION_LEN - 1;
+    }
+    char *description = (char *)arenaAlloc(arena, length + 1);
+    memcpy(description, payload, length);
+    description[length] = '\0';
+    for (char *c = description; *c != '\0'; c++) {
+        if (*c == '\n' || *c == '\r') *c = ' ';
+    }
+    return description;
+}
+
+// Function to commit the mutation frames of several jobs together (group commit)
+// All adds are appended with one write and all status changes and deletions are applied with
+// one rewrite, however many requests and clients they came from. Adds are applied first.
+void commitBinaryGroup(DaemonJob **jobs, size_t job_count) {
+    // First pass: size the batches
+    size_t add_count = 0, mutation_count = 0;
+    for (size_t j = 0; j < job_count; j++) {
+        for (size_t offset = 0; offset < jobs[j]->request_length;) {
+            uint32_t frame_length;
+            memcpy(&frame_length, jobs[j]->request + offset, 4);
+            if (jobs[j]->request[offset + 4] == 'A') add_count++;
+            else mutation_count += (frame_length - 1) / 4;
+            offset += 4 + frame_length;
+        }
+    }
+
+    // Second pass: collect them
+    Arena *arena = scratchArena();
+    char **descriptions = (char **)arenaAlloc(arena, (add_count + 1) * sizeof(char *));
+    int *ids = (int *)arenaAlloc(arena, (add_count + 1) * sizeof(int));
+    Mutation *mutations = (Mutation *)arenaAlloc(arena, (mutation_count + 1) * sizeof(Mutation));
+    size_t a = 0, m = 0;
+    for (size_t j = 0; j < job_count; j++) {
+        for (size_t offset = 0; offset < jobs[j]->request_length;) {
+            uint32_t frame_length;
+            memcpy(&frame_length, jobs[j]->request + offset, 4);
+            char opcode = jobs[j]->request[offset + 4];
+            const char *payload = jobs[j]->request + offset + 5;
+            if (opcode == 'A') {
+                if (!emptyAddFrame(payload, frame_length - 1)) {
+                    descriptions[a++] = frameDescription(arena, payload, frame_length - 1);
+                }
+            } else {
+                for (size_t k = 0; k + 4 <= frame_length - 1; k += 4) {
+                    uint32_t id;
+                    memcpy(&id, payload + k, 4);
+                    mutations[m].id = (int)id;
+                    mutations[m++].op = opcode;
+                }
+            }
+            offset += 4 + frame_length;
+        }
+    }
+
+    add_count = a; // Without the empty descriptions
+    UniquePolicy policy = add_count == 0 ? UNIQUE_OFF : uniquePolicy();
+    bool *duplicates = (bool *)arenaAlloc(arena, add_count + 1);
+    bool added = add_count == 0 || addTasks(descriptions, add_count, ids, policy, duplicates);
+    bool applied = mutation_count == 0 || applyMutations(mutations, mutation_count);
+
+    // Third pass: answer every frame in order
+    a = m = 0;
+    for (size_t j = 0; j < job_count; j++) {
+        DaemonJob *job = jobs[j];
+        size_t capacity = 0;
+        for (size_t offset = 0; offset < job->request_length;) {
+            uint32_t frame_length;
+            memcpy(&frame_length, job->request + offset, 4);
+            char result[8 + WIRE_MAX_FRAME / 4];
+            int32_t status;
+            size_t result_length = 4;
+            if (job->request[offset + 4] == 'A' && emptyAddFrame(job->request + offset + 5, frame_length - 1)) {
+                status = 1;
+                memset(result + 4, 0, 4); // No ID
+                result_length += 4;
+            } else if (job->request[offset + 4] == 'A') {
+                status = !added ? 1 : !duplicates[a] ? 0 : policy == UNIQUE_MERGE ? 3 : 2;
+                memcpy(result + 4, &ids[a++], 4);
+                result_length += 4;
+            } else {
+                status = applied ? 0 : 1;
+                for (size_t k = 0; k + 4 <= frame_length - 1; k += 4) {
+                    result[result_length++] = (char)(applied && mutations[m].found);
+                    m++;
+                }
+            }
+            memcpy(result, &status, 4);
+            appendFrame(&job->response, &job->response_length, &capacity, 'R', result, result_length);
+            offset += 4 + frame_length;
+        }
+    }
+}
+
+// Shared-memory rings
+// A batch client that asks for one ('M' frame) gets a memfd shared with the daemon instead of
+// talking through the socket: requests and answers are fixed-layout slots written in place, and
+// either side publishes its progress with one atomic store. Both sides poll for a while before
+// sleeping on a futex, and only wake the other side if it sleeps, so a client sending requests
+// back to back does no system calls at all. Request n (counting from 0) and then its answer live
+// in slot n % RING_SLOTS; the client keeps at most RING_SLOTS requests unanswered.
+#define RING_MAGIC 0x52544B54    // "TKTR"
+
+// One request and its answer (the fields of an 'A'/'C'/'P'/'X' frame and of its 'R' frame)
+typedef struct {
+    uint32_t op;                 // 'A', 'C', 'P' or 'X'
+    uint32_t length;             // Bytes of the description for 'A', IDs for the others
+    union {
+        char description[MAX_DESCRIPTION_LEN];
+        int32_t ids[RING_MAX_IDS];
+    };
+    int32_t status;              // Written by the daemon: as in an 'R' frame
+    int32_t id;                  // New (or duplicated) task ID for 'A'
+    uint8_t found[RING_MAX_IDS]; // Whether each ID was found
+} RingSlot;
+
+// The shared memory (counters are free-running and wrap)
+typedef struct {
+    uint32_t magic, slot_count;
+    char padding1[56];
+    uint32_t submitted;          // Requests written (only the client writes it)
+    uint32_t daemon_sleeping;    // The daemon sleeps, or is about to, on 'submitted'
+    char padding2[56];           // Keep each side's counter on its own cache line
+    uint32_t answered;           // Requests answered (only the daemon writes it)
+    uint32_t client_sleeping;    // The client sleeps, or is about to, on 'answered'
+    char padding3[56];
+    RingSlot slots[RING_SLOTS];
+} SharedRing;
+
+// Function to get how long to poll a ring before sleeping: polling only pays if the other side
+// runs on another CPU meanwhile
+int ringSpin() {
+    static int spin = -1;
+    if (spin == -1) {
+        spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_SPIN : 0;
+    }
+    return spin;
+}
+
+// Function to tell the CPU we are spinning on memory another core writes
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Function to wake whoever sleeps on a shared (or, with 'private_word', process-private) futex
+void futexWake(uint32_t *word, bool private_word) {
+    syscall(SYS_futex, word, private_word ? FUTEX_WAKE_PRIVATE : FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+// Function to publish a ring counter and wake the other side if it sleeps on it
+// Both stores and loads are sequentially consistent: either the sleeper sees the new value
+// before going to sleep, or we see its flag and wake it.
+void ringPublish(uint32_t *counter, uint32_t value, uint32_t *sleeping) {
+    __atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleeping, __ATOMIC_SEQ_CST)) {
+        futexWake(counter, false);
+    }
+}
+
+// The daemon's side of every ring: one thread answers all of them
+struct {
+    pthread_mutex_t lock;
+    SharedRing *rings[RING_MAX_CLIENTS];  // NULL: free
+    bool closing[RING_MAX_CLIENTS];       // The client's connection closed: unmap the ring
+    uint32_t changes;                     // Futex bumped whenever rings come or go, or on stopping
+    bool started, stopping;
+    pthread_t thread;
+    uint64_t answered;                    // Requests answered on every ring so far
+} ring_server = {PTHREAD_MUTEX_INITIALIZER, {NULL}, {false}, 0, false, false, pthread_t(), 0};
+
+// One ring request collected for a commit
+typedef struct {
+    RingSlot *slot;
+    char op;
+    bool valid;
+    uint32_t count;  // IDs (for 'C', 'P' and 'X')
+    size_t first;    // Index of its description or first mutation
+} RingWork;
+
+// Function to answer the requests waiting on the rings, committed together like a group of frames
+// 'served' is the daemon's own count of requests answered on each ring; 'pending' how many wait.
+void commitRings(SharedRing **rings, uint32_t *served, const uint32_t *pending, size_t total) {
+    uint64_t started = metricClock();
+    Arena *arena = scratchArena();
+    RingWork *work = (RingWork *)arenaAlloc(arena, total * sizeof(RingWork));
+    char **descriptions = (char **)arenaAlloc(arena, total * sizeof(char *));
+    int *ids = (int *)arenaAlloc(arena, total * sizeof(int));
+    Mutation *mutations = (Mutation *)arenaAlloc(arena, total * RING_MAX_IDS * sizeof(Mutation));
+    size_t w = 0, add_count = 0, mutation_count = 0;
+    for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+        for (uint32_t k = 0; k < pending[r]; k++, w++) {
+            // The client can scribble on the slot at any time: read each field once
+            RingSlot *slot = &rings[r]->slots[(served[r] + k) % RING_SLOTS];
+            work[w].slot = slot;
+            work[w].op = (char)__atomic_load_n(&slot->op, __ATOMIC_RELAXED);
+            work[w].count = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+            if (work[w].op == 'A') {
+                work[w].valid = work[w].count <= MAX_DESCRIPTION_LEN && !emptyAddFrame(slot->description, work[w].count);
+                if (work[w].valid) {
+                    work[w].first = add_count;
+                    descriptions[add_count++] = frameDescription(arena, slot->description, work[w].count);
+                }
+            } else {
+                work[w].valid = (work[w].op == 'C' || work[w].op == 'P' || work[w].op == 'X') &&
+                                work[w].count >= 1 && work[w].count <= RING_MAX_IDS;
+                if (work[w].valid) {
+                    work[w].first = mutation_count;
+                    for (uint32_t i = 0; i < work[w].count; i++) {
+                        mutations[mutation_count].id = slot->ids[i];
+                        mutations[mutation_count++].op = work[w].op;
+                    }
+                }
+            }
+        }
+    }
+
+    UniquePolicy policy = add_count == 0 ? UNIQUE_OFF : uniquePolicy();
+    bool *duplicates = (bool *)arenaAlloc(arena, add_count + 1);
+    bool added = true, applied = true;
+    if (add_count > 0 || mutation_count > 0) { // Otherwise every request was malformed
+        pthread_rwlock_wrlock(&store_lock);
+        added = add_count == 0 || addTasks(descriptions, add_count, ids, policy, duplicates);
+        applied = mutation_count == 0 || applyMutations(mutations, mutation_count);
+        refreshStoreVersion();
+        pthread_rwlock_unlock(&store_lock);
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        RingSlot *slot = work[i].slot;
+        if (!work[i].valid) {
+            slot->status = 1;
+            slot->id = 0;
+            memset(slot->found, 0, sizeof(slot->found));
+        } else if (work[i].op == 'A') {
+            size_t a = work[i].first;
+            slot->status = !added ? 1 : !duplicates[a] ? 0 : policy == UNIQUE_MERGE ? 3 : 2;
+            slot->id = ids[a];
+        } else {
+            slot->status = applied ? 0 : 1;
+            for (uint32_t k = 0; k < work[i].count; k++) {
+                slot->found[k] = applied && mutations[work[i].first + k].found;
+            }
+        }
+        if (work[i].valid) {
+            recordLatency(work[i].op == 'A' ? METRIC_ADD : work[i].op == 'C' ? METRIC_DONE :
+                          work[i].op == 'P' ? METRIC_PENDING : METRIC_DELETE, started);
+        }
+    }
+    for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+        if (pending[r] > 0) {
+            served[r] += pending[r];
+            ringPublish(&rings[r]->answered, served[r], &rings[r]->client_sleeping);
+        }
+    }
+    __atomic_add_fetch(&ring_server.answered, total, __ATOMIC_RELAXED);
+}
+
+// Function to count the requests waiting on each ring; a ring whose client submitted more than
+// it may is dropped (its client then waits for answers that never come)
+size_t pendingRingRequests(SharedRing *const *rings, const uint32_t *served, bool *dropped, uint32_t *pending) {
+    size_t total = 0;
+    for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+        pending[r] = 0;
+        if (rings[r] != NULL && !dropped[r]) {
+            pending[r] = __atomic_load_n(&rings[r]->submitted, __ATOMIC_SEQ_CST) - served[r];
+            if (pending[r] > RING_SLOTS) {
+                dropped[r] = true;
+                pending[r] = 0;
+            }
+            total += pending[r];
+        }
+    }
+    return total;
+}
+
+// Function run by the ring thread: answer requests on every ring until the daemon stops
+void *serveRings(void *arg) {
+    (void)arg;
+    Arena arena; // Reset after every commit
+    memset(&arena, 0, sizeof(arena));
+    current_arena = &arena;
+    SharedRing *rings[RING_MAX_CLIENTS] = {NULL}; // This thread's copy of ring_server.rings
+    uint32_t served[RING_MAX_CLIENTS] = {0}, pending[RING_MAX_CLIENTS];
+    bool dropped[RING_MAX_CLIENTS] = {false};
+    for (;;) {
+        uint32_t changes = __atomic_load_n(&ring_server.changes, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&ring_server.lock);
+        bool stopping = ring_server.stopping;
+        for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+            if (ring_server.closing[r]) {
+                munmap(ring_server.rings[r], sizeof(SharedRing));
+                ring_server.rings[r] = NULL;
+                ring_server.closing[r] = false;
+            }
+            if (ring_server.rings[r] != rings[r]) { // A ring came or went
+                rings[r] = ring_server.rings[r];
+                served[r] = 0;
+                dropped[r] = false;
+            }
+        }
+        pthread_mutex_unlock(&ring_server.lock);
+        if (stopping) {
+            break;
+        }
+
+        // Poll for a while, then sleep on every ring and on 'changes' at once
+        size_t total = pendingRingRequests(rings, served, dropped, pending);
+        for (int spin = 0, spins = ringSpin(); total == 0 && spin < spins; spin++) {
+            cpuRelax();
+            if (__atomic_load_n(&ring_server.changes, __ATOMIC_RELAXED) != changes) break;
+            total = pendingRingRequests(rings, served, dropped, pending);
+        }
+        if (total == 0) {
+            struct futex_waitv waiters[RING_MAX_CLIENTS + 1];
+            memset(waiters, 0, sizeof(waiters));
+            unsigned count = 0;
+            for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+                if (rings[r] != NULL && !dropped[r]) {
+                    __atomic_store_n(&rings[r]->daemon_sleeping, 1, __ATOMIC_SEQ_CST);
+                    waiters[count].uaddr = (uintptr_t)&rings[r]->submitted;
+                    waiters[count].val = served[r];
+                    waiters[count++].flags = FUTEX_32;
+                }
+            }
+            waiters[count].uaddr = (uintptr_t)&ring_server.changes;
+            waiters[count].val = changes;
+            waiters[count++].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+            if (pendingRingRequests(rings, served, dropped, pending) == 0) { // Submitted before seeing our flag?
+                syscall(SYS_futex_waitv, waiters, count, 0, NULL, CLOCK_MONOTONIC);
+            }
+            for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+                if (rings[r] != NULL) __atomic_store_n(&rings[r]->daemon_sleeping, 0, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+        commitRings(rings, served, pending, total);
+        arenaReset(&arena, true);
+    }
+    for (int r = 0; r < RING_MAX_CLIENTS; r++) {
+        if (rings[r] != NULL) munmap(rings[r], sizeof(SharedRing));
+    }
+    arenaReset(&arena, false);
+    return NULL;
+}
+
+// Function to tell the ring thread that the rings changed (or that the daemon stops)
+void signalRingServer() {
+    __atomic_add_fetch(&ring_server.changes, 1, __ATOMIC_SEQ_CST);
+    futexWake(&ring_server.changes, true);
+}
+
+// Function to set up a shared-memory ring for a connection that sent an 'M' frame
+// Replies with an 'M' frame carrying the ring's memfd, or 0 slots (and no descriptor) if no
+// ring is available; the client then keeps using the socket. Returns false if the reply could
+// not be sent.
+bool offerRing(DaemonConnection *connection) {
+    int memfd = -1;
+    SharedRing *ring = NULL;
+    int index = -1;
+    pthread_mutex_lock(&ring_server.lock);
+    for (int r = 0; r < RING_MAX_CLIENTS && index == -1; r++) {
+        if (ring_server.rings[r] == NULL) index = r;
+    }
+    if (index != -1 && (memfd = memfd_create("tasakman-ring", MFD_CLOEXEC)) != -1) {
+        void *memory = MAP_FAILED;
+        if (ftruncate(memfd, sizeof(SharedRing)) == 0) {
+            memory = mmap(NULL, sizeof(SharedRing), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        }
+        if (memory != MAP_FAILED) {
+            ring = (SharedRing *)memory; // Zero-filled: both counters start at 0
+            ring->magic = RING_MAGIC;
+            ring->slot_count = RING_SLOTS;
+        } else {
+            close(memfd);
+            memfd = -1;
+        }
+    }
+    if (ring != NULL && !ring_server.started) {
+        // futex_waitv (Linux 5.16) lets one thread sleep on every ring; without it, no rings
+        ring_server.started = syscall(SYS_futex_waitv, NULL, 0, 0, NULL, CLOCK_MONOTONIC) == -1 && errno != ENOSYS &&
+                              pthread_create(&ring_server.thread, NULL, serveRings, NULL) == 0;
+    }
+    if (ring != NULL && !ring_server.started) {
+        munmap(ring, sizeof(SharedRing));
+        close(memfd);
+        ring = NULL;
+        memfd = -1;
+    }
+    pthread_mutex_unlock(&ring_server.lock);
+
+    char frame[9];
+    uint32_t frame_length = 5, slot_count = ring != NULL ? RING_SLOTS : 0;
+    memcpy(frame, &frame_length, 4);
+    frame[4] = 'M';
+    memcpy(frame + 5, &slot_count, 4);
+    struct iovec vector = {frame, sizeof(frame)};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (memfd != -1) {
+        memset(control, 0, sizeof(control));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &memfd, sizeof(int));
+    }
+    // Nothing else is queued on the connection, so the 9 bytes go out in one piece or not at all
+    bool sent = sendmsg(connection->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(frame);
+    if (memfd != -1) {
+        close(memfd); // The mapping stays
+    }
+    if (ring != NULL) {
+        if (sent) {
+            countMetric(COUNTER_SENT, sizeof(frame));
+            pthread_mutex_lock(&ring_server.lock);
+            ring_server.rings[index] = ring;
+            pthread_mutex_unlock(&ring_server.lock);
+            connection->ring = index + 1;
+            signalRingServer();
+        } else {
+            munmap(ring, sizeof(SharedRing));
+        }
+    }
+    return sent;
+}
+
+// Function to hand a closed connection's ring back to the ring thread, which unmaps it
+void releaseRing(DaemonConnection *connection) {
+    if (connection->ring == 0) {
+        return;
+    }
+    pthread_mutex_lock(&ring_server.lock);
+    ring_server.closing[connection->ring - 1] = true;
+    pthread_mutex_unlock(&ring_server.lock);
+    connection->ring = 0;
+    signalRingServer();
+}
+
+// Cache of rendered listings for the HTTP API, valid for one store version
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t generation;       // Store version the listings were rendered from
+    RenderBuffer *listings[3]; // All, pending, done
+} RenderCache;
+
+RenderCache render_cache = {PTHREAD_MUTEX_INITIALIZER, 0, {NULL, NULL, NULL}};
+
+// Function to drop a reference to a render buffer
+void releaseRenderBuffer(RenderBuffer *buffer) {
+    if (buffer != NULL && __atomic_sub_fetch(&buffer->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(buffer->data);
+        free(buffer);
+    }
+}
+
+// Function to append formatted text to a growable buffer
+void appendText(char **buffer, size_t *length, size_t *capacity, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0 || !reserveBuffer(buffer, capacity, *length + needed + 1)) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(*buffer + *length, needed + 1, format, args);
+    va_end(args);
+    *length += needed;
+}
+
+// Function to append a string as a quoted JSON string
+void appendJsonString(char **buffer, size_t *length, size_t *capacity, const char *text) {
+    if (!reserveBuffer(buffer, capacity, *length + 6 * strlen(text) + 3)) {
+        return;
+    }
+    char *out = *buffer + *length;
+    *out++ = '"';
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)*c;
+        } else if (*c < 0x20) {
+            out += sprintf(out, "\\u%04x", *c);
+        } else {
+            *out++ = (char)*c;
+        }
+    }
+    *out++ = '"';
+    *length = (size_t)(out - *buffer);
+}
+
+// Function to append one task of a table as a JSON object
+void appendTaskJson(char **buffer, size_t *length, size_t *capacity, const TaskTable *table, size_t row, const DueEntry *due) {
+    appendText(buffer, length, capacity, "{\"id\":%d,\"status\":\"%s\",\"description\":", table->ids[row], taskDone(table, row) ? "done" : "pending");
+    appendJsonString(buffer, length, capacity, taskDescription(table, row));
+    if (due != NULL) appendText(buffer, length, capacity, ",\"due\":%lld}", (long long)due->due);
+    else appendText(buffer, length, capacity, ",\"due\":null}");
+}
+
+// Function to get the rendered JSON listing of a version for a filter (0 all, 1 pending, 2 done)
+// Listings are rendered at most once per version and the caller gets a reference. Without
+// 'render' only an already rendered listing is returned (or NULL). Listings that would take more
+// than a quarter of the memory limit are not rendered (NULL).
+RenderBuffer *cachedTaskListing(const StoreVersion *version, int filter, bool render) {
+    pthread_mutex_lock(&render_cache.lock);
+    if (render_cache.generation != version->generation) {
+        if (!render || render_cache.generation > version->generation) {
+            pthread_mutex_unlock(&render_cache.lock); // Never replace a newer cache with an older one
+            return NULL;
+        }
+        for (int i = 0; i < 3; i++) {
+            releaseRenderBuffer(render_cache.listings[i]);
+            render_cache.listings[i] = NULL;
+        }
+        render_cache.generation = version->generation;
+    }
+    if (render_cache.listings[filter] == NULL) {
+        if (!render) {
+            pthread_mutex_unlock(&render_cache.lock);
+            return NULL;
+        }
+        countMetric(COUNTER_CACHE_MISSES, 1);
+        // About 64 bytes of JSON per task besides the description
+        if (memory_limit > 0 && 64 * version->table.count + version->table.arena_length > memory_limit / 4) {
+            pthread_mutex_unlock(&render_cache.lock);
+            return NULL; // Too large to keep: the caller streams it instead
+        }
+        RenderBuffer *listing = (RenderBuffer *)calloc(1, sizeof(RenderBuffer));
+        listing->references = 1; // The cache's own reference
+        size_t capacity = 0;
+        bool first = true;
+        appendText(&listing->data, &listing->length, &capacity, "[");
+        const TaskTable *table = &version->table;
+        for (size_t i = 0; i < table->count; i++) {
+            if ((filter == 1 && taskDone(table, i)) || (filter == 2 && !taskDone(table, i))) {
+                continue;
+            }
+            if (!first) appendText(&listing->data, &listing->length, &capacity, ",");
+            appendTaskJson(&listing->data, &listing->length, &capacity, table, i, findVersionDue(version, table->ids[i]));
+            first = false;
+        }
+        appendText(&listing->data, &listing->length, &capacity, "]\n");
+        render_cache.listings[filter] = listing;
+    } else {
+        countMetric(COUNTER_CACHE_HITS, 1);
+    }
+    RenderBuffer *listing = render_cache.listings[filter];
+    __atomic_add_fetch(&listing->references, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&render_cache.lock);
+    return listing;
+}
+
+// Function to set a complete HTTP response on a job
+// With a shared buffer the job only carries the header and the event loop sends the body
+// straight from the render cache.
+void httpRespond(DaemonJob *job, int code, const char *body, size_t body_length, RenderBuffer *shared) {
+    const char *reason = code == 200 ? "OK" : code == 201 ? "Created" : code == 400 ? "Bad Request" :
+                         code == 403 ? "Forbidden" : code == 404 ? "Not Found" : code == 405 ? "Method Not Allowed" :
+                         code == 409 ? "Conflict" : code == 415 ? "Unsupported Media Type" : "Internal Server Error";
+    size_t capacity = 0;
+    appendText(&job->response, &job->response_length, &capacity,
+               "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+               code, reason, shared != NULL ? shared->length : body_length, job->close_after ? "Connection: close\r\n" : "");
+    if (shared != NULL) {
+        job->shared = shared;
+    } else if (reserveBuffer(&job->response, &capacity, job->response_length + body_length)) {
+        memcpy(job->response + job->response_length, body, body_length);
+        job->response_length += body_length;
+    }
+}
+
+// Function to answer GET /metrics with the daemon's metrics in the Prometheus text format
+void httpRespondMetrics(DaemonJob *job) {
+    char *text = NULL;
+    size_t text_length = 0, capacity = 0;
+    FILE *out = open_memstream(&text, &text_length);
+    printMetrics(out, true);
+    fclose(out);
+    appendText(&job->response, &job->response_length, &capacity,
+               "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n%s\r\n",
+               text_length, job->close_after ? "Connection: close\r\n" : "");
+    if (reserveBuffer(&job->response, &capacity, job->response_length + text_length)) {
+        memcpy(job->response + job->response_length, text, text_length);
+        job->response_length += text_length;
+    }
+    free(text);
+}
+
+// Function to send an HTTP error response with a JSON message
+void httpError(DaemonJob *job, int code, const char *message) {
+    char body[128];
+    int length = snprintf(body, sizeof(body), "{\"error\":\"%s\"}\n", message);
+    httpRespond(job, code, body, (size_t)length, NULL);
+}
+
+// Function to respond with one task of the current version as JSON (or 404 if it does not exist)
+void httpRespondTask(DaemonJob *job, int id, int code) {
+    StoreVersion *version = pinStoreVersion(true);
+    size_t row;
+    if (!findVersionTask(version, id, &row)) {
+        httpError(job, 404, "task not found");
+    } else {
+        char *body = NULL;
+        size_t length = 0, capacity = 0;
+        appendTaskJson(&body, &length, &capacity, &version->table, row, findVersionDue(version, id));
+        appendText(&body, &length, &capacity, "\n");
+        httpRespond(job, code, body, length, NULL);
+        free(body);
+    }
+    unpinStoreVersion();
+}
+
+// Function to finish one chunk of a chunked HTTP body that started at 'start'
+// The chunk begins with a fixed-width size line ("%08zx\r\n"), patched in here.
+void finishHttpChunk(char **buffer, size_t *length, size_t *capacity, size_t start) {
+    char size_line[24];
+    snprintf(size_line, sizeof(size_line), "%08zx\r\n", *length - start - 10);
+    memcpy(*buffer + start, size_line, 10);
+    appendText(buffer, length, capacity, "\r\n");
+}
+
+// A range of a version being matched against a listing filter and search
+typedef struct {
+    const StoreVersion *version;
+    const uint32_t *positions; // By-ID positions, or NULL for file order
+    size_t first;
+    int filter;
+    const char *search;
+    unsigned char *matches;   // One flag per position from 'first'
+} ListingScan;
+
+// Function to tell whether a row of a table belongs in a listing
+bool listingMatches(const TaskTable *table, size_t row, int filter, const char *search) {
+    return !((filter == 1 && taskDone(table, row)) || (filter == 2 && !taskDone(table, row)) ||
+             (search != NULL && strcasestr(taskDescription(table, row), search) == NULL));
+}
+
+// Function to match a range of positions (a parallelFor body)
+void scanListing(void *arg, size_t begin, size_t end) {
+    ListingScan *scan = (ListingScan *)arg;
+    for (size_t i = begin; i < end; i++) {
+        size_t position = scan->first + i;
+        size_t row = scan->positions != NULL ? scan->positions[position] : position;
+        scan->matches[i] = listingMatches(&scan->version->table, row, scan->filter, scan->search);
+    }
+}
+
+// Function to stream a searched listing (or an ID range of it) as a chunked HTTP response
+// Searches are matched across the executor's threads first; rows then go out in chunks of about
+// WIRE_LIST_CHUNK bytes.
+void streamTaskListing(DaemonQueue *queue, DaemonJob *job, int filter, const char *search, int low, int high) {
+    char *chunk = NULL;
+    size_t length = 0, capacity = 0;
+    appendText(&chunk, &length, &capacity,
+               "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n%s\r\n",
+               job->close_after ? "Connection: close\r\n" : "");
+    size_t start = length;
+    appendText(&chunk, &length, &capacity, "%010d[", 0); // Size line placeholder, then the body
+    bool first = true;
+
+    StoreVersion *version = pinStoreVersion(true);
+    const uint32_t *positions;
+    size_t first_position, last_position;
+    versionRange(version, low, high, &positions, &first_position, &last_position);
+    ListingScan scan = {version, positions, first_position, filter, search, NULL};
+    // Searches are matched a window at a time; one window covers everything without a memory limit
+    size_t window = last_position - first_position;
+    if (memory_limit > 0 && window > memory_limit / 8) {
+        window = memory_limit / 8 > 65536 ? memory_limit / 8 : 65536;
+    }
+    if (search != NULL && window > 0) {
+        scan.matches = (unsigned char *)arenaAlloc(scratchArena(), window);
+    }
+    for (size_t i = first_position; i < last_position; i++) {
+        size_t row = positions != NULL ? positions[i] : i;
+        if (scan.matches != NULL && (i - first_position) % window == 0) { // Match the next window
+            scan.first = i;
+            parallelFor(last_position - i < window ? last_position - i : window, 4096, scanListing, &scan);
+        }
+        if (scan.matches != NULL ? !scan.matches[(i - first_position) % window] : !listingMatches(&version->table, row, filter, search)) {
+            continue;
+        }
+        if (!first) appendText(&chunk, &length, &capacity, ",");
+        appendTaskJson(&chunk, &length, &capacity, &version->table, row, findVersionDue(version, version->table.ids[row]));
+        first = false;
+
+        if (length - start >= WIRE_LIST_CHUNK) { // Ship this chunk now
+            finishHttpChunk(&chunk, &length, &capacity, start);
+            DaemonJob *part = (DaemonJob *)calloc(1, sizeof(DaemonJob));
+            part->kind = JOB_CHUNK;
+            part->connection = job->connection;
+            part->response = chunk;
+            part->response_length = length;
+            postCompletion(queue, part);
+            chunk = NULL;
+            length = capacity = start = 0;
+            appendText(&chunk, &length, &capacity, "%010d", 0);
+        }
+    }
+    unpinStoreVersion();
+
+    appendText(&chunk, &length, &capacity, "]\n");
+    finishHttpChunk(&chunk, &length, &capacity, start);
+    appendText(&chunk, &length, &capacity, "0\r\n\r\n");
+    job->response = chunk;
+    job->response_length = length;
+}
+
+// Function to copy a URL query parameter, decoding %XX and '+'
+// Returns 1 if it is present, 0 if it is absent and -1 if it has a malformed %XX escape.
+int queryParameter(const char *query, const char *name, char *value, size_t size) {
+    size_t name_length = strlen(name);
+    for (const char *c = query; c != NULL && *c != '\0'; c = strchr(c, '&'), c = c != NULL ? c + 1 : NULL) {
+        if (strncmp(c, name, name_length) != 0 || c[name_length] != '=') {
+            continue;
+        }
+        size_t n = 0;
+        for (c += name_length + 1; *c != '\0' && *c != '&' && n + 1 < size; c++) {
+            unsigned int byte;
+            if (*c == '%') {
+                if (!isxdigit((unsigned char)c[1]) || !isxdigit((unsigned char)c[2])) {
+                    return -1; // Also stops at the end of the query
+                }
+                sscanf(c + 1, "%2x", &byte);
+                value[n++] = (char)byte;
+                c += 2;
+            } else {
+                value[n++] = *c == '+' ? ' ' : *c;
+            }
+        }
+        value[n] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+// Function to parse a JSON string literal at *cursor into value (UTF-8)
+// Returns false on malformed input; on success *cursor points past the closing quote.
+bool parseJsonString(const char **cursor, char *value, size_t size) {
+    const char *c = *cursor;
+    if (*c++ != '"') {
+        return false;
+    }
+    size_t n = 0;
+    while (*c != '"') {
+        unsigned int code = (unsigned char)*c++;
+        bool unicode = false;
+        if (code == 0) {
+            return false;
+        }
+        if (code == '\\') {
+            char escape = *c++;
+            switch (escape) {
+                case 'n': code = '\n'; break;
+                case 't': code = '\t'; break;
+                case 'r': code = '\r'; break;
+                case 'b': code = '\b'; break;
+                case 'f': code = '\f'; break;
+                case 'u':
+                    for (int i = 0; i < 4; i++) {
+                        if (!isxdigit((unsigned char)c[i])) return false; // Also stops at the end of the body
+                    }
+                    sscanf(c, "%4x", &code);
+                    c += 4;
+                    unicode = true;
+                    break;
+                case '"': case '\\': case '/': code = (unsigned char)escape; break;
+                default: return false;
+            }
+        }
+        char bytes[3];
+        size_t count = 1;
+        if (code < 0x80 || !unicode) {
+            bytes[0] = (char)code; // ASCII, or a raw byte of UTF-8 text
+        } else if (code < 0x800) { // Encode \u escapes as UTF-8 (surrogate pairs are not combined)
+            bytes[0] = (char)(0xc0 | (code >> 6));
+            bytes[1] = (char)(0x80 | (code & 0x3f));
+            count = 2;
+        } else {
+            bytes[0] = (char)(0xe0 | (code >> 12));
+            bytes[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+            bytes[2] = (char)(0x80 | (code & 0x3f));
+            count = 3;
+        }
+        if (n + count < size) {
+            memcpy(value + n, bytes, count);
+            n += count;
+        }
+    }
+    value[n] = '\0';
+    *cursor = c + 1;
+    return true;
+}
+
+// Function to read a string field of a flat JSON object such as {"description": "Buy milk"}
+// Returns 1 if the field is a string (copied into value), -1 if it is null, 0 if it is absent
+// and -2 if the body is not such an object.
+int jsonStringField(const char *body, const char *key, char *value, size_t size) {
+    const char *c = body + strspn(body, " \t\r\n");
+    if (*c++ != '{') {
+        return -2;
+    }
+    for (;;) {
+        c += strspn(c, " \t\r\n");
+        if (*c == '}') {
+            return 0;
+        }
+        char name[64];
+        if (!parseJsonString(&c, name, sizeof(name))) {
+            return -2;
+        }
+        c += strspn(c, " \t\r\n");
+        if (*c++ != ':') {
+            return -2;
+        }
+        c += strspn(c, " \t\r\n");
+        bool wanted = strcmp(name, key) == 0;
+        if (*c == '"') {
+            char scratch[8];
+            if (!(wanted ? parseJsonString(&c, value, size) : parseJsonString(&c, scratch, sizeof(scratch)))) {
+                return -2;
+            }
+            if (wanted) return 1;
+        } else {
+            if (wanted) return strncmp(c, "null", 4) == 0 ? -1 : -2;
+            c += strcspn(c, ",}"); // Numbers, booleans and null are skipped
+        }
+        c += strspn(c, " \t\r\n");
+        if (*c == ',') c++;
+        else if (*c != '}') return -2;
+    }
+}
+
+// Parsed request line of an HTTP request
+typedef struct {
+    char method[8];
+    char target[1024]; // Path only; the query string is split off
+    char *query;       // NULL if there is none
+    const char *body;
+    int id;            // Task ID of a /tasks/{id} target
+    bool collection;   // Target is /tasks
+    bool item;         // Target is /tasks/{id}
+    bool local_host;   // Host names this listener (127.0.0.1:<port> or localhost:<port>)
+    bool json_body;    // Content-Type is application/json
+} HttpRequest;
+
+// Port of the HTTP listener, which every request's Host header must name (set by serveDaemon)
+int http_listen_port = 0;
+
+// Function to tell whether a Host header value names the loopback listener
+// Anything else is refused, so a web page whose name resolves to 127.0.0.1 (DNS rebinding)
+// cannot reach the API through the browser.
+bool localHttpHost(const char *value) {
+    size_t length = strcspn(value, " \t\r\n");
+    char expected[32];
+    const char *names[] = {"127.0.0.1", "localhost"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        int expected_length = snprintf(expected, sizeof(expected), "%s:%d", names[i], http_listen_port);
+        if ((size_t)expected_length == length && strncasecmp(value, expected, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to parse the request line and headers of a job's HTTP request
+// Also decides whether the connection stays open afterwards. Returns false if malformed.
+bool parseHttpRequest(DaemonJob *job, HttpRequest *request) {
+    char version[4];
+    if (sscanf(job->request, "%7s %1023s HTTP/%3s", request->method, request->target, version) != 3) {
+        job->close_after = true;
+        return false;
+    }
+    // HTTP/1.1 keeps the connection open unless asked not to, HTTP/1.0 the other way round
+    const char *body = strstr(job->request, "\r\n\r\n");
+    request->body = body != NULL ? body + 4 : job->request + job->request_length;
+    bool keep_alive = strcmp(version, "1.1") == 0;
+    request->local_host = request->json_body = false;
+    for (const char *line = strstr(job->request, "\r\n"); line != NULL && line + 2 < request->body; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Connection:", 11) == 0) {
+            const char *option = line + 13 + strspn(line + 13, " \t");
+            if (strncasecmp(option, "close", 5) == 0) keep_alive = false;
+            else if (strncasecmp(option, "keep-alive", 10) == 0) keep_alive = true;
+        } else if (strncasecmp(line + 2, "Host:", 5) == 0) {
+            request->local_host = localHttpHost(line + 7 + strspn(line + 7, " \t"));
+        } else if (strncasecmp(line + 2, "Content-Type:", 13) == 0) {
+            const char *type = line + 15 + strspn(line + 15, " \t");
+            request->json_body = strncasecmp(type, "application/json", 16) == 0 && strchr(";\r \t", type[16]) != NULL;
+        }
+    }
+    job->close_after = !keep_alive;
+
+    request->query = strchr(request->target, '?');
+    if (request->query != NULL) *request->query++ = '\0';
+    char rest;
+    request->id = 0;
+    request->collection = strcmp(request->target, "/tasks") == 0;
+    request->item = sscanf(request->target, "/tasks/%d%c", &request->id, &rest) == 1 && request->id > 0;
+    return true;
+}
+
+// Function to read the filters of a listing: returns 0 all, 1 pending, 2 done, -1 invalid
+// The search text is left empty when there is none; the ID range is 1..INT_MAX by default.
+int listingFilter(const char *query, char *search, size_t size, int *low, int *high) {
+    char status[16], range[32];
+    int filter = 0;
+    search[0] = '\0';
+    *low = 1;
+    *high = INT_MAX;
+    if (query == NULL) {
+        return filter;
+    }
+    int found = queryParameter(query, "id_range", range, sizeof(range));
+    if (found == -1 || (found == 1 && !parseIdRange(range, low, high))) {
+        return -1;
+    }
+    found = queryParameter(query, "status", status, sizeof(status));
+    if (found == -1) {
+        return -1;
+    } else if (found == 1) {
+        if (strcmp(status, "pending") == 0) filter = 1;
+        else if (strcmp(status, "done") == 0) filter = 2;
+        else if (strcmp(status, "all") != 0) return -1;
+    }
+    if (queryParameter(query, "q", search, size) == -1) {
+        search[0] = '\0';
+        return -1;
+    }
+    return filter;
+}
+
+// Function to answer a plain listing from the render cache on the event loop itself
+// Only done when the current version is already loaded and rendered, so it never blocks;
+// returns false (leaving the job for a worker) otherwise.
+bool answerHttpFromCache(DaemonJob *job) {
+    uint64_t metric_started = metricClock();
+    HttpRequest request;
+    char search[MAX_DESCRIPTION_LEN];
+    int filter, low, high;
+    if (!parseHttpRequest(job, &request) || !request.local_host || !request.collection || strcmp(request.method, "GET") != 0 ||
+        (filter = listingFilter(request.query, search, sizeof(search), &low, &high)) == -1 ||
+        search[0] != '\0' || low != 1 || high != INT_MAX) {
+        return false;
+    }
+    StoreVersion *version = pinStoreVersion(false);
+    if (version == NULL) {
+        return false;
+    }
+    RenderBuffer *listing = cachedTaskListing(version, filter, false);
+    unpinStoreVersion();
+    if (listing == NULL) {
+        return false;
+    }
+    httpRespond(job, 200, NULL, 0, listing);
+    recordLatency(METRIC_LIST, metric_started);
+    return true;
+}
+
+// Function to run one HTTP request on a worker thread
+// Routes: GET /tasks[?status=pending|done][&q=text][&id_range=A-B], POST /tasks, GET|PATCH|DELETE /tasks/{id},
+// GET /metrics.
+// Plain listings come from the render cache; searched listings are streamed in chunks.
+void runHttpRequest(DaemonQueue *queue, DaemonJob *job) {
+    HttpRequest request;
+    if (!parseHttpRequest(job, &request)) {
+        httpError(job, 400, "malformed request");
+        return;
+    }
+    const char *method = request.method, *body = request.body;
+    bool collection = request.collection, item = request.item;
+    int id = request.id;
+    if (!request.local_host) {
+        httpError(job, 403, "Host must be 127.0.0.1:<port> or localhost:<port>");
+        return;
+    }
+    if ((strcmp(method, "POST") == 0 || strcmp(method, "PATCH") == 0) && (collection || item) && !request.json_body) {
+        httpError(job, 415, "Content-Type must be application/json");
+        return;
+    }
+
+    if (collection && strcmp(method, "GET") == 0) {
+        char search[MAX_DESCRIPTION_LEN];
+        int low, high;
+        int filter = listingFilter(request.query, search, sizeof(search), &low, &high);
+        if (filter == -1) {
+            httpError(job, 400, "status must be pending, done or all; id_range must be A-B; escapes must be %XX");
+            return;
+        }
+        request_metric = search[0] != '\0' ? METRIC_SEARCH : METRIC_LIST;
+        if (search[0] != '\0' || low != 1 || high != INT_MAX) {
+            streamTaskListing(queue, job, filter, search[0] != '\0' ? search : NULL, low, high);
+            return;
+        }
+        StoreVersion *version = pinStoreVersion(true);
+        RenderBuffer *listing = cachedTaskListing(version, filter, true);
+        unpinStoreVersion();
+        if (listing != NULL) {
+            httpRespond(job, 200, NULL, 0, listing);
+        } else { // Over the memory limit, or a newer version was published meanwhile: stream it
+            streamTaskListing(queue, job, filter, NULL, 1, INT_MAX);
+        }
+    } else if (collection && strcmp(method, "POST") == 0) {
+        char description[MAX_DESCRIPTION_LEN], due_text[64];
+        if (jsonStringField(body, "description", description, sizeof(description)) != 1 || description[0] == '\0') {
+            httpError(job, 400, "expected {\"description\": \"...\"}");
+            return;
+        }
+        for (char *c = description; *c != '\0'; c++) {
+            if (*c == '\n' || *c == '\r') *c = ' '; // One record per line in tasks.txt
+        }
+        time_t due = 0;
+        if (jsonStringField(body, "due", due_text, sizeof(due_text)) == 1 && (due = parseDueTime(due_text)) == -1) {
+            httpError(job, 400, "invalid due time");
+            return;
+        }
+        const char *descriptions[1] = {description};
+        UniquePolicy policy = uniquePolicy();
+        bool duplicate;
+        request_metric = METRIC_ADD;
+        pthread_rwlock_wrlock(&store_lock);
+        if (!addTasks(descriptions, 1, &id, policy, &duplicate)) {
+            httpError(job, 500, "could not write the task file");
+        } else if (duplicate && policy == UNIQUE_REJECT) {
+            httpError(job, 409, "duplicate of a pending task");
+        } else if (duplicate) { // Merged: answer with the task that already exists
+            httpRespondTask(job, id, 200);
+        } else {
+            if (due > 0 && setDueDate(id, due)) {
+                logOperation('U', id, "%lld", (long long)due);
+            }
+            refreshStoreVersion();
+            httpRespondTask(job, id, 201);
+        }
+        pthread_rwlock_unlock(&store_lock);
+    } else if (item && strcmp(method, "GET") == 0) {
+        request_metric = METRIC_LIST;
+        httpRespondTask(job, id, 200);
+    } else if (item && (strcmp(method, "PATCH") == 0 || strcmp(method, "DELETE") == 0)) {
+        char status[16], due_text[64];
+        Mutation mutation = {id, 'X', false};
+        int status_field = 0, due_field = 0;
+        time_t due = 0;
+        if (method[0] == 'P') {
+            status_field = jsonStringField(body, "status", status, sizeof(status));
+            due_field = jsonStringField(body, "due", due_text, sizeof(due_text));
+            if (status_field == -2 || due_field == -2 || (status_field == 0 && due_field == 0)) {
+                httpError(job, 400, "expected {\"status\": \"done|pending\"} and/or {\"due\": \"...\"}");
+                return;
+            }
+            if (status_field == 1 && strcmp(status, "done") != 0 && strcmp(status, "pending") != 0) {
+                httpError(job, 400, "status must be done or pending");
+                return;
+            }
+            if (due_field == 1 && (due = parseDueTime(due_text)) == -1) {
+                httpError(job, 400, "invalid due time");
+                return;
+            }
+            mutation.op = status_field == 1 ? (status[0] == 'd' ? 'C' : 'P') : 0;
+        }
+        request_metric = mutation.op == 'X' ? METRIC_DELETE : mutation.op == 'C' ? METRIC_DONE :
+                         mutation.op == 'P' ? METRIC_PENDING : METRIC_DUE;
+        pthread_rwlock_wrlock(&store_lock);
+        size_t row;
+        bool exists = findVersionTask(pinStoreVersion(true), id, &row);
+        unpinStoreVersion();
+        if (!exists) {
+            httpError(job, 404, "task not found");
+        } else if (mutation.op != 0 && !applyMutations(&mutation, 1)) {
+            httpError(job, 500, "could not write the task file");
+        } else if (method[0] == 'D') {
+            refreshStoreVersion();
+            char deleted[48];
+            int length = snprintf(deleted, sizeof(deleted), "{\"deleted\":%d}\n", id);
+            httpRespond(job, 200, deleted, (size_t)length, NULL);
+        } else {
+            if (due_field != 0 && setDueDate(id, due)) { // null clears the due date
+                logOperation('U', id, "%lld", (long long)due);
+            }
+            refreshStoreVersion();
+            httpRespondTask(job, id, 200);
+        }
+        pthread_rwlock_unlock(&store_lock);
+    } else if (strcmp(request.target, "/metrics") == 0 && strcmp(method, "GET") == 0) {
+        httpRespondMetrics(job);
+    } else if (collection || item) {
+        httpError(job, 405, "method not allowed");
+    } else {
+        httpError(job, 404, "no such resource");
+    }
+}
+
+// Function run by each worker thread: take jobs off the queue and run them
+void *daemonWorker(void *arg) {
+    DaemonQueue *queue = (DaemonQueue *)arg;
+    DaemonJob *group[256];
+    Arena arena; // Per-request arena, reset after every job
+    memset(&arena, 0, sizeof(arena));
+    current_arena = &arena;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->queue_head == NULL && !queue->stopping) {
+            pthread_cond_wait(&queue->work_ready, &queue->lock);
+        }
+        if (queue->queue_head == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            arenaReset(&arena, false);
+            return NULL;
+        }
+        DaemonJob *job = queue->queue_head;
+        queue->queue_head = job->next;
+        size_t group_count = 0;
+        group[group_count++] = job;
+        if (job->kind == JOB_BINARY_MUTATIONS) {
+            // Take every other queued mutation job along into the same commit
+            DaemonJob **link = &queue->queue_head;
+            while (*link != NULL && group_count < 256) {
+                if ((*link)->kind == JOB_BINARY_MUTATIONS) {
+                    group[group_count++] = *link;
+                    *link = (*link)->next;
+                } else {
+                    link = &(*link)->next;
+                }
+            }
+        }
+        queue->queue_tail = NULL;
+        for (DaemonJob *last = queue->queue_head; last != NULL; last = last->next) queue->queue_tail = last;
+        pthread_mutex_unlock(&queue->lock);
+
+        JobKind kind = job->kind;
+        TASAKMAN_PROBE2(request__start, kind, group_count);
+        uint64_t started = metricClock();
+        request_metric = -1;
+        TASAKMAN_PROBE2(request__start, kind, group_count);
+        if (job->kind == JOB_TEXT || job->kind == JOB_BINARY_COMMAND) {
+            runDaemonRequest(job);
+        } else if (job->kind == JOB_BINARY_LIST) {
+            runBinaryList(queue, job);
+        } else if (job->kind == JOB_HTTP) {
+            runHttpRequest(queue, job);
+        } else {
+            pthread_rwlock_wrlock(&store_lock);
+            commitBinaryGroup(group, group_count);
+            refreshStoreVersion();
+            pthread_rwlock_unlock(&store_lock);
+        }
+        if (kind == JOB_BINARY_MUTATIONS) { // Every frame of the group waited for the shared commit
+            for (size_t i = 0; i < group_count; i++) {
+                for (size_t offset = 0; offset < group[i]->request_length;) {
+                    uint32_t frame_length;
+                    memcpy(&frame_length, group[i]->request + offset, 4);
+                    char opcode = group[i]->request[offset + 4];
+                    recordLatency(opcode == 'A' ? METRIC_ADD : opcode == 'C' ? METRIC_DONE :
+                                  opcode == 'P' ? METRIC_PENDING : METRIC_DELETE, started);
+                    offset += 4 + frame_length;
+                }
+            }
+        } else if (request_metric != -1) {
+            recordLatency((MetricOp)request_metric, started);
+        }
+        TASAKMAN_PROBE2(request__done, kind, group_count);
+        if (trace_enabled) {
+            const char *names[] = {"text", "binary mutations", "binary list", "command", "http", "chunk"};
+            fprintf(stderr, "trace: %s request (%zu job%s): %zu arena allocation%s, %zu bytes, %zu block%s\n",
+                    names[kind], group_count, group_count == 1 ? "" : "s", arena.allocations,
+                    arena.allocations == 1 ? "" : "s", arena.bytes, arena.block_count, arena.block_count == 1 ? "" : "s");
+        }
+        arenaReset(&arena, true); // Everything the request allocated goes at once
+        for (size_t i = 0; i < group_count; i++) {
+            postCompletion(queue, group[i]);
+        }
+    }
+}
+
+// Function to send as much queued output as the socket accepts without blocking
+// Returns false if the connection failed.
+bool flushConnection(DaemonConnection *connection) {
+    while (connection->output_sent < connection->output_length) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_sent,
+                            connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK; // Resume on the next EPOLLOUT
+        }
+        connection->output_sent += (size_t)sent;
+        countMetric(COUNTER_SENT, (uint64_t)sent);
+    }
+    connection->output_sent = connection->output_length = 0;
+    return true;
+}
+
+// Function to read everything available from a connection without blocking
+// Returns false if the connection failed.
+bool readConnection(DaemonConnection *connection) {
+    for (;;) {
+        if (connection->output_length - connection->output_sent > DAEMON_OUTPUT_HIGH_WATER) {
+            connection->read_blocked = true; // The client isn't reading its responses: stop reading
+            return true;
+        }
+        if (!reserveBuffer(&connection->input, &connection->input_capacity, connection->input_length + 4096)) {
+            return false;
+        }
+        ssize_t got = recv(connection->fd, connection->input + connection->input_length,
+                           connection->input_capacity - connection->input_length, 0);
+        if (got == 0) {
+            connection->closing = true; // Peer finished sending; answer what it sent
+            return true;
+        }
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection->input_length += (size_t)got;
+        countMetric(COUNTER_RECEIVED, (uint64_t)got);
+        bool line_protocol = connection->mode == CONNECTION_TEXT ||
+            (connection->mode == CONNECTION_UNKNOWN && (unsigned char)connection->input[0] != WIRE_MAGIC);
+        if (line_protocol && connection->input_length > DAEMON_MAX_REQUEST &&
+            memchr(connection->input, '\n', connection->input_length) == NULL) {
+            return false; // Oversized request line
+        }
+    }
+}
+
+// Function to queue a job for the worker pool
+void queueJob(DaemonQueue *queue, DaemonJob *job) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->queue_tail != NULL) queue->queue_tail->next = job;
+    else queue->queue_head = job;
+    queue->queue_tail = job;
+    pthread_cond_signal(&queue->work_ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Function to find how long the HTTP request at the start of a buffer is
+// Returns 0 while the headers or body are incomplete and -1 for requests that can't be served.
+long httpRequestLength(const char *input, size_t length) {
+    const char *end = (const char *)memmem(input, length, "\r\n\r\n", 4);
+    if (end == NULL) {
+        return length > DAEMON_MAX_REQUEST ? -1 : 0;
+    }
+    size_t header_length = (size_t)(end - input) + 4;
+    long content_length = 0;
+    for (const char *line = (const char *)memchr(input, '\n', header_length); line != NULL && line + 1 < end;
+         line = (const char *)memchr(line + 1, '\n', (size_t)(end - line))) {
+        if (strncasecmp(line + 1, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 16, NULL, 10);
+        } else if (strncasecmp(line + 1, "Transfer-Encoding:", 18) == 0) {
+            return -1; // Chunked request bodies are not accepted
+        }
+    }
+    if (content_length < 0 || content_length > WIRE_MAX_FRAME) {
+        return -1;
+    }
+    size_t total = header_length + (size_t)content_length;
+    return length < total ? 0 : (long)total;
+}
+
+// Function to queue a job's response on its connection
+// A response from the render cache is sent straight from the cached buffer when nothing is
+// queued ahead of it; only what the socket does not take right away is copied.
+void queueResponse(DaemonConnection *connection, DaemonJob *job) {
+    struct iovec parts[2] = {{job->response, job->response_length}, {NULL, 0}};
+    if (job->shared != NULL) {
+        parts[1].iov_base = job->shared->data;
+        parts[1].iov_len = job->shared->length;
+    }
+    size_t skip = 0;
+    if (job->shared != NULL && connection->output_length == 0) {
+        // Nothing queued ahead: send the cached body without copying it
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        ssize_t sent = sendmsg(connection->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        skip = sent > 0 ? (size_t)sent : 0;
+        countMetric(COUNTER_SENT, skip);
+    }
+    for (int p = 0; p < 2; p++) { // Queue whatever the socket did not take
+        size_t taken = skip < parts[p].iov_len ? skip : parts[p].iov_len;
+        skip -= taken;
+        size_t remaining = parts[p].iov_len - taken;
+        size_t needed = connection->output_length + remaining;
+        if (remaining > 0 && reserveBuffer(&connection->output, &connection->output_capacity, needed)) {
+            memcpy(connection->output + connection->output_length, (char *)parts[p].iov_base + taken, remaining);
+            connection->output_length = needed;
+        }
+    }
+}
+
+// Function to hand the connection's next complete request(s) to the worker pool
+// A binary connection hands over every complete mutation frame it has received as one job, so
+// pipelined requests are committed together. HTTP listings that the render cache can answer are
+// answered right here, as many as are pipelined. Returns false on a protocol error.
+bool dispatchRequest(DaemonQueue *queue, DaemonConnection *connection) {
+    size_t offset = 0; // Input answered on the event loop so far
+    bool ok = true;
+    while (ok && !connection->busy && !connection->hanging_up && offset < connection->input_length &&
+           connection->output_length - connection->output_sent <= DAEMON_OUTPUT_HIGH_WATER) {
+        if (connection->mode == CONNECTION_UNKNOWN) { // The first byte picks the protocol
+            if ((unsigned char)connection->input[0] == WIRE_MAGIC) {
+                connection->mode = CONNECTION_BINARY;
+                memmove(connection->input, connection->input + 1, --connection->input_length);
+                continue;
+            }
+            connection->mode = CONNECTION_TEXT;
+        }
+
+        char *input = connection->input + offset;
+        size_t available = connection->input_length - offset;
+        size_t consumed = 0;
+        JobKind kind = JOB_TEXT;
+        if (connection->mode == CONNECTION_TEXT) {
+            char *newline = (char *)memchr(input, '\n', available);
+            if (newline == NULL) {
+                break;
+            }
+            *newline = '\0';
+            consumed = (size_t)(newline - input) + 1;
+        } else if (connection->mode == CONNECTION_HTTP) {
+            long length = httpRequestLength(input, available);
+            if (length <= 0) {
+                ok = length == 0;
+                break;
+            }
+            kind = JOB_HTTP;
+            consumed = (size_t)length;
+        } else {
+            kind = JOB_BINARY_MUTATIONS;
+            size_t frames = 0;
+            bool offered = false;
+            while (consumed + 4 <= available && frames < 4096) {
+                uint32_t frame_length;
+                memcpy(&frame_length, input + consumed, 4);
+                char opcode = consumed + 4 < available ? input[consumed + 4] : 'A';
+                if (frame_length == 0 || frame_length > WIRE_MAX_FRAME ||
+                    (opcode != 'A' && opcode != 'C' && opcode != 'P' && opcode != 'X' && opcode != 'L' && opcode != 'V' && opcode != 'M') ||
+                    (opcode != 'A' && opcode != 'L' && opcode != 'V' && (frame_length - 1) % 4 != 0) ||
+                    (opcode == 'M' && frame_length != 1)) {
+                    ok = false;
+                    break;
+                }
+                if (consumed + 4 + frame_length > available) {
+                    break; // Incomplete frame: wait for the rest
+                }
+                if (opcode == 'L' || opcode == 'V') { // Listings and commands run on their own
+                    if (frames == 0) {
+                        kind = opcode == 'L' ? JOB_BINARY_LIST : JOB_BINARY_COMMAND;
+                        consumed += 4 + frame_length;
+                    }
+                    break;
+                }
+                if (opcode == 'M') { // Answered right here, with nothing else outstanding
+                    if (frames == 0) {
+                        ok = connection->ring == 0 && connection->output_length == 0 && offerRing(connection);
+                        consumed += 4 + frame_length;
+                        offered = true;
+                    }
+                    break;
+                }
+                consumed += 4 + frame_length;
+                frames++;
+            }
+            if (!ok || consumed == 0) {
+                break;
+            }
+            if (offered) {
+                offset += consumed;
+                continue;
+            }
+        }
+
+        DaemonJob *job = (DaemonJob *)calloc(1, sizeof(DaemonJob));
+        job->kind = kind;
+        job->connection = connection;
+        job->request = (char *)malloc(consumed + 1);
+        memcpy(job->request, input, consumed);
+        job->request[consumed] = '\0';
+        job->request_length = consumed;
+        offset += consumed;
+        if (kind == JOB_HTTP && answerHttpFromCache(job)) { // Served without a trip to a worker
+            queueResponse(connection, job);
+            connection->hanging_up = job->close_after;
+            releaseRenderBuffer(job->shared);
+            free(job->request);
+            free(job->response);
+            free(job);
+        } else {
+            connection->busy = true;
+            queueJob(queue, job);
+        }
+    }
+    if (offset > 0) {
+        memmove(connection->input, connection->input + offset, connection->input_length - offset);
+        connection->input_length -= offset;
+    }
+    return ok;
+}
+
+// Function to free a connection's memory
+void freeConnection(DaemonConnection *connection) {
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+// Function to close a connection once nothing of it is in flight any more
+void closeConnection(int epoll_fd, DaemonConnection *connection) {
+    releaseRing(connection);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    if (!connection->busy) { // Otherwise freed when its job comes back
+        freeConnection(connection);
+    }
+}
+
+// Function to make progress on a connection after any event: send, read, dispatch, close
+void serviceConnection(int epoll_fd, DaemonQueue *queue, DaemonConnection *connection) {
+    bool ok = flushConnection(connection);
+    if (ok && connection->read_blocked &&
+        connection->output_length - connection->output_sent <= DAEMON_OUTPUT_HIGH_WATER / 2) {
+        connection->read_blocked = false; // Drained enough: resume reading
+        ok = readConnection(connection);
+    }
+    if (ok) {
+        ok = dispatchRequest(queue, connection) && flushConnection(connection);
+    }
+    bool finished = (connection->closing || connection->hanging_up) && !connection->busy && connection->output_length == 0;
+    if (!ok || finished) {
+        closeConnection(epoll_fd, connection);
+    }
+}
+
+// Function to hand responses that workers completed to their connections
+void deliverCompletions(int epoll_fd, DaemonQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    DaemonJob *job = queue->completed_head;
+    queue->completed_head = queue->completed_tail = NULL;
+    pthread_mutex_unlock(&queue->lock);
+
+    while (job != NULL) {
+        DaemonJob *next = job->next;
+        DaemonConnection *connection = job->connection;
+        bool final = job->kind != JOB_CHUNK;
+        if (final) {
+            connection->busy = false;
+        }
+        if (connection->fd == -1) { // Client went away while its request ran
+            if (final) freeConnection(connection);
+        } else {
+            queueResponse(connection, job);
+            if (final && job->close_after) {
+                connection->hanging_up = true; // Ignore anything pipelined after it
+            }
+            serviceConnection(epoll_fd, queue, connection);
+        }
+        releaseRenderBuffer(job->shared);
+        free(job->request);
+        free(job->response);
+        free(job);
+        job = next;
+    }
+}
+
+// Function to create the daemon's listening socket in the task directory
+int openDaemonSocket(const char *socket_path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Error creating daemon socket");
+        return -1;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: socket path %s is too long.\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // A leftover socket file from a daemon that died is removed; a live daemon is left alone
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "Error: a daemon is already listening on %s.\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror("Error listening on daemon socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to create the daemon's HTTP listening socket on 127.0.0.1
+int openHttpSocket(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Error creating HTTP socket");
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Never reachable from other machines
+    address.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        perror("Error listening on HTTP port");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to accept every pending connection on a listening socket
+void acceptConnections(int epoll_fd, int listen_fd, ConnectionMode mode) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return; // EAGAIN, or out of descriptors until some client leaves
+        }
+        if (mode == CONNECTION_HTTP) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Small responses go out at once
+        }
+        DaemonConnection *connection = (DaemonConnection *)calloc(1, sizeof(DaemonConnection));
+        connection->fd = fd;
+        connection->mode = mode;
+        struct epoll_event connection_event;
+        connection_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        connection_event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &connection_event);
+    }
+}
+
+// Function to run the daemon (the 'serve' command)
+// One edge-triggered epoll loop owns every connection and never blocks on a client: sockets are
+// non-blocking, each connection buffers its own input and output, and a client that doesn't
+// read its responses only stops its own requests. Store operations run on a fixed pool of
+// worker threads, so thousands of connections cost no extra threads. With an HTTP port the same
+// loop also serves the JSON API on 127.0.0.1. With an idle timeout (minutes, 0 for none) the
+// daemon exits once nothing has happened for that long.
+void serveDaemon(int worker_count, int http_port, int idle_minutes) {
+    char socket_path[MAX_PATH_LEN];
+    if (!storeFilePath(socket_path, DAEMON_SOCKET_FILENAME)) {
+        fprintf(stderr, "Error: task directory path %s is too long.\n", task_dir_path);
+        return;
+    }
+
+    // The lock is what makes a daemon the daemon of this directory; the kernel drops it on exit
+    int lock_fd = openStoreFile(DAEMON_LOCK_FILENAME, O_RDWR | O_CREAT);
+    if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+        fprintf(stderr, "Error: a daemon is already running for %s.\n", task_dir_path);
+        if (lock_fd != -1) close(lock_fd);
+        return;
+    }
+
+    // Allow as many connections as the hard limit permits
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = openDaemonSocket(socket_path);
+    if (listen_fd == -1) {
+        close(lock_fd);
+        return;
+    }
+    int http_fd = -1;
+    http_listen_port = http_port;
+    if (http_port > 0 && (http_fd = openHttpSocket(http_port)) == -1) {
+        close(listen_fd);
+        unlinkat(task_dir_fd, DAEMON_SOCKET_FILENAME, 0);
+        close(lock_fd);
+        return;
+    }
+    metrics_started = monotonicNanoseconds();
+    metrics_enabled = true; // Before any worker starts
+    DaemonQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.work_ready, NULL);
+    queue.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (queue.event_fd == -1 || epoll_fd == -1) {
+        perror("Error starting daemon");
+        close(listen_fd);
+        return;
+    }
+
+    // The listening sockets and the eventfd are told apart by their (NULL / &http_fd / &queue)
+    // data pointers
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    if (http_fd != -1) {
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = &http_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, http_fd, &event);
+    }
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &queue;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, queue.event_fd, &event);
+
+    refreshStoreVersion(); // Load the first version before any reader needs it
+    pthread_t *workers = (pthread_t *)malloc(worker_count * sizeof(pthread_t));
+    for (int i = 0; i < worker_count; i++) {
+        pthread_create(&workers[i], NULL, daemonWorker, &queue);
+    }
+    printf("Serving %s on %s with %d worker%s.\n", task_dir_path, socket_path, worker_count, worker_count == 1 ? "" : "s");
+    if (http_fd != -1) {
+        printf("HTTP API on http://127.0.0.1:%d/tasks\n", http_port);
+    }
+    fflush(stdout);
+
+    struct epoll_event events[256];
+    uint64_t ring_requests_seen = 0;
+    for (;;) {
+        int ready = epoll_wait(epoll_fd, events, 256, idle_minutes > 0 ? idle_minutes * 60000 : -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            perror("Error waiting for events");
+            break;
+        }
+        if (ready == 0) { // Idle for the whole timeout: clients fall back to the files directly
+            uint64_t ring_answered = __atomic_load_n(&ring_server.answered, __ATOMIC_RELAXED);
+            if (ring_answered != ring_requests_seen) { // Unless ring clients kept it busy
+                ring_requests_seen = ring_answered;
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL) { // New connections: accept until the backlog is empty
+                acceptConnections(epoll_fd, listen_fd, CONNECTION_UNKNOWN);
+            } else if (events[i].data.ptr == &http_fd) {
+                acceptConnections(epoll_fd, http_fd, CONNECTION_HTTP);
+            } else if (events[i].data.ptr == &queue) { // Workers finished some requests
+                uint64_t count;
+                if (read(queue.event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                    perror("Error reading eventfd");
+                }
+                deliverCompletions(epoll_fd, &queue);
+            } else {
+                DaemonConnection *connection = (DaemonConnection *)events[i].data.ptr;
+                bool ok = true;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    ok = readConnection(connection);
+                }
+                if (!ok || (events[i].events & EPOLLERR)) {
+                    closeConnection(epoll_fd, connection);
+                } else {
+                    serviceConnection(epoll_fd, &queue, connection);
+                }
+            }
+        }
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = true;
+    pthread_cond_broadcast(&queue.work_ready);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    pthread_mutex_lock(&ring_server.lock);
+    ring_server.stopping = true;
+    bool rings_started = ring_server.started;
+    pthread_mutex_unlock(&ring_server.lock);
+    if (rings_started) {
+        signalRingServer();
+        pthread_join(ring_server.thread, NULL);
+    }
+    close(epoll_fd);
+    close(queue.event_fd);
+    close(listen_fd);
+    if (http_fd != -1) close(http_fd);
+    unlinkat(task_dir_fd, DAEMON_SOCKET_FILENAME, 0);
+    close(lock_fd); // Only now may another daemon start
+}
+
+// Aggregated reports over the whole store ('report --group-by status|tag|day')
+// The report works on the columns of a freshly loaded version (the done bitset, plus creation
+// times and tags derived per row) instead of on formatted listings: each task is assigned to its
+// groups through a hash table, counted in one pass, and the ages of each group are then sorted
+// once to read off percentiles.
+#define REPORT_KEY_MAX 48 // Longest group key (longer tags are cut)
+
+// One group of a report
+typedef struct {
+    char key[REPORT_KEY_MAX];
+    size_t key_length;
+    char label[REPORT_KEY_MAX]; // Name printed for the group
+    int64_t order;              // Groups are printed by ascending order, then label
+    uint64_t hash;
+    size_t tasks, done;
+    size_t aged;                // Tasks with a known creation time
+    size_t first_age;           // Where the group's ages start in the sorted age column
+} ReportGroup;
+
+// Hash aggregation table of report groups
+typedef struct {
+    ReportGroup *groups;
+    size_t count, capacity;
+    uint32_t *slots;            // Group index + 1, 0 for free slots
+    size_t slot_capacity;       // Power of two, kept at most half full
+} ReportGroups;
+
+// Function to find the next #tag of a description at or after 'from'
+// A tag starts at a word boundary and runs up to a space, ',' or another '#'. Returns NULL when
+// there are no more, and sets *length (including the '#') otherwise.
+const char *nextTag(const char *description, const char *from, size_t *length) {
+    for (const char *c = strchr(from, '#'); c != NULL; c = strchr(c + 1, '#')) {
+        const char *end = c + 1;
+        while (*end != '\0' && *end != ' ' && *end != '\t' && *end != '#' && *end != ',') end++;
+        if (end > c + 1 && (c == description || c[-1] == ' ' || c[-1] == '\t')) {
+            *length = (size_t)(end - c);
+            return c;
+        }
+    }
+    return NULL;
+}
+
+// Function to find a report group by key, creating it if needed
+// Sets *created for a new group, whose label and order the caller then fills in.
+uint32_t reportGroup(ReportGroups *groups, const char *key, size_t length, bool *created) {
+    if (length > REPORT_KEY_MAX - 1) length = REPORT_KEY_MAX - 1;
+    if (2 * (groups->count + 1) > groups->slot_capacity) {
+        size_t capacity = groups->slot_capacity ? groups->slot_capacity * 2 : 64;
+        uint32_t *slots = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+        for (size_t i = 0; i < groups->count; i++) {
+            size_t slot = groups->groups[i].hash & (capacity - 1);
+            while (slots[slot] != 0) slot = (slot + 1) & (capacity - 1);
+            slots[slot] = (uint32_t)i + 1;
+        }
+        free(groups->slots);
+        groups->slots = slots;
+        groups->slot_capacity = capacity;
+    }
+    uint64_t hash = hashBytes(key, length, 0);
+    size_t slot = hash & (groups->slot_capacity - 1);
+    for (; groups->slots[slot] != 0; slot = (slot + 1) & (groups->slot_capacity - 1)) {
+        const ReportGroup *group = &groups->groups[groups->slots[slot] - 1];
+        if (group->hash == hash && group->key_length == length && memcmp(group->key, key, length) == 0) {
+            *created = false;
+            return groups->slots[slot] - 1;
+        }
+    }
+    if (groups->count == groups->capacity) {
+        groups->capacity = groups->capacity ? groups->capacity * 2 : 64;
+        groups->groups = (ReportGroup *)realloc(groups->groups, groups->capacity * sizeof(ReportGroup));
+    }
+    ReportGroup *group = &groups->groups[groups->count];
+    memset(group, 0, sizeof(ReportGroup));
+    memcpy(group->key, key, length);
+    group->key_length = length;
+    memcpy(group->label, key, length);
+    group->hash = hash;
+    groups->slots[slot] = (uint32_t)groups->count + 1;
+    *created = true;
+    return (uint32_t)groups->count++;
+}
+
+// Function to order report groups for printing
+int compareReportGroups(const void *a, const void *b) {
+    const ReportGroup *x = (const ReportGroup *)a, *y = (const ReportGroup *)b;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return strcmp(x->label, y->label);
+}
+
+// Function to order ages
+int compareAges(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Function to count the done tasks of a table, 64 at a time
+size_t countDoneTasks(const TaskTable *table) {
+    size_t words = table->count / 64, done = 0;
+    for (size_t i = 0; i < words; i++) {
+        done += (size_t)__builtin_popcountll(table->done[i]);
+    }
+    if (table->count % 64 != 0) {
+        done += (size_t)__builtin_popcountll(table->done[words] & ((1ULL << (table->count % 64)) - 1));
+    }
+    return done;
+}
+
+// Function to get the creation time of every task of a version, by row (-1 if unknown)
+time_t *loadCreationTimes(const StoreVersion *version) {
+    size_t count;
+    CreationEntry *entries = loadCreationEntries(&count);
+    time_t *created = (time_t *)malloc((version->table.count + 1) * sizeof(time_t));
+    for (size_t i = 0; i < version->table.count; i++) {
+        created[i] = findCreationTime(entries, count, version->table.ids[i]);
+    }
+    free(entries);
+    return created;
+}
+
+// Function to format an age in seconds compactly ("45s", "12m", "5h", "3d")
+void formatAge(char *buffer, size_t size, int64_t age) {
+    if (age < 60) snprintf(buffer, size, "%llds", (long long)age);
+    else if (age < 3600) snprintf(buffer, size, "%lldm", (long long)(age / 60));
+    else if (age < 86400) snprintf(buffer, size, "%lldh", (long long)(age / 3600));
+    else snprintf(buffer, size, "%lldd", (long long)(age / 86400));
+}
+
+// Function to print one line of a report
+void printReportRow(const char *label, size_t tasks, size_t done, const int64_t *ages, size_t aged) {
+    char percentiles[3][16];
+    const int ranks[3] = {50, 90, 99};
+    for (int p = 0; p < 3; p++) {
+        if (aged == 0) {
+            snprintf(percentiles[p], sizeof(percentiles[p]), "-");
+        } else { // Nearest rank
+            size_t rank = (aged * ranks[p] + 99) / 100;
+            formatAge(percentiles[p], sizeof(percentiles[p]), ages[rank > 0 ? rank - 1 : 0]);
+        }
+    }
+    printf("%-24s %8zu %8zu %6.1f%% %7s %7s %7s\n", label, tasks, done,
+           tasks > 0 ? 100.0 * (double)done / (double)tasks : 0.0, percentiles[0], percentiles[1], percentiles[2]);
+}
+
+// Function to print a report of the store grouped by status, tag (#word in the description) or
+// day added
+// A task with several tags counts in each of their groups. Returns false for an unknown grouping.
+bool reportTasks(const char *group_by) {
+    bool by_status = strcmp(group_by, "status") == 0, by_tag = strcmp(group_by, "tag") == 0;
+    if (!by_status && !by_tag && strcmp(group_by, "day") != 0) {
+        return false;
+    }
+    StoreVersion *version = loadStoreVersion();
+    const TaskTable *table = &version->table;
+    time_t *created = loadCreationTimes(version);
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    int64_t offset = (int64_t)local.tm_gmtoff; // Days follow the current UTC offset
+
+    // Ages (seconds since added) as a column of their own
+    int64_t *ages = (int64_t *)malloc((table->count + 1) * sizeof(int64_t));
+    for (size_t i = 0; i < table->count; i++) {
+        ages[i] = created[i] < 0 ? -1 : (int64_t)(now - created[i]);
+    }
+
+    // Assign tasks to groups: one membership per task, or per tag of the task
+    ReportGroups groups = {NULL, 0, 0, NULL, 0};
+    size_t member_capacity = table->count + 1, member_count = 0;
+    uint32_t *member_group = (uint32_t *)malloc(member_capacity * sizeof(uint32_t));
+    uint32_t *member_row = (uint32_t *)malloc(member_capacity * sizeof(uint32_t));
+    bool created_group;
+    if (by_status) {
+        uint32_t pending = reportGroup(&groups, "pending", 7, &created_group);
+        uint32_t done = reportGroup(&groups, "done", 4, &created_group);
+        groups.groups[done].order = 1;
+        for (size_t i = 0; i < table->count; i++) {
+            member_group[i] = taskDone(table, i) ? done : pending;
+            member_row[i] = (uint32_t)i;
+        }
+        member_count = table->count;
+    } else if (by_tag) {
+        for (size_t i = 0; i < table->count; i++) {
+            const char *description = taskDescription(table, i);
+            size_t tags = 0, length;
+            for (const char *tag = nextTag(description, description, &length); tag != NULL;
+                 tag = nextTag(description, tag + length, &length)) {
+                if (member_count == member_capacity) {
+                    member_capacity *= 2;
+                    member_group = (uint32_t *)realloc(member_group, member_capacity * sizeof(uint32_t));
+                    member_row = (uint32_t *)realloc(member_row, member_capacity * sizeof(uint32_t));
+                }
+                member_group[member_count] = reportGroup(&groups, tag, length, &created_group);
+                member_row[member_count++] = (uint32_t)i;
+                tags++;
+            }
+            if (tags == 0) {
+                if (member_count == member_capacity) {
+                    member_capacity *= 2;
+                    member_group = (uint32_t *)realloc(member_group, member_capacity * sizeof(uint32_t));
+                    member_row = (uint32_t *)realloc(member_row, member_capacity * sizeof(uint32_t));
+                }
+                member_group[member_count] = reportGroup(&groups, "(untagged)", 10, &created_group);
+                if (created_group) groups.groups[member_group[member_count]].order = 1; // Last
+                member_row[member_count++] = (uint32_t)i;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < table->count; i++) {
+            // Local day number, floored for times before the epoch
+            int64_t local_time = created[i] < 0 ? INT64_MAX : (int64_t)created[i] + offset;
+            int64_t day = local_time == INT64_MAX ? INT64_MAX : (local_time - (local_time < 0 ? 86399 : 0)) / 86400;
+            member_group[i] = reportGroup(&groups, (const char *)&day, sizeof(day), &created_group);
+            member_row[i] = (uint32_t)i;
+            if (created_group) {
+                ReportGroup *group = &groups.groups[member_group[i]];
+                group->order = day;
+                if (day == INT64_MAX) {
+                    snprintf(group->label, sizeof(group->label), "unknown");
+                } else {
+                    time_t noon = (time_t)(day * 86400 - offset + 43200);
+                    struct tm tm;
+                    localtime_r(&noon, &tm);
+                    strftime(group->label, sizeof(group->label), "%Y-%m-%d", &tm);
+                }
+            }
+        }
+        member_count = table->count;
+    }
+
+    // Count, then gather each group's ages next to each other and sort them
+    for (size_t m = 0; m < member_count; m++) {
+        ReportGroup *group = &groups.groups[member_group[m]];
+        group->tasks++;
+        group->done += taskDone(table, member_row[m]);
+        group->aged += ages[member_row[m]] >= 0;
+    }
+    for (size_t g = 0; by_tag && g < groups.count; g++) {
+        if (groups.groups[g].order == 0) groups.groups[g].order = -(int64_t)groups.groups[g].tasks; // Largest first
+    }
+    size_t aged_total = 0;
+    for (size_t g = 0; g < groups.count; g++) {
+        groups.groups[g].first_age = aged_total;
+        aged_total += groups.groups[g].aged;
+    }
+    int64_t *group_ages = (int64_t *)malloc((aged_total + 1) * sizeof(int64_t));
+    size_t *fill = (size_t *)calloc(groups.count + 1, sizeof(size_t));
+    for (size_t m = 0; m < member_count; m++) {
+        int64_t age = ages[member_row[m]];
+        if (age >= 0) {
+            const ReportGroup *group = &groups.groups[member_group[m]];
+            group_ages[group->first_age + fill[member_group[m]]++] = age;
+        }
+    }
+    for (size_t g = 0; g < groups.count; g++) {
+        qsort(group_ages + groups.groups[g].first_age, groups.groups[g].aged, sizeof(int64_t), compareAges);
+    }
+
+    printf("%-24s %8s %8s %7s %7s %7s %7s\n", by_status ? "STATUS" : by_tag ? "TAG" : "DAY ADDED",
+           "TASKS", "DONE", "RATE", "AGE p50", "p90", "p99");
+    qsort(groups.groups, groups.count, sizeof(ReportGroup), compareReportGroups);
+    for (size_t g = 0; g < groups.count; g++) {
+        const ReportGroup *group = &groups.groups[g];
+        printReportRow(group->label, group->tasks, group->done, group_ages + group->first_age, group->aged);
+    }
+
+    // Totals over all tasks (not memberships, which count tagged tasks once per tag)
+    size_t aged = 0;
+    for (size_t i = 0; i < table->count; i++) {
+        if (ages[i] >= 0) ages[aged++] = ages[i];
+    }
+    qsort(ages, aged, sizeof(int64_t), compareAges);
+    printReportRow("all", table->count, countDoneTasks(table), ages, aged);
+
+    free(fill);
+    free(group_ages);
+    free(member_group);
+    free(member_row);
+    free(groups.groups);
+    free(groups.slots);
+    free(ages);
+    free(created);
+    freeStoreVersion(version);
+    return true;
+}
+
+// Query language ('query'), e.g.  status=pending and tag:ops and desc~"deploy" order by due limit 20
+// Predicates (joined with 'and'): status=pending|done, tag:WORD, desc~TEXT (case-insensitive
+// substring), id=N / id<N / id<=N / id>N / id>=N, and due<TIME / due<=TIME / due>TIME /
+// due>=TIME with the times 'due' accepts. Then optionally 'order by id|due|desc [asc|desc]' and
+// 'limit N'. A query is parsed once into a plan: an access path (the ID index for id bounds, the
+// due entries for due bounds, or a scan in file order) and filters ordered cheapest first. The
+// plan runs batch at a time: the scan fills a selection vector of up to QUERY_BATCH rows, every
+// filter compacts it, and the survivors go to a top-K heap, or straight out without an ordering.
+#define QUERY_BATCH 1024
+#define QUERY_MAX_FILTERS 16
+
+// Filters, in the order they are applied (cheapest first)
+typedef enum {
+    FILTER_ID,     // Only on the due access path; the ID index applies id bounds otherwise
+    FILTER_STATUS,
+    FILTER_DUE,
+    FILTER_TAG,
+    FILTER_TEXT
+} QueryFilterKind;
+
+typedef struct {
+    QueryFilterKind kind;
+    bool done;                      // FILTER_STATUS
+    char text[MAX_DESCRIPTION_LEN]; // FILTER_TAG (with its '#'), FILTER_TEXT
+} QueryFilter;
+
+typedef enum { ORDER_NONE, ORDER_ID, ORDER_DUE, ORDER_DESCRIPTION } QueryOrder;
+
+typedef enum { ACCESS_SCAN, ACCESS_ID_INDEX, ACCESS_DUE } QueryAccess;
+
+// A parsed query and its plan
+typedef struct {
+    int low, high;                  // ID bounds, inclusive
+    time_t due_low, due_high;       // Due bounds, inclusive (when has_due)
+    bool has_due;
+    QueryFilter filters[QUERY_MAX_FILTERS];
+    size_t filter_count;
+    QueryOrder order;
+    bool descending;
+    size_t limit;                   // 0 for no limit
+    QueryAccess access;
+    const StoreVersion *version;
+} Query;
+
+// Function to read the next token of a query
+// Tokens are words, "quoted strings" (returned without the quotes) and the operators
+// = ~ : < <= > >=. Returns false at the end of the text; *quoted tells strings from words.
+bool queryToken(const char **text, char *token, size_t size, bool *quoted) {
+    const char *c = *text;
+    while (*c == ' ' || *c == '\t') c++;
+    if (*c == '\0') {
+        *text = c;
+        return false;
+    }
+    size_t length = 0;
+    *quoted = *c == '"';
+    if (*quoted) {
+        for (c++; *c != '\0' && *c != '"'; c++) {
+            if (length < size - 1) token[length++] = *c;
+        }
+        if (*c == '"') c++;
+    } else if (strchr("=~:<>", *c) != NULL) {
+        token[length++] = *c++;
+        if ((token[0] == '<' || token[0] == '>') && *c == '=') token[length++] = *c++;
+    } else {
+        for (; *c != '\0' && strchr(" \t=~:<>\"", *c) == NULL; c++) {
+            if (length < size - 1) token[length++] = *c;
+        }
+    }
+    token[length] = '\0';
+    *text = c;
+    return true;
+}
+
+// Function to parse a query
+// Prints what is wrong and returns false for a malformed one.
+bool parseQuery(const char *text, Query *query) {
+    memset(query, 0, sizeof(Query));
+    query->low = 1;
+    query->high = INT_MAX;
+    query->due_low = (time_t)LLONG_MIN;
+    query->due_high = (time_t)LLONG_MAX;
+    char token[MAX_DESCRIPTION_LEN], op[4], value[MAX_DESCRIPTION_LEN];
+    bool quoted, expect_predicate = true;
+    while (queryToken(&text, token, sizeof(token), &quoted)) {
+        if (!quoted && strcmp(token, "and") == 0 && !expect_predicate) {
+            expect_predicate = true;
+            continue;
+        }
+        if (!quoted && strcmp(token, "order") == 0) {
+            if (!queryToken(&text, token, sizeof(token), &quoted) || strcmp(token, "by") != 0 ||
+                !queryToken(&text, token, sizeof(token), &quoted)) {
+                printf("Query error: expected 'order by id|due|desc'.\n");
+                return false;
             }
+            if (strcmp(token, "id") == 0) query->order = ORDER_ID;
+            else if (strcmp(token, "due") == 0) query->order = ORDER_DUE;
+            else if (strcmp(token, "desc") == 0) query->order = ORDER_DESCRIPTION;
+            else {
+                printf("Query error: cannot order by '%s' (id, due or desc).\n", token);
+                return false;
+            }
+            const char *rest = text;
+            if (queryToken(&rest, token, sizeof(token), &quoted) && (strcmp(token, "asc") == 0 || strcmp(token, "desc") == 0)) {
+                query->descending = token[0] == 'd';
+                text = rest;
+            }
+            expect_predicate = false;
+            continue;
         }
-        addTask(description);
-    } else if (strcmp(argv[1], "list") == 0) {
-        listTasks();
-    } else if (strcmp(argv[1], "done") == 0) {
-        if (argc < 3) {
-            printf("Usage: %s done <task_id>\n", argv[0]);
+        if (!quoted && strcmp(token, "limit") == 0) {
+            char *end;
+            long limit = queryToken(&text, token, sizeof(token), &quoted) ? strtol(token, &end, 10) : 0;
+            if (limit <= 0 || *end != '\0') {
+                printf("Query error: limit needs a positive number.\n");
+                return false;
+            }
+            query->limit = (size_t)limit;
+            expect_predicate = false;
+            continue;
+        }
+        if (!expect_predicate) {
+            printf("Query error: expected 'and', 'order by' or 'limit' before '%s'.\n", token);
+            return false;
+        }
+        if (!queryToken(&text, op, sizeof(op), &quoted) || quoted || strchr("=~:<>", op[0]) == NULL ||
+            !queryToken(&text, value, sizeof(value), &quoted)) {
+            printf("Query error: expected an operator and a value after '%s'.\n", token);
+            return false;
+        }
+        if (query->filter_count == QUERY_MAX_FILTERS - 2) { // planQuery() may add two
+            printf("Query error: too many conditions.\n");
+            return false;
+        }
+        QueryFilter *filter = &query->filters[query->filter_count];
+        if (strcmp(token, "status") == 0 && strcmp(op, "=") == 0 && (strcmp(value, "pending") == 0 || strcmp(value, "done") == 0)) {
+            filter->kind = FILTER_STATUS;
+            filter->done = value[0] == 'd';
+            query->filter_count++;
+        } else if (strcmp(token, "tag") == 0 && strcmp(op, ":") == 0 && value[0] != '\0') {
+            filter->kind = FILTER_TAG;
+            int length = snprintf(filter->text, sizeof(filter->text), "%s%s", value[0] == '#' ? "" : "#", value);
+            if (length < 0 || (size_t)length >= sizeof(filter->text)) {
+                printf("Query error: tag '%s' is too long.\n", value);
+                return false;
+            }
+            query->filter_count++;
+        } else if (strcmp(token, "desc") == 0 && strcmp(op, "~") == 0) {
+            filter->kind = FILTER_TEXT;
+            snprintf(filter->text, sizeof(filter->text), "%s", value);
+            query->filter_count++;
+        } else if (strcmp(token, "id") == 0 && strcmp(op, "~") != 0 && strcmp(op, ":") != 0) {
+            char *end;
+            long id = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || id < 0 || id > INT_MAX) {
+                printf("Query error: '%s' is not a task ID.\n", value);
+                return false;
+            }
+            long long low = op[0] == '>' ? id + (op[1] == '=' ? 0 : 1) : op[0] == '=' ? id : 1;
+            long long high = op[0] == '<' ? id - (op[1] == '=' ? 0 : 1) : op[0] == '=' ? id : INT_MAX;
+            if (low > INT_MAX || high < 1) { // Past the highest possible ID or below the lowest
+                low = INT_MAX;
+                high = 0;
+            }
+            if (low > query->low) query->low = (int)low;
+            if (high < query->high) query->high = (int)high;
+        } else if (strcmp(token, "due") == 0 && (op[0] == '<' || op[0] == '>')) {
+            time_t when = parseDueTime(value);
+            if (when <= 0) {
+                printf("Query error: invalid due time '%s'.\n", value);
+                return false;
+            }
+            if (op[0] == '>') {
+                time_t low = when + (op[1] == '=' ? 0 : 1);
+                if (low > query->due_low) query->due_low = low;
+            } else {
+                time_t high = when - (op[1] == '=' ? 0 : 1);
+                if (high < query->due_high) query->due_high = high;
+            }
+            query->has_due = true;
+        } else {
+            printf("Query error: unknown condition '%s%s%s'.\n", token, op, value);
+            return false;
+        }
+        expect_predicate = false;
+    }
+    if (expect_predicate && (query->filter_count > 0 || query->has_due || query->low > 1 || query->high < INT_MAX)) {
+        printf("Query error: expected a condition after 'and'.\n");
+        return false;
+    }
+    return true;
+}
+
+// Function to pick the access path and the filter order of a parsed query
+// The due entries are scanned instead of the tasks when there are due bounds and fewer entries
+// than tasks in the ID range; id bounds then become a filter.
+void planQuery(Query *query, const StoreVersion *version) {
+    query->version = version;
+    const uint32_t *positions;
+    size_t first, last;
+    versionRange(version, query->low, query->high, &positions, &first, &last);
+    if (query->has_due) {
+        if (version->due_count < last - first) {
+            query->access = ACCESS_DUE;
+            if (query->low > 1 || query->high < INT_MAX) {
+                query->filters[query->filter_count++].kind = FILTER_ID;
+            }
+        }
+        query->filters[query->filter_count++].kind = FILTER_DUE;
+    }
+    if (query->access != ACCESS_DUE) {
+        query->access = positions != NULL ? ACCESS_ID_INDEX : ACCESS_SCAN;
+    }
+    // Insertion sort keeps conditions of the same kind in query order
+    for (size_t i = 1; i < query->filter_count; i++) {
+        QueryFilter filter = query->filters[i];
+        size_t j = i;
+        for (; j > 0 && query->filters[j - 1].kind > filter.kind; j--) query->filters[j] = query->filters[j - 1];
+        query->filters[j] = filter;
+    }
+}
+
+// Function to keep the rows of a batch that pass one filter
+// Returns how many are left at the front of rows[].
+size_t applyQueryFilter(const Query *query, const QueryFilter *filter, uint32_t *rows, size_t count) {
+    const StoreVersion *version = query->version;
+    const TaskTable *table = &version->table;
+    size_t kept = 0;
+    switch (filter->kind) {
+    case FILTER_ID:
+        for (size_t i = 0; i < count; i++) {
+            int id = table->ids[rows[i]];
+            rows[kept] = rows[i];
+            kept += id >= query->low && id <= query->high;
+        }
+        break;
+    case FILTER_STATUS:
+        for (size_t i = 0; i < count; i++) {
+            rows[kept] = rows[i];
+            kept += taskDone(table, rows[i]) == filter->done;
+        }
+        break;
+    case FILTER_DUE:
+        for (size_t i = 0; i < count; i++) {
+            const DueEntry *due = findVersionDue(version, table->ids[rows[i]]);
+            rows[kept] = rows[i];
+            kept += due != NULL && due->due >= query->due_low && due->due <= query->due_high;
+        }
+        break;
+    case FILTER_TAG:
+        for (size_t i = 0; i < count; i++) {
+            const char *description = taskDescription(table, rows[i]);
+            size_t length, wanted = strlen(filter->text);
+            bool found = false;
+            for (const char *tag = nextTag(description, description, &length); tag != NULL && !found;
+                 tag = nextTag(description, tag + length, &length)) {
+                found = length == wanted && strncasecmp(tag, filter->text, length) == 0;
+            }
+            rows[kept] = rows[i];
+            kept += found;
+        }
+        break;
+    case FILTER_TEXT:
+        for (size_t i = 0; i < count; i++) {
+            rows[kept] = rows[i];
+            kept += strcasestr(taskDescription(table, rows[i]), filter->text) != NULL;
+        }
+        break;
+    }
+    return kept;
+}
+
+// Function to compare two rows in a query's output order (a qsort_r comparator)
+// Tasks without a due date come last when ordering by due, in either direction.
+int compareQueryRows(const void *a, const void *b, void *arg) {
+    const Query *query = (const Query *)arg;
+    const TaskTable *table = &query->version->table;
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    int result = 0;
+    if (query->order == ORDER_DUE) {
+        const DueEntry *dx = findVersionDue(query->version, table->ids[x]);
+        const DueEntry *dy = findVersionDue(query->version, table->ids[y]);
+        if ((dx == NULL) != (dy == NULL)) return dx == NULL ? 1 : -1;
+        if (dx != NULL && dx->due != dy->due) result = dx->due < dy->due ? -1 : 1;
+    } else if (query->order == ORDER_DESCRIPTION) {
+        result = strcasecmp(taskDescription(table, x), taskDescription(table, y));
+    }
+    if (result == 0) { // Ties (and ORDER_ID) by ID
+        result = (table->ids[x] > table->ids[y]) - (table->ids[x] < table->ids[y]);
+    }
+    return query->descending ? -result : result;
+}
+
+// Function to restore the heap property downwards in a top-K heap
+// The root is the row that would be printed last, so better rows replace it.
+void siftQueryHeap(const Query *query, uint32_t *heap, size_t count, size_t index) {
+    for (;;) {
+        size_t largest = index, left = 2 * index + 1, right = left + 1;
+        if (left < count && compareQueryRows(&heap[left], &heap[largest], (void *)query) > 0) largest = left;
+        if (right < count && compareQueryRows(&heap[right], &heap[largest], (void *)query) > 0) largest = right;
+        if (largest == index) return;
+        uint32_t swap = heap[index];
+        heap[index] = heap[largest];
+        heap[largest] = swap;
+        index = largest;
+    }
+}
+
+// Function to run a query against the store and print the matching tasks like 'list'
+// With --explain only the plan is printed. Returns the exit status.
+int runQuery(const char *text, bool explain) {
+    Query query;
+    if (!parseQuery(text, &query)) {
+        return 1;
+    }
+    StoreVersion *version = loadStoreVersion();
+    planQuery(&query, version);
+    const TaskTable *table = &version->table;
+    if (explain) {
+        static const char *const access[] = {"scan in file order", "ID index", "due entries"};
+        static const char *const filters[] = {"id", "status", "due", "tag", "desc"};
+        static const char *const orders[] = {"", "id", "due", "desc"};
+        printf("access: %s", access[query.access]);
+        if (query.low > query.high) printf(" (no ids)");
+        else if (query.high < INT_MAX) printf(" (ids %d-%d)", query.low, query.high);
+        else if (query.low > 1) printf(" (ids %d-)", query.low);
+        printf("\nfilters:");
+        for (size_t i = 0; i < query.filter_count; i++) printf(" %s", filters[query.filters[i].kind]);
+        if (query.order != ORDER_NONE) printf("\norder: %s %s", orders[query.order], query.descending ? "desc" : "asc");
+        if (query.limit > 0) printf("\n%s: %zu", query.order != ORDER_NONE ? "top-k" : "limit", query.limit);
+        printf("\n");
+        freeStoreVersion(version);
+        return 0;
+    }
+
+    const uint32_t *positions;
+    size_t first, last;
+    versionRange(version, query.low, query.high, &positions, &first, &last);
+    if (query.access == ACCESS_DUE) {
+        positions = NULL;
+        first = 0;
+        last = version->due_count;
+    }
+
+    // Rows that made it through: the top-K heap, or every match when there is no limit
+    size_t output_capacity = query.limit > 0 ? query.limit : 1024, output_count = 0;
+    uint32_t *output = (uint32_t *)malloc(output_capacity * sizeof(uint32_t));
+    uint32_t batch[QUERY_BATCH];
+    bool full = false; // A limit without ordering is satisfied
+    for (size_t start = first; start < last && !full; start += QUERY_BATCH) {
+        // Scan: one batch of rows from the access path
+        size_t end = start + QUERY_BATCH < last ? start + QUERY_BATCH : last, count = 0;
+        for (size_t i = start; i < end; i++) {
+            if (query.access == ACCESS_DUE) {
+                size_t row;
+                if (findVersionTask(version, version->dues[i].id, &row)) batch[count++] = (uint32_t)row;
+            } else {
+                batch[count++] = positions != NULL ? positions[i] : (uint32_t)i;
+            }
+        }
+        // Filter
+        for (size_t f = 0; f < query.filter_count && count > 0; f++) {
+            count = applyQueryFilter(&query, &query.filters[f], batch, count);
+        }
+        // Top-K (or collect)
+        for (size_t i = 0; i < count; i++) {
+            if (query.order != ORDER_NONE && query.limit > 0 && output_count == query.limit) {
+                if (compareQueryRows(&batch[i], &output[0], &query) < 0) {
+                    output[0] = batch[i];
+                    siftQueryHeap(&query, output, output_count, 0);
+                }
+                continue;
+            }
+            if (output_count == output_capacity) {
+                output_capacity *= 2;
+                output = (uint32_t *)realloc(output, output_capacity * sizeof(uint32_t));
+            }
+            output[output_count++] = batch[i];
+            if (query.order != ORDER_NONE && query.limit > 0 && output_count == query.limit) {
+                for (size_t k = output_count / 2; k-- > 0;) siftQueryHeap(&query, output, output_count, k);
+            } else if (query.order == ORDER_NONE && output_count == query.limit) {
+                full = true;
+                break;
+            }
+        }
+    }
+    if (query.order != ORDER_NONE) {
+        qsort_r(output, output_count, sizeof(uint32_t), compareQueryRows, &query);
+    }
+
+    // Project
+    printf("\n%s%s------------------------------------------------------%s\n", ANSI_BOLD, ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    for (size_t i = 0; i < output_count; i++) {
+        uint32_t row = output[i];
+        printTaskRow(stdout, table->ids[row], taskDone(table, row), taskDescription(table, row), findVersionDue(version, table->ids[row]));
+    }
+    if (output_count == 0) {
+        printf("No tasks found.\n");
+    }
+    printf("%s------------------------------------------------------%s\n\n", ANSI_COLOR_CYAN, ANSI_COLOR_RESET);
+    free(output);
+    freeStoreVersion(version);
+    return 0;
+}
+
+// One command read by 'batch'
+typedef struct {
+    char op;              // 'A' add, 'C' done, 'P' pending, 'X' delete
+    char *description;    // For 'A'
+    int *ids;             // For the others
+    size_t id_count;
+} BatchCommand;
+
+// Function to read 'batch' commands, one per line in command-line syntax ("done 4 7")
+// Malformed lines are reported and skipped. With a byte budget (0: none) reading stops once the
+// commands take about that much memory; *line_number carries on across calls.
+BatchCommand *readBatchCommands(FILE *in, size_t *count, size_t budget, int *line_number) {
+    size_t capacity = 64;
+    BatchCommand *commands = (BatchCommand *)malloc(capacity * sizeof(BatchCommand));
+    Arena *arena = scratchArena(); // Descriptions and ID lists
+    size_t arena_start = arena->bytes;
+    *count = 0;
+    char line[MAX_DESCRIPTION_LEN + 32];
+    while ((budget == 0 || capacity * sizeof(BatchCommand) + arena->bytes - arena_start < budget) &&
+           fgets(line, sizeof(line), in) != NULL) {
+        (*line_number)++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *save = NULL;
+        char *verb = strtok_r(line, " \t", &save);
+        if (verb == NULL) {
+            continue;
+        }
+        BatchCommand command;
+        memset(&command, 0, sizeof(command));
+        if (strcmp(verb, "add") == 0) {
+            char *rest = save + strspn(save, " \t");
+            if (*rest == '\0') {
+                fprintf(stderr, "Line %d: missing description.\n", *line_number);
+                continue;
+            }
+            command.op = 'A';
+            size_t length = strnlen(rest, MAX_DESCRIPTION_LEN - 1);
+            command.description = (char *)arenaAlloc(arena, length + 1);
+            memcpy(command.description, rest, length);
+            command.description[length] = '\0';
+        } else if (strcmp(verb, "done") == 0 || strcmp(verb, "pending") == 0 || strcmp(verb, "delete") == 0) {
+            command.op = verb[0] == 'd' ? (verb[1] == 'o' ? 'C' : 'X') : 'P';
+            command.ids = (int *)arenaAlloc(arena, (strlen(save) / 2 + 2) * sizeof(int)); // At most one ID per two characters
+            for (char *token = strtok_r(NULL, " \t", &save); token != NULL; token = strtok_r(NULL, " \t", &save)) {
+                int id = atoi(token);
+                if (id <= 0) {
+                    command.id_count = 0;
+                    break;
+                }
+                command.ids[command.id_count++] = id;
+            }
+            if (command.id_count == 0) {
+                fprintf(stderr, "Line %d: invalid task ID.\n", *line_number);
+                continue;
+            }
+        } else {
+            fprintf(stderr, "Line %d: unknown command: %s\n", *line_number, verb);
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            commands = (BatchCommand *)realloc(commands, capacity * sizeof(BatchCommand));
+        }
+        commands[(*count)++] = command;
+    }
+    return commands;
+}
+
+// Function to print the outcome of one 'batch' command the way the single commands do
+// Returns the exit status the command has when run on its own.
+int printBatchResult(const BatchCommand *command, int status, int new_id, const bool *found) {
+    if (command->op == 'A') {
+        if (status == 0) printf("Task added: ID %d - \"%s\"\n", new_id, command->description);
+        else if (status == 2) printf("Task not added: duplicate of pending task ID %d.\n", new_id);
+        else if (status == 3) printf("Task already exists: ID %d - \"%s\"\n", new_id, command->description);
+        else printf("Failed to add \"%s\".\n", command->description);
+        return status == 0 || status == 3 ? 0 : 1;
+    }
+    if (status != 0) {
+        printf("No tasks found.\n");
+        return 0;
+    }
+    for (size_t i = 0; i < command->id_count; i++) {
+        if (!found[i]) printf("Task ID %d not found.\n", command->ids[i]);
+        else if (command->op == 'X') printf("Task ID %d deleted.\n", command->ids[i]);
+        else printf("Task ID %d marked as %s.\n", command->ids[i], command->op == 'C' ? "DONE" : "PENDING");
+    }
+    return 0;
+}
+
+// Function to connect to the daemon serving this task directory
+// Returns the socket, or -1 if no daemon is listening.
+int connectDaemon() {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int length = snprintf(address.sun_path, sizeof(address.sun_path), "%s/%s", task_dir_path, DAEMON_SOCKET_FILENAME);
+    if (length < 0 || (size_t)length >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to find the most IDs any one 'batch' command names (to size per-command buffers)
+size_t maxBatchIds(const BatchCommand *commands, size_t count) {
+    size_t most = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].id_count > most) most = commands[i].id_count;
+    }
+    return most;
+}
+
+// Function to run 'batch' commands through the daemon over the binary protocol
+// Every request is written without waiting for answers (pipelining); responses are read as they
+// arrive, so the whole batch costs about one round trip and the daemon can commit it as a group.
+bool runBatchThroughDaemon(int fd, const BatchCommand *commands, size_t count) {
+    char *request = NULL;
+    size_t request_length = 1, request_capacity = 0;
+    reserveBuffer(&request, &request_capacity, 1);
+    request[0] = (char)WIRE_MAGIC;
+    size_t most_ids = maxBatchIds(commands, count);
+    uint32_t *ids = (uint32_t *)malloc((most_ids + 1) * sizeof(uint32_t)); // One command's IDs in wire format
+    bool *found = (bool *)malloc(most_ids + 1); // One command's results
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].op == 'A') {
+            appendFrame(&request, &request_length, &request_capacity, 'A', commands[i].description, strlen(commands[i].description));
+        } else {
+            for (size_t k = 0; k < commands[i].id_count; k++) ids[k] = (uint32_t)commands[i].ids[k];
+            appendFrame(&request, &request_length, &request_capacity, commands[i].op, ids, commands[i].id_count * sizeof(uint32_t));
+        }
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    char *response = NULL;
+    size_t response_length = 0, response_capacity = 0, request_sent = 0, answered = 0;
+    bool ok = true;
+    while (answered < count && ok) {
+        struct pollfd descriptor;
+        descriptor.fd = fd;
+        descriptor.events = POLLIN | (request_sent < request_length ? POLLOUT : 0);
+        if (poll(&descriptor, 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if ((descriptor.revents & POLLOUT) && request_sent < request_length) {
+            ssize_t sent = send(fd, request + request_sent, request_length - request_sent, MSG_NOSIGNAL);
+            if (sent > 0) request_sent += (size_t)sent;
+            else if (errno != EAGAIN && errno != EINTR) ok = false;
+        }
+        if (descriptor.revents & (POLLIN | POLLHUP | POLLERR)) {
+            reserveBuffer(&response, &response_capacity, response_length + 65536);
+            ssize_t got = recv(fd, response + response_length, response_capacity - response_length, 0);
+            if (got == 0) ok = false; // Daemon went away
+            else if (got > 0) response_length += (size_t)got;
+            else if (errno != EAGAIN && errno != EINTR) ok = false;
+        }
+
+        // Print every complete 'R' frame, in request order
+        size_t offset = 0;
+        while (offset + 4 <= response_length) {
+            uint32_t frame_length;
+            memcpy(&frame_length, response + offset, 4);
+            if (offset + 4 + frame_length > response_length) break;
+            const char *payload = response + offset + 5;
+            int32_t status;
+            memcpy(&status, payload, 4);
+            const BatchCommand *command = &commands[answered++];
+            int new_id = 0;
+            if (command->op == 'A') {
+                memcpy(&new_id, payload + 4, 4);
+            } else {
+                for (size_t k = 0; k < command->id_count; k++) found[k] = payload[4 + k] != 0;
+            }
+            printBatchResult(command, status, new_id, found);
+            offset += 4 + frame_length;
+        }
+        if (offset > 0) {
+            memmove(response, response + offset, response_length - offset);
+            response_length -= offset;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: lost the daemon after %zu of %zu commands.\n", answered, count);
+    }
+    free(request);
+    free(response);
+    free(ids);
+    free(found);
+    return ok;
+}
+
+// Function to ask the daemon for a shared-memory ring on a fresh connection
+// Returns the mapped ring, or NULL if the daemon offers none (the connection is then spent).
+SharedRing *mapDaemonRing(int fd) {
+    char request[6];
+    uint32_t frame_length = 1;
+    request[0] = (char)WIRE_MAGIC;
+    memcpy(request + 1, &frame_length, 4);
+    request[5] = 'M';
+    if (send(fd, request, sizeof(request), MSG_NOSIGNAL) != (ssize_t)sizeof(request)) {
+        return NULL;
+    }
+    char frame[9];
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec vector = {frame, sizeof(frame)};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t got = recvmsg(fd, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    int memfd = -1;
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        memcpy(&memfd, CMSG_DATA(header), sizeof(int));
+    }
+    uint32_t slot_count = 0;
+    memcpy(&frame_length, frame, 4);
+    if (got == (ssize_t)sizeof(frame) && frame_length == 5 && frame[4] == 'M') {
+        memcpy(&slot_count, frame + 5, 4);
+    }
+    SharedRing *ring = NULL;
+    struct stat st;
+    if (memfd != -1 && slot_count == RING_SLOTS && fstat(memfd, &st) == 0 && st.st_size >= (off_t)sizeof(SharedRing)) {
+        void *memory = mmap(NULL, sizeof(SharedRing), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (memory != MAP_FAILED) {
+            ring = (SharedRing *)memory;
+        }
+    }
+    if (memfd != -1) {
+        close(memfd);
+    }
+    if (ring != NULL && (ring->magic != RING_MAGIC || ring->slot_count != RING_SLOTS)) {
+        munmap(ring, sizeof(SharedRing));
+        ring = NULL;
+    }
+    return ring;
+}
+
+// Function to wait until the daemon has answered more than 'seen' requests on a ring
+// Polls first, then sleeps on the futex; every RING_WAIT_MS asleep it checks that the daemon is
+// still there (its end of the socket closes when it exits). Returns false if it went away.
+bool waitForRingAnswers(SharedRing *ring, int fd, uint32_t seen, uint32_t *answered) {
+    for (int spin = 0, spins = ringSpin(); spin < spins; spin++) {
+        if ((*answered = __atomic_load_n(&ring->answered, __ATOMIC_ACQUIRE)) != seen) {
+            return true;
+        }
+        cpuRelax();
+    }
+    for (;;) {
+        __atomic_store_n(&ring->client_sleeping, 1, __ATOMIC_SEQ_CST);
+        if ((*answered = __atomic_load_n(&ring->answered, __ATOMIC_SEQ_CST)) == seen) {
+            struct timespec timeout = {0, RING_WAIT_MS * 1000000L};
+            syscall(SYS_futex, &ring->answered, FUTEX_WAIT, seen, &timeout, NULL, 0);
+            *answered = __atomic_load_n(&ring->answered, __ATOMIC_SEQ_CST);
+        }
+        __atomic_store_n(&ring->client_sleeping, 0, __ATOMIC_RELAXED);
+        if (*answered != seen) {
+            return true;
+        }
+        struct pollfd descriptor = {fd, POLLIN, 0};
+        if (poll(&descriptor, 1, 0) == 1) { // The daemon never writes after the 'M' frame: EOF
+            return false;
+        }
+    }
+}
+
+// Function to run 'batch' commands through the daemon's shared-memory ring
+// Requests are written straight into the ring's slots, up to RING_SLOTS ahead of the answers;
+// a command with more than RING_MAX_IDS IDs takes several slots. Unless it is NULL, *exit_status
+// is set to 1 if any command failed as it would on its own, and to 0 otherwise.
+bool runBatchThroughRing(SharedRing *ring, int fd, const BatchCommand *commands, size_t count, int *exit_status) {
+    size_t most_ids = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].id_count > most_ids) most_ids = commands[i].id_count;
+    }
+    bool *found = (bool *)arenaAlloc(scratchArena(), most_ids + 1);
+    uint32_t submitted = 0, answered = 0, collected = 0; // A new ring starts at 0
+    size_t next = 0, next_id = 0;     // Next command (and ID within it) to submit
+    size_t finished = 0, found_count = 0;
+    int status = 0, failed = 0;
+    bool ok = true;
+    while (finished < count) {
+        uint32_t before = submitted;
+        for (; next < count && submitted - collected < RING_SLOTS; submitted++) {
+            RingSlot *slot = &ring->slots[submitted % RING_SLOTS];
+            const BatchCommand *command = &commands[next];
+            slot->op = (uint32_t)command->op;
+            if (command->op == 'A') {
+                slot->length = (uint32_t)strlen(command->description);
+                memcpy(slot->description, command->description, slot->length);
+                next++;
+                continue;
+            }
+            size_t ids = command->id_count - next_id < RING_MAX_IDS ? command->id_count - next_id : RING_MAX_IDS;
+            for (size_t k = 0; k < ids; k++) slot->ids[k] = command->ids[next_id + k];
+            slot->length = (uint32_t)ids;
+            next_id += ids;
+            if (next_id == command->id_count) {
+                next++;
+                next_id = 0;
+            }
+        }
+        if (submitted != before) {
+            ringPublish(&ring->submitted, submitted, &ring->daemon_sleeping);
+        }
+        if (!waitForRingAnswers(ring, fd, collected, &answered)) {
+            ok = false;
+            break;
+        }
+
+        // Collect the answers in order; print a command once all of its slots are answered
+        for (; collected != answered && collected != submitted; collected++) {
+            const RingSlot *slot = &ring->slots[collected % RING_SLOTS];
+            const BatchCommand *command = &commands[finished];
+            if (command->op == 'A') {
+                failed |= printBatchResult(command, slot->status, slot->id, NULL);
+                finished++;
+                continue;
+            }
+            if (slot->status != 0) status = slot->status;
+            size_t ids = command->id_count - found_count < RING_MAX_IDS ? command->id_count - found_count : RING_MAX_IDS;
+            for (size_t k = 0; k < ids; k++) found[found_count++] = slot->found[k] != 0;
+            if (found_count == command->id_count) {
+                failed |= printBatchResult(command, status, 0, found);
+                finished++;
+                found_count = 0;
+                status = 0;
+            }
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: lost the daemon after %zu of %zu commands.\n", finished, count);
+    }
+    if (exit_status != NULL) {
+        *exit_status = ok ? failed : 1;
+    }
+    return ok;
+}
+
+// Function to apply 'batch' commands to the files directly
+// All adds are appended with one write and all other commands applied with one rewrite.
+void runBatchLocally(const BatchCommand *commands, size_t count) {
+    size_t add_count = 0, mutation_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].op == 'A') add_count++;
+        else mutation_count += commands[i].id_count;
+    }
+    Arena *arena = scratchArena();
+    const char **descriptions = (const char **)arenaAlloc(arena, (add_count + 1) * sizeof(char *));
+    int *new_ids = (int *)arenaAlloc(arena, (add_count + 1) * sizeof(int));
+    Mutation *mutations = (Mutation *)arenaAlloc(arena, (mutation_count + 1) * sizeof(Mutation));
+    bool *found = (bool *)arenaAlloc(arena, maxBatchIds(commands, count) + 1); // One command's results
+    size_t a = 0, m = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].op == 'A') {
+            descriptions[a++] = commands[i].description;
+        }
+        for (size_t k = 0; k < commands[i].id_count; k++, m++) {
+            mutations[m].id = commands[i].ids[k];
+            mutations[m].op = commands[i].op;
+        }
+    }
+    UniquePolicy policy = add_count == 0 ? UNIQUE_OFF : uniquePolicy();
+    bool *duplicates = (bool *)arenaAlloc(arena, add_count + 1);
+    bool added = add_count == 0 || addTasks(descriptions, add_count, new_ids, policy, duplicates);
+    bool applied = mutation_count == 0 || applyMutations(mutations, mutation_count);
+    a = m = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t k = 0; k < commands[i].id_count; k++, m++) found[k] = mutations[m].found;
+        if (commands[i].op == 'A') {
+            int status = !added ? 1 : !duplicates[a] ? 0 : policy == UNIQUE_MERGE ? 3 : 2;
+            printBatchResult(&commands[i], status, new_ids[a++], found);
+        } else {
+            printBatchResult(&commands[i], applied ? 0 : 1, 0, found);
+        }
+    }
+}
+
+// Function to run the 'batch' command: apply many commands read from standard input
+// Through a running daemon the commands are pipelined; otherwise they are applied to the files
+// directly. Either way adds come first. With 'ring' they go through a shared-memory ring if the
+// daemon offers one. Under a memory limit the commands are read and applied a quarter of the
+// limit at a time instead of all at once.
+void runBatch(FILE *in, bool ring) {
+    int line_number = 0;
+    do {
+        size_t count;
+        BatchCommand *commands = readBatchCommands(in, &count, memory_limit / 4, &line_number);
+        int fd = count > 0 ? connectDaemon() : -1;
+        SharedRing *shared = ring && fd != -1 ? mapDaemonRing(fd) : NULL;
+        if (ring && fd != -1 && shared == NULL) { // No ring: the socket then, on a connection of its own
+            close(fd);
+            fd = connectDaemon();
+        }
+        if (shared != NULL) {
+            runBatchThroughRing(shared, fd, commands, count, NULL);
+            munmap(shared, sizeof(SharedRing));
+            close(fd);
+        } else if (fd != -1) {
+            runBatchThroughDaemon(fd, commands, count);
+            close(fd);
+        } else if (count > 0) {
+            runBatchLocally(commands, count);
+        }
+        free(commands);
+        arenaReset(scratchArena(), true);
+    } while (!feof(in) && !ferror(in));
+}
+
+// Function to run add, done, pending or delete through a shared-memory ring of the daemon
+// The command goes into the ring as one request (or one per RING_MAX_IDS IDs) and its answer is
+// printed the way the command prints it. Returns the command's exit status, or -1 if nothing was
+// sent: the command is another one, has to go through the socket to behave the same ('add
+// --unique', an empty description, an invalid ID, whose error the daemon reports), or the
+// daemon offers no ring.
+int forwardThroughRing(int argc, char *argv[]) {
+    if (argc < 3) {
+        return -1; // Usage errors come from the daemon
+    }
+    BatchCommand command;
+    memset(&command, 0, sizeof(command));
+    char description[MAX_DESCRIPTION_LEN];
+    if (strcmp(argv[1], "add") == 0) {
+        joinDescription(description, argc, argv, 2);
+        if (strcmp(argv[2], "--unique") == 0 || description[0] == '\0') {
+            return -1;
+        }
+        command.op = 'A';
+        command.description = description;
+    } else if (strcmp(argv[1], "done") == 0 || strcmp(argv[1], "pending") == 0 || strcmp(argv[1], "delete") == 0) {
+        command.op = argv[1][0] == 'p' ? 'P' : argv[1][1] == 'o' ? 'C' : 'X';
+        command.id_count = (size_t)(argc - 2);
+        command.ids = (int *)arenaAlloc(scratchArena(), command.id_count * sizeof(int));
+        for (size_t i = 0; i < command.id_count; i++) {
+            command.ids[i] = atoi(argv[i + 2]);
+            if (command.ids[i] <= 0) {
+                return -1;
+            }
+        }
+    } else {
+        return -1;
+    }
+
+    int fd = connectDaemon();
+    if (fd == -1) {
+        return -1;
+    }
+    SharedRing *ring = mapDaemonRing(fd);
+    if (ring == NULL) {
+        close(fd);
+        return -1;
+    }
+    int status;
+    runBatchThroughRing(ring, fd, &command, 1, &status);
+    munmap(ring, sizeof(SharedRing));
+    close(fd);
+    return status;
+}
+
+// Function to run a store command through the daemon serving this task directory
+// add, done, pending and delete go through a shared-memory ring when the daemon offers one.
+// Otherwise the arguments travel as one 'V' frame of the binary protocol, each ending in a NUL, so they
+// reach the daemon exactly as given; the answer is an 'O' frame with the exit status and output.
+// Returns the command's exit status, or -1 if no daemon took the request (the caller then runs
+// the command itself). A request that was sent is never run again here: if its answer is lost,
+// the daemon may already have applied it, so that is reported as a failure.
+int forwardToDaemon(int argc, char *argv[]) {
+    int ring_status = forwardThroughRing(argc, argv);
+    if (ring_status != -1) {
+        return ring_status;
+    }
+    size_t payload_length = 0;
+    for (int i = 1; i < argc; i++) {
+        payload_length += strlen(argv[i]) + 1;
+    }
+    if (1 + payload_length > WIRE_MAX_FRAME) {
+        return -1; // Too long for one frame
+    }
+    int fd = connectDaemon();
+    if (fd == -1) {
+        return -1;
+    }
+    char *payload = (char *)malloc(payload_length + 1);
+    size_t filled = 0;
+    for (int i = 1; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1; // With its NUL
+        memcpy(payload + filled, argv[i], length);
+        filled += length;
+    }
+    char *request = NULL;
+    size_t request_length = 1, request_capacity = 0;
+    reserveBuffer(&request, &request_capacity, 1);
+    request[0] = (char)WIRE_MAGIC;
+    appendFrame(&request, &request_length, &request_capacity, 'V', payload, payload_length);
+    free(payload);
+    size_t sent = 0;
+    while (sent < request_length) {
+        ssize_t written = send(fd, request + sent, request_length - sent, MSG_NOSIGNAL);
+        if (written == -1 && errno == EINTR) continue;
+        if (written <= 0) break;
+        sent += (size_t)written;
+    }
+    free(request);
+    if (sent < request_length) { // The daemon never had a whole request, so nothing ran
+        close(fd);
+        return -1;
+    }
+
+    FILE *stream = fdopen(fd, "r");
+    uint32_t frame_length;
+    char opcode;
+    int32_t status;
+    bool answered = fread(&frame_length, 4, 1, stream) == 1 && frame_length >= 5 &&
+                    fread(&opcode, 1, 1, stream) == 1 && opcode == 'O' && fread(&status, 4, 1, stream) == 1;
+    size_t remaining = answered ? frame_length - 5 : 0;
+    char buffer[8192];
+    while (remaining > 0) {
+        size_t got = fread(buffer, 1, remaining < sizeof(buffer) ? remaining : sizeof(buffer), stream);
+        if (got == 0) break;
+        fwrite(buffer, 1, got, stdout);
+        remaining -= got;
+    }
+    fclose(stream);
+    if (!answered || remaining > 0) {
+        fprintf(stderr, "Error: the daemon did not answer; the command may or may not have been applied.\n");
+        return 1;
+    }
+    return status;
+}
+
+// Function to start a daemon for this task directory in the background
+// The forked child detaches and runs 'serve --idle-timeout DAEMON_IDLE_MINUTES'; the
+// caller goes on to run its own command directly. If another daemon holds the lock (one is just
+// starting up), nothing is started.
+void spawnDaemon() {
+    int lock_fd = openStoreFile(DAEMON_LOCK_FILENAME, O_RDWR | O_CREAT);
+    if (lock_fd == -1) {
+        return;
+    }
+    bool running = flock(lock_fd, LOCK_EX | LOCK_NB) == -1;
+    close(lock_fd); // Releases the probe; the daemon takes the lock itself
+    if (running) {
+        return;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid != 0) {
+        return; // Parent (or fork failed): carry on without waiting
+    }
+    setsid(); // Detach from the terminal and the caller's process group
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) close(null_fd);
+    }
+    // Re-executing gives the daemon a clean process (and an honest name in ps)
+    char idle[16];
+    snprintf(idle, sizeof(idle), "%d", DAEMON_IDLE_MINUTES);
+    char self[MAX_PATH_LEN];
+    ssize_t self_length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (self_length > 0) {
+        self[self_length] = '\0';
+        execl(self, "tasakman", "serve", "--idle-timeout", idle, (char *)NULL);
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    serveDaemon(cpus < 2 ? 2 : (int)cpus, 0, DAEMON_IDLE_MINUTES);
+    _exit(0);
+}
+
+// When the traced command started (see printTrace())
+uint64_t trace_start = 0;
+
+// Function to report what a command cost on stderr (registered with atexit by --trace)
+void printTrace() {
+    fflush(stdout); // Keep the report after the command's own output
+    arenaReset(&command_arena, false); // Counts the command arena into the totals
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "trace: %.3f ms, %zu arena allocation%s (%zu bytes) from %zu heap block%s, peak RSS %ld KiB\n",
+            (double)(nowNanoseconds() - trace_start) / 1e6, arena_totals.allocations,
+            arena_totals.allocations == 1 ? "" : "s", arena_totals.bytes, arena_totals.blocks,
+            arena_totals.blocks == 1 ? "" : "s", usage.ru_maxrss);
+}
+
+// The command being run, for the command__done probe
+const char *probe_command = NULL;
+
+// Function to fire the command__done probe as the command exits (registered with atexit)
+void probeCommandDone() {
+    TASAKMAN_PROBE1(command__done, probe_command);
+}
+
+// Main function to handle command-line arguments
+int main(int argc, char *argv[]) {
+    current_arena = &command_arena; // Temporary data of the command (released when the process exits)
+    const char *mem_limit = getenv("TASAKMAN_MEM_LIMIT");
+    if (mem_limit != NULL && mem_limit[0] != '\0' && !parseByteSize(mem_limit, &memory_limit)) {
+        fprintf(stderr, "Error: invalid TASAKMAN_MEM_LIMIT: %s\n", mem_limit);
+        return 1;
+    }
+    // Options before the command: '--trace' reports its time, allocations and peak RSS on
+    // stderr, '--mem-limit SIZE' bounds what it buffers in memory
+    while (argc >= 2 && (strcmp(argv[1], "--trace") == 0 || strcmp(argv[1], "--mem-limit") == 0)) {
+        int used = 1;
+        if (argv[1][2] == 't') {
+            trace_enabled = true;
+            trace_start = nowNanoseconds();
+            atexit(printTrace);
+        } else if (argc < 3 || !parseByteSize(argv[2], &memory_limit)) {
+            fprintf(stderr, "Error: --mem-limit needs a size like 512M.\n");
             return 1;
+        } else {
+            used = 2;
         }
-        int taskId = atoi(argv[2]);
-        if (taskId <= 0) {
-            printf("Invalid task ID. Please provide a positive integer.\n");
+        argv[used] = argv[0];
+        argv += used;
+        argc -= used;
+    }
+
+    // --- IMPORTANT: Initialize the task directory path and ensure the directory exists ---
+    // TASAKMAN_DIR points the commands at another store, e.g. a follower kept by 'replicate'
+    const char *store_dir = getenv("TASAKMAN_DIR");
+    if (store_dir != NULL && store_dir[0] != '\0') {
+        snprintf(task_dir_path, sizeof(task_dir_path), "%s", store_dir);
+    } else {
+        const char *home_dir = getenv("HOME");
+        if (home_dir == NULL) {
+            fprintf(stderr, "Error: HOME environment variable not set. Cannot determine task file path.\n");
             return 1;
         }
-        modifyTaskStatus(taskId, true);
-    } else if (strcmp(argv[1], "pending") == 0) {
+        snprintf(task_dir_path, sizeof(task_dir_path), "%s%s", home_dir, TASK_DIR_SUFFIX);
+    }
+
+    // Open the directory ~/.local/taskmanager, creating it if it doesn't exist yet
+    openTaskDirectory();
+    // --- END IMPORTANT INITIALIZATION ---
+
+    if (argc < 2) {
+        printf("Usage: %s [--trace] [--mem-limit SIZE] <command>\n", argv[0]);
+        printf("  %s add [--unique] <description>\n", argv[0]);
+        printf("  %s list [--id-range A-B] [--sort-by description|created|due|priority] [--limit K]\n", argv[0]);
+        printf("  %s done <task_id>...\n", argv[0]);
+        printf("  %s pending <task_id>...\n", argv[0]);
+        printf("  %s delete <task_id>...\n", argv[0]);
+        printf("  %s due <task_id> <YYYY-MM-DD [HH:MM]|+N[m|h|d]|none>\n", argv[0]);
+        printf("  %s remind [--exec <command>]\n", argv[0]);
+        printf("  %s diff <storeA> <storeB>\n", argv[0]);
+        printf("  %s replicate --to <dir> [--once]\n", argv[0]);
+        printf("  %s merge <store>\n", argv[0]);
+        printf("  %s backup <dir>\n", argv[0]);
+        printf("  %s restore <dir> [snapshot] [--to <dir>]\n", argv[0]);
+        printf("  %s serve [--workers N] [--http <port>] [--idle-timeout <minutes>]\n", argv[0]);
+        printf("  %s batch [--ring] < commands\n", argv[0]);
+        printf("  %s policy [unique off|reject|merge]\n", argv[0]);
+        printf("  %s report --group-by status|tag|day\n", argv[0]);
+        printf("  %s query [--explain] '<query>'\n", argv[0]);
+        printf("  %s metrics [--prometheus]\n", argv[0]);
+        return 1;
+    }
+    probe_command = argv[1];
+    TASAKMAN_PROBE1(command__start, probe_command);
+    atexit(probeCommandDone); // Every command ends in exit(), however it returns
+
+    // Store commands go to the daemon when one is running, and start one for next time when
+    // not; this invocation then runs directly against the files, as without a daemon.
+    // TASAKMAN_NO_DAEMON=1 (or --trace, which measures this process) always runs directly.
+    const char *store_commands[] = {"add", "list", "done", "pending", "delete", "due"};
+    const char *sort_memory = getenv("TASAKMAN_SORT_MEMORY");
+    if (sort_memory != NULL && atol(sort_memory) > 0) {
+        sort_memory_budget = (size_t)atol(sort_memory) << 20;
+    }
+    if (memory_limit > 0 && sort_memory_budget > memory_limit / 2) {
+        sort_memory_budget = memory_limit / 2; // The rest is for due dates, buffers and the like
+    }
+    const char *no_daemon = getenv("TASAKMAN_NO_DAEMON");
+    bool use_daemon = !trace_enabled && (no_daemon == NULL || strcmp(no_daemon, "0") == 0 || no_daemon[0] == '\0');
+    for (size_t i = 0; use_daemon && i < sizeof(store_commands) / sizeof(store_commands[0]); i++) {
+        if (strcmp(argv[1], store_commands[i]) == 0) {
+            int forwarded = forwardToDaemon(argc, argv);
+            if (forwarded != -1) {
+                return forwarded;
+            }
+            spawnDaemon();
+            break;
+        }
+    }
+
+    // Check the command argument
+    int status = runStoreCommand(argv[0], argc, argv, stdout);
+    if (status != -1) {
+        return status;
+    } else if (strcmp(argv[1], "remind") == 0) {
+        // The hook can be given with --exec or through TASAKMAN_REMIND_HOOK
+        const char *hook = getenv("TASAKMAN_REMIND_HOOK");
+        if (argc >= 4 && strcmp(argv[2], "--exec") == 0) {
+            hook = argv[3];
+        }
+        remindTasks(hook);
+    } else if (strcmp(argv[1], "diff") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s diff <storeA> <storeB>\n", argv[0]);
+            return 1;
+        }
+        int differences = diffStores(argv[2], argv[3]);
+        return differences == 0 ? 0 : 1; // Like diff(1): non-zero when the stores differ
+    } else if (strcmp(argv[1], "replicate") == 0) {
+        if (argc < 4 || strcmp(argv[2], "--to") != 0) {
+            printf("Usage: %s replicate --to <dir> [--once]\n", argv[0]);
+            return 1;
+        }
+        bool once = argc > 4 && strcmp(argv[4], "--once") == 0;
+        replicateTasks(argv[3], once);
+    } else if (strcmp(argv[1], "merge") == 0) {
         if (argc < 3) {
-            printf("Usage: %s pending <task_id>\n", argv[0]);
+            printf("Usage: %s merge <store>\n", argv[0]);
             return 1;
         }
-        int taskId = atoi(argv[2]);
-        if (taskId <= 0) {
-            printf("Invalid task ID. Please provide a positive integer.\n");
+        mergeStores(argv[2]);
+    } else if (strcmp(argv[1], "backup") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s backup <dir>\n", argv[0]);
             return 1;
         }
-        modifyTaskStatus(taskId, false);
-    } else if (strcmp(argv[1], "delete") == 0) {
+        backupStore(argv[2]);
+    } else if (strcmp(argv[1], "restore") == 0) {
         if (argc < 3) {
-            printf("Usage: %s delete <task_id>\n", argv[0]);
+            printf("Usage: %s restore <dir> [snapshot] [--to <dir>]\n", argv[0]);
             return 1;
         }
-        int taskId = atoi(argv[2]);
-        if (taskId <= 0) {
-            printf("Invalid task ID. Please provide a positive integer.\n");
+        const char *snapshot = NULL;
+        const char *target_dir = task_dir_path; // Restore over the current store by default
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+                target_dir = argv[++i];
+            } else {
+                snapshot = argv[i];
+            }
+        }
+        restoreStore(argv[2], snapshot, target_dir);
+    } else if (strcmp(argv[1], "serve") == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int worker_count = cpus < 2 ? 2 : cpus > VERSION_READER_SLOTS - 2 ? VERSION_READER_SLOTS - 2 : (int)cpus;
+        int http_port = 0, idle_minutes = 0;
+        for (int i = 2; i < argc; i += 2) {
+            if (i + 1 < argc && strcmp(argv[i], "--workers") == 0 && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < VERSION_READER_SLOTS - 1) {
+                worker_count = atoi(argv[i + 1]);
+            } else if (i + 1 < argc && strcmp(argv[i], "--http") == 0 && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < 65536) {
+                http_port = atoi(argv[i + 1]);
+            } else if (i + 1 < argc && strcmp(argv[i], "--idle-timeout") == 0 && atoi(argv[i + 1]) > 0) {
+                idle_minutes = atoi(argv[i + 1]);
+            } else {
+                printf("Usage: %s serve [--workers N] [--http <port>] [--idle-timeout <minutes>]\n", argv[0]);
+                return 1;
+            }
+        }
+        serveDaemon(worker_count, http_port, idle_minutes);
+    } else if (strcmp(argv[1], "batch") == 0) {
+        if (argc > 3 || (argc == 3 && strcmp(argv[2], "--ring") != 0)) {
+            printf("Usage: %s batch [--ring] < commands\n", argv[0]);
+            return 1;
+        }
+        runBatch(stdin, argc == 3);
+    } else if (strcmp(argv[1], "report") == 0) {
+        if (argc != 4 || strcmp(argv[2], "--group-by") != 0 || !reportTasks(argv[3])) {
+            printf("Usage: %s report --group-by status|tag|day\n", argv[0]);
+            return 1;
+        }
+    } else if (strcmp(argv[1], "query") == 0) {
+        bool explain = argc >= 3 && strcmp(argv[2], "--explain") == 0;
+        int first = explain ? 3 : 2;
+        // The query may be one quoted argument or spread over several
+        char text[DAEMON_MAX_REQUEST] = "";
+        size_t length = 0;
+        for (int i = first; i < argc && length < sizeof(text) - 1; i++) {
+            length += snprintf(text + length, sizeof(text) - length, "%s%s", argv[i], i < argc - 1 ? " " : "");
+        }
+        return runQuery(text, explain);
+    } else if (strcmp(argv[1], "policy") == 0) {
+        static const char *const policies[] = {"off", "reject", "merge"};
+        if (argc == 2) {
+            printf("unique=%s\n", policies[uniquePolicy()]);
+        } else if (argc == 4 && strcmp(argv[2], "unique") == 0 &&
+                   (strcmp(argv[3], "off") == 0 || strcmp(argv[3], "reject") == 0 || strcmp(argv[3], "merge") == 0)) {
+            if (!setPolicy(argv[3])) {
+                return 1;
+            }
+            printf("Duplicate policy set to %s.\n", argv[3]);
+        } else {
+            printf("Usage: %s policy [unique off|reject|merge]\n", argv[0]);
+            return 1;
+        }
+    } else if (strcmp(argv[1], "metrics") == 0) {
+        // Metrics live in the daemon, so this is always forwarded (even with TASAKMAN_NO_DAEMON)
+        int forwarded = forwardToDaemon(argc, argv);
+        if (forwarded == -1) {
+            printf("No daemon is running for %s.\n", task_dir_path);
             return 1;
         }
-        deleteTask(taskId);
+        return forwarded;
     } else {
         printf("Unknown command: %s\n", argv[1]);
-        printf("Usage:\n");
-        printf("  %s add <description>\n", argv[0]);
-        printf("  %s list\n", argv[0]);
-        printf("  %s done <task_id>\n", argv[0]);
-        printf("  %s pending <task_id>\n", argv[0]);
-        printf("  %s delete <task_id>\n", argv[0]);
+        printf("Usage: %s [--trace] [--mem-limit SIZE] <command>\n", argv[0]);
+        printf("  %s add [--unique] <description>\n", argv[0]);
+        printf("  %s list [--id-range A-B] [--sort-by description|created|due|priority] [--limit K]\n", argv[0]);
+        printf("  %s done <task_id>...\n", argv[0]);
+        printf("  %s pending <task_id>...\n", argv[0]);
+        printf("  %s delete <task_id>...\n", argv[0]);
+        printf("  %s due <task_id> <YYYY-MM-DD [HH:MM]|+N[m|h|d]|none>\n", argv[0]);
+        printf("  %s remind [--exec <command>]\n", argv[0]);
+        printf("  %s diff <storeA> <storeB>\n", argv[0]);
+        printf("  %s replicate --to <dir> [--once]\n", argv[0]);
+        printf("  %s merge <store>\n", argv[0]);
+        printf("  %s backup <dir>\n", argv[0]);
+        printf("  %s restore <dir> [snapshot] [--to <dir>]\n", argv[0]);
+        printf("  %s serve [--workers N] [--http <port>] [--idle-timeout <minutes>]\n", argv[0]);
+        printf("  %s batch [--ring] < commands\n", argv[0]);
+        printf("  %s policy [unique off|reject|merge]\n", argv[0]);
+        printf("  %s report --group-by status|tag|day\n", argv[0]);
+        printf("  %s query [--explain] '<query>'\n", argv[0]);
+        printf("  %s metrics [--prometheus]\n", argv[0]);
         return 1;
     }
 
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Checks that 'restore' brings back exactly what 'backup' saw, and that it refuses a snapshot
+# manifest naming a file outside the target directory.
+# Usage: tests/backup_restore.sh <path to tasakman binary>
+set -eu
+
+bin=${1:?usage: $0 <tasakman binary>}
+case $bin in /*) ;; *) bin=$(pwd)/$bin ;; esac
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+export HOME="$tmp" TASAKMAN_NO_DAEMON=1 TASAKMAN_DIR="$tmp/store"
+mkdir -p "$tmp/.local/taskmanager"
+
+tk() {
+    "$bin" "$@" >/dev/null
+}
+
+status=0
+fail() {
+    echo "FAIL: $1"
+    status=1
+}
+
+# Round trip: the restored store matches the one that was backed up
+i=0
+while [ $i -lt 200 ]; do
+    tk add "task number $i with some padding to span several chunks"
+    i=$((i + 1))
+done
+tk done 7
+tk due 9 2099-01-01
+tk diff "$tmp/store" "$tmp/store" # Leaves a merkle.bin behind
+[ -e "$tmp/store/merkle.bin" ] || fail "diff did not build merkle.bin"
+tk backup "$tmp/backup"
+cp "$tmp/store/tasks.txt" "$tmp/tasks.saved"
+cp "$tmp/store/due.txt" "$tmp/due.saved"
+log_header=$(head -n 1 "$tmp/store/oplog.txt")
+
+tk delete 3
+tk add "added after the backup"
+tk restore "$tmp/backup"
+cmp -s "$tmp/store/tasks.txt" "$tmp/tasks.saved" || fail "tasks.txt not restored"
+cmp -s "$tmp/store/due.txt" "$tmp/due.saved" || fail "due.txt not restored"
+[ "$(head -n 1 "$tmp/store/oplog.txt")" != "$log_header" ] || fail "restore kept the old operation log"
+[ "$(wc -l <"$tmp/store/oplog.txt")" -eq 1 ] || fail "new operation log is not empty"
+
+tk restore "$tmp/backup" --to "$tmp/copy"
+cmp -s "$tmp/copy/tasks.txt" "$tmp/tasks.saved" || fail "restore --to did not copy tasks.txt"
+[ ! -e "$tmp/copy/remind.sent" ] && [ ! -e "$tmp/copy/merkle.bin" ] || fail "runtime state was backed up"
+
+# A manifest entry that climbs out of the target directory is refused, and nothing is written
+snapshot=$(ls "$tmp/backup/snapshots" | tail -n 1)
+chunk=$(sed -n 's/^C \([0-9a-f]*\) .*/\1/p' "$tmp/backup/snapshots/$snapshot" | head -n 1)
+length=$(sed -n 's/^C [0-9a-f]* \([0-9]*\)$/\1/p' "$tmp/backup/snapshots/$snapshot" | head -n 1)
+printf 'F ../escaped %s 644\nC %s %s\n' "$length" "$chunk" "$length" >"$tmp/backup/snapshots/99999999-evil"
+cp "$tmp/store/tasks.txt" "$tmp/tasks.before"
+if "$bin" restore "$tmp/backup" 99999999-evil --to "$tmp/target" >/dev/null 2>&1; then :; fi
+[ ! -e "$tmp/escaped" ] && [ ! -e "$tmp/escaped.restore.tmp" ] || fail "manifest entry escaped the target directory"
+cmp -s "$tmp/store/tasks.txt" "$tmp/tasks.before" || fail "refused restore changed the store"
+
+# So is a chunk name that is not a chunk name
+printf 'F tasks.txt 5 644\nC ../../../etc/passwd 5\n' >"$tmp/backup/snapshots/99999999-evil"
+if "$bin" restore "$tmp/backup" 99999999-evil >/dev/null 2>&1; then :; fi
+cmp -s "$tmp/store/tasks.txt" "$tmp/tasks.before" || fail "restore used a chunk outside the backup"
+
+[ $status -eq 0 ] && echo "PASS: backup and restore"
+exit $status
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Checks that 'merge' is symmetric: merging copy B into copy A gives the same tasks and record
+# states as merging A into B, including when both copies used the same IDs.
+# Usage: tests/merge_order.sh <path to tasakman binary>
+set -eu
+
+bin=${1:?usage: $0 <tasakman binary>}
+case $bin in /*) ;; *) bin=$(pwd)/$bin ;; esac
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+export HOME="$tmp" TASAKMAN_NO_DAEMON=1
+mkdir -p "$tmp/.local/taskmanager"
+
+tk() {
+    store=$1
+    shift
+    TASAKMAN_DIR="$tmp/$store" "$bin" "$@" >/dev/null
+}
+
+# A shared history: B starts as a merge of A
+tk a add "write report"
+tk a add "book flights"
+tk a add "renew passport"
+tk a due 3 2099-01-01
+tk b merge "$tmp/a"
+
+# Diverge: both copies add tasks under the same new IDs, and change the same records
+tk a add "call plumber"
+tk a done 1
+tk a delete 2
+tk a due 4 2099-02-01
+tk b add "buy milk"
+tk b add "pay rent"
+tk b due 4 2099-03-01
+tk b done 3
+tk b pending 1
+tk b done 1
+
+cp -R "$tmp/a" "$tmp/a2"
+cp -R "$tmp/b" "$tmp/b2"
+tk a merge "$tmp/b"  # A <- B
+tk b2 merge "$tmp/a2" # B <- A
+
+status=0
+if ! cmp -s "$tmp/a/tasks.txt" "$tmp/b2/tasks.txt"; then
+    echo "FAIL: tasks.txt differs between 'merge A B' and 'merge B A'"
+    diff "$tmp/a/tasks.txt" "$tmp/b2/tasks.txt" || true
+    status=1
+fi
+# crdt.txt starts with each store's own replica ID
+tail -n +2 "$tmp/a/crdt.txt" >"$tmp/a.records"
+tail -n +2 "$tmp/b2/crdt.txt" >"$tmp/b2.records"
+if ! cmp -s "$tmp/a.records" "$tmp/b2.records"; then
+    echo "FAIL: crdt.txt records differ between 'merge A B' and 'merge B A'"
+    status=1
+fi
+# "buy milk" was created after "call plumber", so it gives up ID 4 and takes its due date along
+if ! grep -q '^6,0,buy milk$' "$tmp/b2/tasks.txt" || ! grep -q '^6,' "$tmp/b2/due.txt"; then
+    echo "FAIL: renumbered task lost its due date"
+    status=1
+fi
+
+# Merging the results again changes nothing
+before=$(cat "$tmp/a/tasks.txt")
+tk a merge "$tmp/b2"
+if [ "$(cat "$tmp/a/tasks.txt")" != "$before" ]; then
+    echo "FAIL: merging converged copies changed tasks.txt"
+    status=1
+fi
+
+[ $status -eq 0 ] && echo "PASS: merge order"
+exit $status